@@ -0,0 +1,42 @@
+function conflicts = applyChangeset(varargin)
+%APPLYCHANGESET Apply a changeset to the database.
+%
+%    conflicts = sqlite3.applyChangeset(database, bytes, policy)
+%    conflicts = sqlite3.applyChangeset(database, bytes)
+%    conflicts = sqlite3.applyChangeset(bytes, ...)
+%
+% The applyChangeset operation applies the changeset or patchset `bytes` of
+% sqlite3.changeset to the connection specified by the connection id
+% `database`, and returns the number of conflicts. When `database` is
+% omitted, the default connection is used. The changes are applied in a
+% savepoint, and nothing changes when the changeset is aborted.
+%
+% The conflict policy `policy` decides a change that conflicts with the
+% database, e.g., an update of a row whose values differ from the original
+% values in the changeset, or an insert of an existing primary key.
+%
+%    'abort'    Abort the changeset and raise an error. Default.
+%    'omit'     Skip the conflicting change.
+%    'replace'  Overwrite the row with the change. Changes of missing rows
+%               and constraint violations are skipped.
+%
+% Example:
+%     bytes = sqlite3.changeset(session);
+%     conflicts = sqlite3.applyChangeset(replica, bytes, 'replace');
+%
+% See also sqlite3.changeset sqlite3.sessionStart
+  narginchk(1, 3);
+  if ~isa(varargin{1}, 'uint8')
+    database = varargin(1);
+    varargin = varargin(2:end);
+  else
+    database = {};
+  end
+  if isempty(varargin)
+    error('sqlite3:applyChangeset', 'Missing changeset.');
+  end
+  if numel(varargin) < 2
+    varargin{2} = 'abort';
+  end
+  conflicts = libsqlite3_('applyChangeset', database{:}, varargin{:});
+end
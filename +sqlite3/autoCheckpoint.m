@@ -0,0 +1,40 @@
+function autoCheckpoint(varargin)
+%AUTOCHECKPOINT Checkpoint the WAL and free pages in the background.
+%
+%    sqlite3.autoCheckpoint(database, 'Interval', milliseconds, ...)
+%    sqlite3.autoCheckpoint(...)
+%
+% The autoCheckpoint operation starts a background thread that maintains the
+% database file of the connection specified by the connection id `database`
+% every 'Interval' milliseconds. When `database` is omitted, the default
+% connection is used. The thread has its own connection to the file, so
+% queries of the connection do not wait for it. Each round
+%
+%  1. frees up to 'VacuumPages' pages by PRAGMA incremental_vacuum, which
+%     needs PRAGMA auto_vacuum = INCREMENTAL set before the first table is
+%     created, and
+%  2. checkpoints the WAL in the PASSIVE mode, which copies the frames that
+%     no reader needs without waiting, or in the TRUNCATE mode when the WAL is
+%     larger than 'MaxWalSize' bytes, which waits up to the interval for the
+%     readers and writers to finish and empties the WAL file.
+%
+% The default checkpoint on commit is starved by continuous writers, and the
+% WAL grows and slows down reads. Disable it by PRAGMA wal_autocheckpoint = 0
+% on the writers to keep commits short.
+%
+%    'Interval'     Milliseconds between rounds. Default 1000. Zero stops the
+%                   thread.
+%    'MaxWalSize'   Bytes of the WAL that escalate the checkpoint. Default
+%                   64 MiB.
+%    'VacuumPages'  Pages freed per round. Default 0.
+%
+% See sqlite3.checkpointStats for the statistics.
+%
+% Example:
+%     sqlite3.execute(database, 'PRAGMA journal_mode = WAL');
+%     sqlite3.autoCheckpoint(database, 'Interval', 500, ...
+%                            'MaxWalSize', 256 * 2^20);
+%
+% See also sqlite3.checkpointStats
+  libsqlite3_('autoCheckpoint', varargin{:});
+end
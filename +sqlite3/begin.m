@@ -0,0 +1,25 @@
+function begin(varargin)
+%BEGIN Begin a transaction.
+%
+%    sqlite3.begin()
+%    sqlite3.begin(mode)
+%    sqlite3.begin(database, ...)
+%
+% The begin operation starts a transaction in the database specified by the
+% connection id `database`. When `database` is omitted, the default
+% connection is used. The mode is one of 'deferred' (default), 'immediate',
+% or 'exclusive'. Pending writes of the group commit are committed first.
+%
+% See also sqlite3.commit sqlite3.rollback sqlite3.savepoint
+  if nargin > 0 && ~ischar(varargin{1})
+    database = varargin(1);
+    varargin = varargin(2:end);
+  else
+    database = {};
+  end
+  mode = 'deferred';
+  if ~isempty(varargin)
+    mode = lower(varargin{1});
+  end
+  libsqlite3_('begin', database{:}, mode);
+end
@@ -0,0 +1,54 @@
+function bulkLoad(varargin)
+%BULKLOAD Run a load into indexed tables without maintaining the indexes.
+%
+%    sqlite3.bulkLoad(tables, load, ...)
+%    sqlite3.bulkLoad(database, tables, load, ...)
+%
+% The bulkLoad operation calls the function handle `load` with indexes of the
+% tables `tables`, a table name or a cellstr of names, dropped and writes not
+% synced in the database specified by the connection id `database`. After the
+% load, the indexes are rebuilt with a sorted build and the settings are
+% restored, also when the load fails. When `database` is omitted, the default
+% connection is used. The load must not leave a transaction open.
+%
+% Maintaining an index per inserted row dominates the cost of large loads.
+% Building the index once from the loaded rows is several times faster.
+% Indexes of UNIQUE and PRIMARY KEY constraints are kept, and a UNIQUE index
+% rebuilt over duplicate rows fails the operation.
+%
+% The load runs with PRAGMA synchronous = OFF, so an operating system crash or
+% a power loss during the load may lose the loaded rows or corrupt the
+% database; back up the database first if that matters. A crash of matlab
+% itself is safe. The definitions of the dropped indexes are kept in the
+% sqlite3mex_bulkload table in the same transaction that drops them, and
+% sqlite3.bulkLoadEnd rebuilds them even after the load did not end, e.g., on
+% the next connection. Once bulkLoad returns, the loaded rows and the indexes
+% are synced to the disk.
+%
+% Options:
+%
+%    'CacheSize'   Bytes of the page cache during the load. Default 2^30.
+%
+% Example:
+%     sqlite3.bulkLoad('events', @() sqlite3.importCSV('events', ...
+%                                                      '/path/to/events.csv'));
+%
+% See also sqlite3.bulkLoadBegin sqlite3.bulkLoadEnd sqlite3.importCSV
+  narginchk(2, inf);
+  if ~ischar(varargin{1}) && ~iscell(varargin{1})
+    database = varargin(1);
+    varargin = varargin(2:end);
+  else
+    database = {};
+  end
+  narginchk(numel(database) + 2, inf);
+  [tables, load] = varargin{1:2};
+  sqlite3.bulkLoadBegin(database{:}, tables, varargin{3:end});
+  try
+    load();
+  catch e
+    sqlite3.bulkLoadEnd(database{:});
+    rethrow(e);
+  end
+  sqlite3.bulkLoadEnd(database{:});
+end
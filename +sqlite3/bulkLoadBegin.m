@@ -0,0 +1,30 @@
+function bulkLoadBegin(varargin)
+%BULKLOADBEGIN Start a bulk load into indexed tables.
+%
+%    sqlite3.bulkLoadBegin(tables, ...)
+%    sqlite3.bulkLoadBegin(database, tables, ...)
+%
+% The bulkLoadBegin operation drops the indexes of the tables `tables`, a
+% table name or a cellstr of names, keeping their definitions in the
+% sqlite3mex_bulkload table, and turns off synced writes with a large page
+% cache in the database specified by the connection id `database`. Call
+% sqlite3.bulkLoadEnd after the load. When `database` is omitted, the default
+% connection is used. See sqlite3.bulkLoad for the options and the crash
+% safety.
+%
+% Example:
+%     sqlite3.bulkLoadBegin({'events', 'sessions'});
+%     sqlite3.importCSV('events', '/path/to/events.csv');
+%     sqlite3.importCSV('sessions', '/path/to/sessions.csv');
+%     sqlite3.bulkLoadEnd();
+%
+% See also sqlite3.bulkLoad sqlite3.bulkLoadEnd
+  narginchk(1, inf);
+  if ~ischar(varargin{1}) && ~iscell(varargin{1})
+    narginchk(2, inf);
+    varargin{2} = cellstr(varargin{2});
+  else
+    varargin{1} = cellstr(varargin{1});
+  end
+  libsqlite3_('bulkLoadBegin', varargin{:});
+end
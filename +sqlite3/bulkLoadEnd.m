@@ -0,0 +1,17 @@
+function bulkLoadEnd(varargin)
+%BULKLOADEND End the bulk load and rebuild the indexes.
+%
+%    sqlite3.bulkLoadEnd()
+%    sqlite3.bulkLoadEnd(database)
+%
+% The bulkLoadEnd operation restores the settings changed by
+% sqlite3.bulkLoadBegin and rebuilds the indexes kept in the
+% sqlite3mex_bulkload table in one transaction in the database specified by
+% the connection id `database`, including the ones of a load that did not
+% end. When a rebuild fails, e.g., a UNIQUE index over duplicate rows, no
+% index is rebuilt and the definitions stay for the next call. When `database`
+% is omitted, the default connection is used.
+%
+% See also sqlite3.bulkLoad sqlite3.bulkLoadBegin
+  libsqlite3_('bulkLoadEnd', varargin{:});
+end
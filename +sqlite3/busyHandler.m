@@ -0,0 +1,36 @@
+function busyHandler(varargin)
+%BUSYHANDLER Wait on locked databases with exponential backoff.
+%
+%    sqlite3.busyHandler(database, ...)
+%    sqlite3.busyHandler(...)
+%
+% The busyHandler operation sets how the connection specified by the
+% connection id `database` waits when the database is locked by other
+% connections or processes. When `database` is omitted, the default
+% connection is used. Each retry waits twice as long as the previous one up
+% to 'MaxDelay', and the jitter shortens each wait at random so that writers
+% blocked by the same lock do not retry in lockstep. The statement fails with
+% "database is locked" once the waits reach 'MaxWait', on Ctrl-C, or past the
+% deadline of sqlite3.limits.
+%
+%    'InitialDelay'  Milliseconds of the first wait. Default 1.
+%    'MaxDelay'      Maximum milliseconds of a wait. Default 100.
+%    'MaxWait'       Maximum milliseconds of waits for a lock. Zero fails at
+%                    once without waiting. Default 5000.
+%    'Jitter'        Fraction between 0 and 1 of a wait that is cut at
+%                    random. Default 0.5.
+%
+% The waits are counted in sqlite3.busyStats. sqlite3.timeout replaces this
+% handler with the built-in one of SQLite, which is not counted.
+%
+% Writers avoid the deadlock of two transactions that read and then both try
+% to write, where SQLite fails one of them without waiting, by taking the
+% write lock at the start with sqlite3.begin('immediate') or
+% sqlite3.transaction.
+%
+% Example:
+%     sqlite3.busyHandler(database, 'MaxWait', 30000, 'MaxDelay', 250);
+%
+% See also sqlite3.busyStats sqlite3.timeout sqlite3.transaction
+  libsqlite3_('busyHandler', varargin{:});
+end
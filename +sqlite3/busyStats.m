@@ -0,0 +1,27 @@
+function stats = busyStats(varargin)
+%BUSYSTATS Get the statistics of waits on locked databases.
+%
+%    stats = sqlite3.busyStats(database, 'Reset', false)
+%    stats = sqlite3.busyStats(...)
+%
+% The busyStats operation returns the statistics of sqlite3.busyHandler of
+% the connection specified by the connection id `database`. When `database`
+% is omitted, the default connection is used. The result is a struct with
+% the following fields.
+%
+%    Events       Number of times a lock was found busy.
+%    Retries      Number of waits before retrying the lock.
+%    Failures     Number of events that gave up with "database is locked".
+%    WaitTime     Total seconds waited.
+%    LongestWait  Longest seconds waited for a lock.
+%
+% The statistics are reset after they are taken when 'Reset' is true.
+%
+% Example:
+%     stats = sqlite3.busyStats(database, 'Reset', true);
+%     fprintf('%.1f s lost to locking in %d events\n', stats.WaitTime, ...
+%             stats.Events);
+%
+% See also sqlite3.busyHandler
+  stats = libsqlite3_('busyStats', varargin{:});
+end
@@ -0,0 +1,31 @@
+function changes = changesSince(varargin)
+%CHANGESSINCE Get the rows changed since the token.
+%
+%    changes = sqlite3.changesSince(token)
+%    changes = sqlite3.changesSince(database, token)
+%
+% The changesSince operation returns the rows changed since `token` in the
+% connection specified by the connection id `database`, recorded after
+% sqlite3.trackChanges. When `database` is omitted, the default connection
+% is used. The result is a struct with the following fields.
+%
+%    Token     Token of the next change to pass to the next call.
+%    Overflow  true if some of the changes since the token were dropped for
+%              the capacity. Then the tables must be read again in full.
+%    Tables    Struct array of the changed tables with fields Table,
+%              Inserted, Updated, and Deleted. Each of them is a sorted int64
+%              column vector of rowids by the net change since the token,
+%              e.g., a row inserted and then updated is in Inserted, and a
+%              row inserted and then deleted is not reported.
+%
+% Example:
+%     changes = sqlite3.changesSince(token);
+%     token = changes.Token;
+%     for i = 1:numel(changes.Tables)
+%       updated = [changes.Tables(i).Inserted; changes.Tables(i).Updated];
+%     end
+%
+% See also sqlite3.trackChanges
+  narginchk(1, 2);
+  changes = libsqlite3_('changesSince', varargin{:});
+end
@@ -0,0 +1,26 @@
+function bytes = changeset(session, varargin)
+%CHANGESET Get the changes recorded by the session.
+%
+%    bytes = sqlite3.changeset(session)
+%    bytes = sqlite3.changeset(session, 'Patchset', true)
+%
+% The changeset operation returns the net changes recorded by the session
+% `session` of sqlite3.sessionStart as a uint8 row vector of the changeset
+% format of SQLite. The session keeps recording, and the next changeset
+% contains all the changes since the session started.
+%
+%    'Patchset'  Return the compact patchset instead, which omits the
+%                original values of updated and deleted rows. A patchset
+%                cannot detect DATA conflicts when it is applied. Default
+%                false.
+%
+% Example:
+%     bytes = sqlite3.changeset(session);
+%     fid = fopen('changes.bin', 'w');
+%     fwrite(fid, bytes, 'uint8');
+%     fclose(fid);
+%
+% See also sqlite3.sessionStart sqlite3.applyChangeset
+  narginchk(1, 3);
+  bytes = libsqlite3_('changeset', session, varargin{:});
+end
@@ -0,0 +1,28 @@
+function stats = checkpointStats(varargin)
+%CHECKPOINTSTATS Get the statistics of the background checkpoints.
+%
+%    stats = sqlite3.checkpointStats(database, 'Reset', false)
+%    stats = sqlite3.checkpointStats(...)
+%
+% The checkpointStats operation returns the statistics of
+% sqlite3.autoCheckpoint of the connection specified by the connection id
+% `database`. When `database` is omitted, the default connection is used.
+% The result is a struct with the following fields.
+%
+%    Checkpoints      Number of checkpoints.
+%    Truncates        Number of checkpoints escalated to the TRUNCATE mode.
+%    Busy             Number of checkpoints that left frames in the WAL for
+%                     the readers or writers.
+%    VacuumedPages    Number of pages freed by incremental_vacuum.
+%    WalSize          Bytes of the WAL after the last checkpoint. -1 when the
+%                     database is not in WAL mode.
+%    MaxWalSize       Largest bytes of the WAL seen before a checkpoint.
+%    LastDuration     Seconds of the last checkpoint.
+%    LongestDuration  Longest seconds of a checkpoint.
+%    TotalDuration    Total seconds of the checkpoints.
+%
+% The statistics are reset after they are taken when 'Reset' is true.
+%
+% See also sqlite3.autoCheckpoint
+  stats = libsqlite3_('checkpointStats', varargin{:});
+end
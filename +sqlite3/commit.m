@@ -0,0 +1,13 @@
+function commit(varargin)
+%COMMIT Commit the transaction.
+%
+%    sqlite3.commit()
+%    sqlite3.commit(database)
+%
+% The commit operation commits the transaction in the database specified by
+% the connection id `database`. When `database` is omitted, the default
+% connection is used.
+%
+% See also sqlite3.begin sqlite3.rollback
+  libsqlite3_('commit', varargin{:});
+end
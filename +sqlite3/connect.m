@@ -0,0 +1,25 @@
+function database = connect(descriptor)
+%CONNECT Open the database of the descriptor once per process.
+%
+%    database = sqlite3.connect(descriptor)
+%
+% The connect operation returns the connection id of the database described
+% by `descriptor` of sqlite3.descriptor. The first call in a MATLAB process,
+% e.g., in a parallel worker, opens the database, runs the pragmas, and
+% loads the schema, and later calls with the same descriptor return the same
+% connection while it is open. Calling connect at the top of a parfor body
+% is cheap after the first iteration on each worker.
+%
+% Example:
+%     descriptor = sqlite3.descriptor('dataset.sqlite3', 'Immutable', true);
+%     parfor i = 1:100
+%       database = sqlite3.connect(descriptor);
+%       counts(i) = sqlite3.execute(database, ...
+%           'SELECT count(*) AS n FROM records WHERE label = ?', i).n;
+%     end
+%
+% See also sqlite3.descriptor sqlite3.open sqlite3.close
+  narginchk(1, 1);
+  database = libsqlite3_('connect', descriptor.Filename, ...
+                         descriptor.Pragmas, descriptor.Options{:});
+end
@@ -0,0 +1,80 @@
+function descriptor = descriptor(filename, varargin)
+%DESCRIPTOR Create a connection descriptor for parallel workers.
+%
+%    descriptor = sqlite3.descriptor(filename, ...)
+%
+% The descriptor operation returns a struct that describes how to open the
+% database `filename`. Unlike a connection id, the descriptor can be sent to
+% parfor and spmd workers, where sqlite3.connect opens the database once per
+% worker process and returns the same connection afterwards. A relative
+% file name is resolved against the current folder of the client.
+%
+% The function takes the flags of sqlite3.open, and the following options.
+%
+%    'Immutable'  Open the file read only as immutable, i.e., the file is
+%                 never changed while it is open. SQLite skips locking and
+%                 change detection, and the file is memory mapped so that all
+%                 workers on a host share its pages through the OS cache.
+%                 Default false.
+%    'MmapSize'   Bytes of the file mapped into memory. Default 1 TB when
+%                 'Immutable', which SQLite caps at its compile-time limit
+%                 (2 GB unless SQLITE_MAX_MMAP_SIZE is set), and the default
+%                 of SQLite otherwise.
+%    'Pragmas'    Cellstr of pragmas run after open, e.g.,
+%                 {'cache_size = -65536', 'query_only = 1'}.
+%
+% Example:
+%     descriptor = sqlite3.descriptor('dataset.sqlite3', 'Immutable', true);
+%     parfor i = 1:numel(ids)
+%       database = sqlite3.connect(descriptor);
+%       rows{i} = sqlite3.execute(database, ...
+%                                 'SELECT * FROM records WHERE id = ?', ids(i));
+%     end
+%
+% See also sqlite3.connect sqlite3.open
+  descriptor = struct('Filename', absolutePath(filename), ...
+                      'Options', {{}}, ...
+                      'Pragmas', {{}});
+  immutable = false;
+  mmap_size = [];
+  i = 1;
+  while i <= numel(varargin)
+    switch varargin{i}
+      case {'ReadOnly', 'ReadWrite', 'Create', 'NoMutex', 'FullMutex', ...
+            'SharedCache', 'PrivateCache', 'OpenURI'}
+        descriptor.Options = [descriptor.Options, varargin(i), {true}];
+        i = i + 1;
+      case 'Immutable'
+        immutable = logical(varargin{i + 1});
+        i = i + 2;
+      case 'MmapSize'
+        mmap_size = varargin{i + 1};
+        i = i + 2;
+      case 'Pragmas'
+        descriptor.Pragmas = cellstr(varargin{i + 1});
+        i = i + 2;
+      otherwise
+        error('sqlite3:descriptor', 'Invalid option: %s', varargin{i});
+    end
+  end
+  if immutable
+    descriptor.Options = [descriptor.Options, {'Immutable', true}];
+    if isempty(mmap_size)
+      mmap_size = 2^40;
+    end
+  end
+  if ~isempty(mmap_size)
+    descriptor.Pragmas = [{sprintf('mmap_size = %d', mmap_size)}, ...
+                          descriptor.Pragmas];
+  end
+end
+
+function filename = absolutePath(filename)
+%ABSOLUTEPATH Resolve the file name against the current folder.
+  if isempty(filename) || filename(1) == ':' || ...
+     strncmp(filename, 'file:', 5) || filename(1) == '/' || ...
+     filename(1) == '\' || (numel(filename) > 1 && filename(2) == ':')
+    return;
+  end
+  filename = fullfile(pwd, filename);
+end
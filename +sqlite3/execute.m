@@ -10,13 +10,50 @@ function results = execute(varargin)
 %
 % The sql statement can use binding of the value through `?` as the
 % placeholder. When the binding is used, there must be the corresponding
-% number of parameters followed by the sql statement.
+% number of parameters followed by the sql statement. Named placeholders,
+% `:name`, `@name`, or `$name`, are bound to the fields of the same name in a
+% struct given as the only parameter.
+%
+% Results are a struct array of rows. Options can follow the parameters as
+% name-value pairs.
+%
+%    'Format'   'struct' (default) or 'table'. The table format builds a
+%               table from per-column arrays: numeric columns are double
+%               with NaN for null, text columns are string arrays with
+%               missing for null, and blob or mixed columns are cell arrays.
+%               VariableDescriptions keep the column names reported by
+%               SQLite.
+%    'Dictionary'  'off' (default), 'on', or 'auto'. In the table format,
+%               text columns are returned as categorical arrays, keeping one
+%               copy of each distinct text. Null and empty text are
+%               undefined. 'auto' encodes a column only when the number of
+%               distinct texts per row is below 'DictionaryThreshold'. A
+%               column with texts starting or ending in white space stays
+%               a string array, as categorical trims the category names.
+%    'DictionaryThreshold'  Ratio of distinct texts to rows for 'auto'.
+%               Default 0.1.
+%    'MaxRows', 'MaxBytes', 'Deadline'  Resource limits of this call. See
+%               sqlite3.limits.
+%    'SpillThreshold'  Bytes of the staged result kept in memory. When the
+%               result grows beyond it, rows are streamed to a columnar file
+%               and the result is a struct of memmapfile per column. See
+%               sqlite3.readColumns. Default 0 keeps everything in memory.
+%    'SpillFile'  Path of the spilled file. Default is a new file in the
+%               temporary directory. The caller deletes the file.
+%
+% Ctrl-C cancels a running query with the error id 'sqlite3:interrupted'.
 %
 % Example:
 %     results = sqlite3.execute('SELECT * FROM records WHERE rowid = ?', 1)
 %     results = sqlite3.execute(db_id, 'SELECT * FROM records WHERE name = ?', 'foo')
+%     results = sqlite3.execute('SELECT * FROM records WHERE name = :name', ...
+%                               struct('name', 'foo'))
+%     results = sqlite3.execute('SELECT * FROM records', 'Format', 'table')
+%     results = sqlite3.execute('SELECT * FROM events', 'Format', 'table', ...
+%                               'Dictionary', 'auto')
+%     results = sqlite3.execute('SELECT * FROM logs', 'SpillThreshold', 2^30)
 %
-% See also sqlite3.open sqlite3.close
+% See also sqlite3.open sqlite3.close sqlite3.limits sqlite3.readColumns
   narginchk(1, inf);
   if ischar(varargin{1})
     results = libsqlite3_('execute', varargin{1}, varargin(2:end));
@@ -27,4 +64,7 @@ function results = execute(varargin)
                           varargin{2}, ...
                           varargin(3:end));
   end
+  if ischar(results)
+    results = sqlite3.readColumns(results);
+  end
 end
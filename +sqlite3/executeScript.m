@@ -0,0 +1,36 @@
+function results = executeScript(varargin)
+%EXECUTESCRIPT Execute an SQL script of multiple statements.
+%
+%     results = sqlite3.executeScript(sql, param1, param2, ...)
+%     results = sqlite3.executeScript(database, sql, param1, param2, ...)
+%
+% The executeScript operation applies all statements separated by `;` in the
+% script `sql` in the database specified by the connection id `database`.
+% When `database` is omitted, the default connection is used.
+%
+% The statements run in a single transaction, or in a savepoint when a
+% transaction is already open, and the script must not contain transaction
+% statements itself. When any statement fails, all changes by the script are
+% rolled back and the error tells which statement failed. Parameters are
+% bound to the `?` placeholders in the order of appearance across statements.
+% Results are of the last statement.
+%
+% Example:
+%     sqlite3.executeScript(['CREATE TABLE records (id INTEGER, name TEXT);' ...
+%                            'CREATE INDEX records_id ON records (id);'])
+%     results = sqlite3.executeScript(db_id, ...
+%         ['INSERT INTO records VALUES (?, ?);' ...
+%          'SELECT * FROM records WHERE id = ?'], 1, 'foo', 1)
+%
+% See also sqlite3.execute
+  narginchk(1, inf);
+  if ischar(varargin{1})
+    results = libsqlite3_('executeScript', varargin{1}, varargin(2:end));
+  else
+    narginchk(2, inf);
+    results = libsqlite3_('executeScript', ...
+                          varargin{1}, ...
+                          varargin{2}, ...
+                          varargin(3:end));
+  end
+end
@@ -0,0 +1,33 @@
+function rows = exportArrow(varargin)
+%EXPORTARROW Write the result of an SQL statement in Apache Arrow IPC format.
+%
+%     rows = sqlite3.exportArrow(sql, params, filename, ...)
+%     rows = sqlite3.exportArrow(database, sql, params, filename, ...)
+%
+% The exportArrow operation applies sql statement `sql` in the database
+% specified by the connection id `database` and writes the result to
+% `filename` as Arrow record batches. When `database` is omitted, the
+% default connection is used. `params` is a cell array of the bind
+% parameters, and may be followed by the 'MaxRows' and 'Deadline' options of
+% sqlite3.execute. The return value is the number of rows written.
+%
+% Rows are written every batch, so memory use does not grow with the
+% result. Integer columns are Int64, float columns are Float64, text columns
+% are Utf8, and blob columns are Binary, following the declared type or the
+% first non-null value of an expression.
+%
+% Options:
+%
+%    'BatchSize'  Rows of a record batch. Default 65536.
+%    'Format'     'stream' (default) for the IPC stream format, or 'file'
+%                 for the IPC file format, also known as Feather V2.
+%
+% Example:
+%     sqlite3.exportArrow('SELECT * FROM records', {}, '/tmp/records.arrows');
+%     sqlite3.exportArrow('SELECT * FROM records WHERE id > ?', {100}, ...
+%                         '/tmp/records.arrow', 'Format', 'file');
+%
+% See also sqlite3.exportColumns sqlite3.execute
+  narginchk(3, inf);
+  rows = libsqlite3_('exportArrow', varargin{:});
+end
@@ -0,0 +1,41 @@
+function rows = exportCSV(varargin)
+%EXPORTCSV Write the result of an SQL statement to a CSV file.
+%
+%     rows = sqlite3.exportCSV(sql, params, filename, ...)
+%     rows = sqlite3.exportCSV(database, sql, params, filename, ...)
+%
+% The exportCSV operation applies sql statement `sql` in the database
+% specified by the connection id `database` and writes the result rows to
+% the CSV file `filename` as they are stepped, so memory use does not depend
+% on the size of the result. When `database` is omitted, the default
+% connection is used. `params` is a cell array of the bind parameters, and
+% may be followed by the 'MaxRows' and 'Deadline' options of sqlite3.execute.
+% The return value is the number of rows written.
+%
+% Floats are written with the fewest digits that read back to the same
+% value, and blobs are written in hex. With the default options, the file
+% reads back with sqlite3.importCSV: null is an unquoted empty field and
+% empty text is quoted.
+%
+% Options:
+%
+%    'Delimiter'    Field delimiter. Default ','. Use '\t' for tab.
+%    'Header'       true (default) to write the column names first.
+%    'Null'         Text written for null. Default ''. Text equal to it is
+%                   quoted.
+%    'Quote'        'minimal' (default) quotes text with delimiters, quotes,
+%                   or newlines. 'all' quotes all text, and 'none' never
+%                   quotes.
+%    'Compression'  'gzip' or 'none'. Default is 'gzip' when the file name
+%                   ends with .gz. Gzip needs the driver built with zlib.
+%
+% Example:
+%     sqlite3.exportCSV('SELECT * FROM records', {}, '/tmp/records.csv');
+%     sqlite3.exportCSV('SELECT * FROM events WHERE day = ?', {'mon'}, ...
+%                       '/tmp/events.tsv.gz', 'Delimiter', '\t', ...
+%                       'Null', 'NA');
+%
+% See also sqlite3.importCSV sqlite3.execute
+  narginchk(3, inf);
+  rows = libsqlite3_('exportCSV', varargin{:});
+end
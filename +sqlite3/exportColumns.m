@@ -0,0 +1,30 @@
+function rows = exportColumns(varargin)
+%EXPORTCOLUMNS Write the result of an SQL statement to a columnar file.
+%
+%     rows = sqlite3.exportColumns(sql, params, filename)
+%     rows = sqlite3.exportColumns(database, sql, params, filename)
+%
+% The exportColumns operation applies sql statement `sql` in the database
+% specified by the connection id `database` and writes the result to the
+% columnar file `filename`. When `database` is omitted, the default
+% connection is used. `params` is a cell array of the bind parameters, and
+% may be followed by the 'MaxRows' and 'Deadline' options of sqlite3.execute.
+%
+% Rows are streamed from SQLite to the file without creating matlab arrays,
+% so the result can be larger than memory. The file keeps a validity bitmap
+% of non-null rows, fixed-width int64 or double values for numeric columns,
+% and offsets and bytes for text and blob columns. The column type follows
+% the declared type of the column, or the first non-null value when there is
+% none. Other processes can read the file; the layout is documented in
+% src/columnar.cc. The return value is the number of rows written.
+%
+% Example:
+%     rows = sqlite3.exportColumns('SELECT * FROM records WHERE id > ?', ...
+%                                  {100}, '/tmp/records.col');
+%     columns = sqlite3.readColumns('/tmp/records.col');
+%     ids = columns.id.Data.data;
+%
+% See also sqlite3.readColumns sqlite3.execute
+  narginchk(3, 4);
+  rows = libsqlite3_('exportColumns', varargin{:});
+end
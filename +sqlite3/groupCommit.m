@@ -0,0 +1,25 @@
+function groupCommit(varargin)
+%GROUPCOMMIT Set the group commit of writes.
+%
+%    sqlite3.groupCommit(rows, milliseconds)
+%    sqlite3.groupCommit(database, rows, milliseconds)
+%    sqlite3.groupCommit(database, 0, 0)
+%
+% The groupCommit operation buffers writes outside of an explicit transaction
+% in an open transaction of the database specified by the connection id
+% `database`. The transaction is committed after `rows` changed rows or
+% `milliseconds` since the first write, whichever comes first, and always on
+% close. A background thread commits the transaction when no statement
+% arrives in time. Zero disables the condition, and setting both to zero
+% commits the pending writes and disables the group commit. When `database`
+% is omitted, the default connection is used.
+%
+% Example:
+%     sqlite3.groupCommit(1000, 200);
+%     for i = 1:numel(events)
+%       sqlite3.execute('INSERT INTO events VALUES (?)', events(i));
+%     end
+%
+% See also sqlite3.begin sqlite3.commit
+  libsqlite3_('groupCommit', varargin{:});
+end
@@ -0,0 +1,42 @@
+function rows = importCSV(varargin)
+%IMPORTCSV Import a CSV file into a table.
+%
+%     rows = sqlite3.importCSV(table, filename, ...)
+%     rows = sqlite3.importCSV(database, table, filename, ...)
+%
+% The importCSV operation inserts the records of the CSV file `filename` into
+% the table `table` in the database specified by the connection id
+% `database`. When `database` is omitted, the default connection is used.
+% The return value is the number of rows imported.
+%
+% The file is parsed on multiple threads in the driver and the rows are
+% inserted through one prepared statement, without creating matlab arrays.
+% When the table does not exist, it is created with INTEGER, REAL, or TEXT
+% columns inferred from the first records. Otherwise the header names the
+% columns to insert, and values follow the declared types of the table.
+% Unquoted empty fields are null. The whole file is imported in one
+% transaction, or in a savepoint within an open transaction, and nothing is
+% imported when a record is malformed, unless 'BatchSize' is given.
+%
+% Options:
+%
+%    'Delimiter'   Field delimiter. Default ','. Use '\t' for tab.
+%    'Header'      true (default) if the first record is the column names.
+%                  Otherwise columns are Var1, Var2, ... or the columns of
+%                  the table in order.
+%    'Threads'     Parser threads. Default 0 uses all cores.
+%    'SampleRows'  Records to infer the column types from. Default 1000.
+%    'BatchSize'   Rows to commit at once outside of a transaction. Default
+%                  0 imports in one transaction. With a batch size, a
+%                  malformed record rolls back only its batch. The earlier
+%                  batches and the table created for them stay committed.
+%
+% Example:
+%     sqlite3.importCSV('records', '/path/to/records.csv');
+%     sqlite3.importCSV(database, 'events', '/path/to/events.tsv', ...
+%                       'Delimiter', '\t', 'BatchSize', 1e6);
+%
+% See also sqlite3.execute
+  narginchk(2, inf);
+  rows = libsqlite3_('importCSV', varargin{:});
+end
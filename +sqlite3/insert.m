@@ -0,0 +1,77 @@
+function rows = insert(varargin)
+%INSERT Insert a struct array or a table into a table.
+%
+%     rows = sqlite3.insert(table, data)
+%     rows = sqlite3.insert(database, table, data)
+%
+% The insert operation inserts the rows of `data` into the table `table` in
+% the database specified by the connection id `database`. When `database` is
+% omitted, the default connection is used. The return value is the number of
+% rows inserted.
+%
+% `data` is a struct array of rows, e.g., the result of sqlite3.execute, or a
+% table. Fields or variables are inserted into the columns of the same name
+% through one prepared statement, and all rows are bound in the driver in one
+% transaction, or in a savepoint within an open transaction. Nothing is
+% inserted when a row fails.
+%
+% Values are bound as in sqlite3.execute: numeric and logical scalars are
+% numbers, char arrays are text, uint8 arrays are blobs, and empty values are
+% null. In a table, NaN and missing or undefined values are null, string and
+% categorical variables are text, and datetime variables are text in the
+% 'yyyy-MM-dd HH:mm:ss.SSS' format.
+%
+% Example:
+%     records = sqlite3.execute('SELECT * FROM records');
+%     sqlite3.insert('backup', records);
+%     sqlite3.insert(database, 'records', ...
+%                    table([1; 2], {'foo'; 'bar'}, 'VariableNames', ...
+%                          {'id', 'name'}));
+%
+% See also sqlite3.execute
+  narginchk(2, 3);
+  data = varargin{end};
+  if ~istable(data)
+    rows = libsqlite3_('insert', varargin{:});
+    return
+  end
+  columns = struct();
+  names = data.Properties.VariableNames;
+  for i = 1:numel(names)
+    columns.(names{i}) = toColumn(data.(names{i}), names{i});
+  end
+  rows = libsqlite3_('insert', varargin{1:end-1}, columns, 'Columns', true);
+end
+
+function column = toColumn(values, name)
+%TOCOLUMN Convert the table variable to a numeric array or a cell array.
+  if size(values, 2) ~= 1 && ~ischar(values)
+    error('sqlite3:insert', 'Variable %s must have one column.', name);
+  end
+  if isnumeric(values) || islogical(values)
+    column = values;
+    return
+  end
+  if isdatetime(values)
+    null = isnat(values);
+    values.Format = 'yyyy-MM-dd HH:mm:ss.SSS';
+    column = cellstr(values);
+  elseif isstring(values)
+    null = ismissing(values);
+    values(null) = "";
+    column = cellstr(values);
+  elseif iscategorical(values)
+    null = isundefined(values);
+    column = cellstr(values);
+  elseif ischar(values)
+    null = false(size(values, 1), 1);
+    column = cellstr(values);
+  elseif iscell(values)
+    null = false(size(values));
+    column = values;
+  else
+    error('sqlite3:insert', 'Variable %s of %s is not supported.', name, ...
+          class(values));
+  end
+  column(null) = {[]};
+end
@@ -0,0 +1,28 @@
+function limits = limits(varargin)
+%LIMITS Set resource limits of queries in the database connection.
+%
+%    limits = sqlite3.limits(database, 'MaxRows', rows, ...)
+%    limits = sqlite3.limits('MaxRows', rows, ...)
+%    limits = sqlite3.limits(database)
+%
+% The limits operation sets the resource limits applied to every execute
+% call of the connection and returns the current limits. Zero is unlimited.
+% The same limits can be given to a single execute call as options.
+%
+%    'MaxRows'        Maximum number of result rows.
+%    'MaxBytes'       Maximum bytes of the result staged in the driver.
+%    'Deadline'       Maximum seconds of the call.
+%    'SoftHeapLimit'  Soft limit of the SQLite heap in bytes. This is shared
+%                     by all connections in the process.
+%
+% A query exceeding a limit is stopped, and the error id is
+% 'sqlite3:maxRows', 'sqlite3:maxBytes', or 'sqlite3:deadline'. The error
+% message tells how many rows and bytes were fetched in how many seconds.
+%
+% Example:
+%     sqlite3.limits('MaxRows', 1e6, 'Deadline', 60);
+%     results = sqlite3.execute('SELECT * FROM records', 'MaxRows', 10);
+%
+% See also sqlite3.execute
+  limits = libsqlite3_('limits', varargin{:});
+end
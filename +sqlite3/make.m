@@ -1,8 +1,22 @@
 function make(action, varargin)
 %MAKE Build a driver mex file.
+%
+%    sqlite3.make()
+%    sqlite3.make('all', 'Session', true)
+%    sqlite3.make('clean')
+%
+% The 'Session' option builds the session extension for sqlite3.changeset,
+% which needs the amalgamation of SQLite 3.13.0 or later in src/sqlite3 and
+% include.
   if nargin < 1
     action = 'all';
   end
+  session = false;
+  for i = 1:2:numel(varargin)
+    if strcmpi(varargin{i}, 'Session')
+      session = varargin{i + 1};
+    end
+  end
 
   switch action
     case 'all'
@@ -10,9 +24,20 @@ function make(action, varargin)
       if isunix() && ~ismac()
         options = ' -ldl -lboost_regex CXXFLAGS="$CXXFLAGS -std=c++11"';
       end
-      dispAndEval('mex -c -Iinclude src/sqlite3/sqlite3.c -outdir src/sqlite3');
+      if isunix()
+        % Gzip output of exportCSV through the system zlib.
+        options = [options, ' -DSQLITE3MEX_ZLIB -lz'];
+      end
+      sqlite3_options = '';
+      if session
+        sqlite3_options = ' -DSQLITE_ENABLE_SESSION -DSQLITE_ENABLE_PREUPDATE_HOOK';
+        options = [options, sqlite3_options];
+      end
+      dispAndEval(['mex -c -Iinclude', sqlite3_options, ...
+                   ' src/sqlite3/sqlite3.c -outdir src/sqlite3']);
       dispAndEval([...
-          'mex -Iinclude src/api.cc src/sqlite3mex.cc src/sqlite3/sqlite3.%s ' ...
+          'mex -Iinclude src/api.cc src/sqlite3mex.cc src/vector.cc src/ann.cc src/columnar.cc src/arrow.cc src/csv.cc src/warm.cc ' ...
+          'src/sqlite3/sqlite3.%s -lut ' ...
           '-output +sqlite3/private/libsqlite3_%s' ...
           ], ...
           libext, ...
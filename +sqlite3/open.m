@@ -5,7 +5,8 @@ function database = open(filename, varargin)
 %
 % The open operation takes a file name of the database and returns newly
 % created connection id. This id can be used for this connection until
-% closed.
+% closed. The most recently opened connection that is still open is the
+% default connection for the other operations.
 %
 % The function takes optional flags.
 %
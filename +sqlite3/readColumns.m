@@ -0,0 +1,156 @@
+function [columns, valid] = readColumns(filename, name)
+%READCOLUMNS Read a columnar result file.
+%
+%    columns = sqlite3.readColumns(filename)
+%    [values, valid] = sqlite3.readColumns(filename, name)
+%
+% The readColumns operation maps the columnar file written by the driver,
+% e.g., a result of sqlite3.execute spilled to disk. The first form returns
+% a struct with a field per column holding a memmapfile of the column. The
+% memmapfile reads the data only when accessed, and its Data has the
+% following fields.
+%
+%    validity  uint8 bitmap. Bit mod(i-1, 8) of byte floor((i-1) / 8) + 1
+%              is set if row i is not null.
+%    offsets   uint64 offsets of text and blob columns. Row i is bytes
+%              offsets(i)+1 to offsets(i+1) of data.
+%    data      int64 or double values, or uint8 bytes of text and blob.
+%
+% Empty parts are omitted, and the field is empty when the column has no
+% data at all. The second form loads the column of the given name: integer
+% columns are int64, float columns are double with NaN for null, text
+% columns are string arrays with missing for null, and blob columns are cell
+% arrays. `valid` is a logical vector of the non-null rows.
+%
+% The file format is documented in src/columnar.cc.
+%
+% Example:
+%     columns = sqlite3.readColumns('/tmp/result.col');
+%     prices = columns.price.Data.data;
+%     [names, valid] = sqlite3.readColumns('/tmp/result.col', 'name');
+%
+% See also sqlite3.execute memmapfile
+  [num_rows, entries] = readDirectory(filename);
+  if nargin < 2
+    columns = struct();
+    names = matlab.lang.makeUniqueStrings(...
+        matlab.lang.makeValidName({entries.name}));
+    for i = 1:numel(entries)
+      columns.(names{i}) = mapColumn(filename, entries(i), num_rows);
+    end
+    return
+  end
+  index = find(strcmp({entries.name}, name), 1);
+  if isempty(index)
+    error('sqlite3:readColumns', 'Column not found: %s', name);
+  end
+  [columns, valid] = loadColumn(filename, entries(index), num_rows);
+end
+
+function [num_rows, entries] = readDirectory(filename)
+%READDIRECTORY Read the header and the column directory.
+  fid = fopen(filename, 'r', 'ieee-le');
+  if fid < 0
+    error('sqlite3:readColumns', 'Failed to open %s', filename);
+  end
+  closer = onCleanup(@() fclose(fid));
+  magic = fread(fid, [1, 8], '*char');
+  version = fread(fid, 1, 'uint32');
+  if ~strcmp(magic, 'SQLMXCOL') || version ~= 1
+    error('sqlite3:readColumns', 'Not a columnar file: %s', filename);
+  end
+  num_columns = fread(fid, 1, 'uint32');
+  num_rows = fread(fid, 1, 'uint64');
+  directory = fread(fid, 1, 'uint64');
+  fseek(fid, directory, 'bof');
+  entries = struct('name', {}, 'type', {}, 'validity', {}, 'offsets', {}, ...
+                   'data', {}, 'bytes', {});
+  for i = 1:num_columns
+    type = fread(fid, 1, 'uint32');
+    name_length = fread(fid, 1, 'uint32');
+    name = native2unicode(fread(fid, [1, name_length], '*uint8'), 'UTF-8');
+    fseek(fid, mod(8 - mod(name_length, 8), 8), 'cof');
+    parts = fread(fid, 4, 'uint64');
+    entries(i) = struct('name', name, 'type', type, 'validity', parts(1), ...
+                        'offsets', parts(2), 'data', parts(3), ...
+                        'bytes', parts(4));
+  end
+end
+
+function map = mapColumn(filename, entry, num_rows)
+%MAPCOLUMN Map the parts of the column with memmapfile.
+  validity_bytes = ceil(num_rows / 8);
+  format = {};
+  position = entry.validity;
+  format = addPart(format, 'uint8', validity_bytes, 'validity');
+  position = position + validity_bytes;
+  if entry.offsets > 0
+    format = addPart(format, 'uint8', entry.offsets - position, 'padding1');
+    format = addPart(format, 'uint64', num_rows + 1, 'offsets');
+    position = entry.offsets + 8 * (num_rows + 1);
+  end
+  format = addPart(format, 'uint8', entry.data - position, 'padding2');
+  switch entry.type
+    case 1
+      format = addPart(format, 'int64', num_rows, 'data');
+    case 2
+      format = addPart(format, 'double', num_rows, 'data');
+    case {3, 4}
+      format = addPart(format, 'uint8', entry.bytes, 'data');
+  end
+  map = [];
+  if ~isempty(format)
+    map = memmapfile(filename, 'Offset', entry.validity, ...
+                     'Format', format, 'Repeat', 1);
+  end
+end
+
+function format = addPart(format, type, count, name)
+%ADDPART Append a non-empty part to the memmapfile format.
+  if count > 0
+    format(end + 1, :) = {type, [double(count), 1], name};
+  end
+end
+
+function [values, valid] = loadColumn(filename, entry, num_rows)
+%LOADCOLUMN Load the column into a matlab array.
+  valid = false(num_rows, 1);
+  map = mapColumn(filename, entry, num_rows);
+  if num_rows > 0
+    bits = bitget(repmat(map.Data.validity', 8, 1), ...
+                  repmat((1:8)', 1, numel(map.Data.validity)));
+    valid = logical(bits(1:num_rows)');
+  end
+  switch entry.type
+    case 1
+      values = zeros(num_rows, 1, 'int64');
+      if num_rows > 0
+        values = map.Data.data;
+      end
+    case 2
+      values = zeros(num_rows, 1);
+      if num_rows > 0
+        values = map.Data.data;
+      end
+      values(~valid) = NaN;
+    case {3, 4}
+      offsets = double(map.Data.offsets);
+      data = zeros(0, 1, 'uint8');
+      if entry.bytes > 0
+        data = map.Data.data;
+      end
+      values = cell(num_rows, 1);
+      for i = 1:num_rows
+        values{i} = data(offsets(i) + 1:offsets(i + 1))';
+      end
+      if entry.type == 3
+        values = string(cellfun(@(x) native2unicode(x, 'UTF-8'), values, ...
+                                'UniformOutput', false));
+        values(~valid) = missing;
+      else
+        values(~valid) = {[]};
+      end
+    otherwise
+      values = NaN(num_rows, 1);
+  end
+end
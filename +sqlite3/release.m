@@ -0,0 +1,13 @@
+function release(varargin)
+%RELEASE Release a savepoint.
+%
+%    sqlite3.release(name)
+%    sqlite3.release(database, name)
+%
+% The release operation releases the named savepoint and all the savepoints
+% after it in the database specified by the connection id `database`. When
+% `database` is omitted, the default connection is used.
+%
+% See also sqlite3.savepoint sqlite3.rollback
+  libsqlite3_('release', varargin{:});
+end
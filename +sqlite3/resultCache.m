@@ -0,0 +1,37 @@
+function stats = resultCache(varargin)
+%RESULTCACHE Set the result cache of the database connection.
+%
+%    stats = sqlite3.resultCache(database, 'Capacity', bytes, ...)
+%    stats = sqlite3.resultCache('Capacity', bytes, ...)
+%    stats = sqlite3.resultCache(database)
+%
+% The resultCache operation sets the cache of query results in the
+% connection specified by the connection id `database` and returns the
+% statistics of the cache. When `database` is omitted, the default
+% connection is used. The cache is disabled by default.
+%
+% When enabled, sqlite3.execute keeps a copy of the result of a read-only
+% query, keyed by the SQL, the parameters, and the options. The same query
+% returns the copy without running the statement while the database is not
+% changed by this or other connections, as told by sqlite3_total_changes and
+% PRAGMA data_version and schema_version of the main database. Pragmas,
+% spilled results, and results over the capacity are not cached. Queries of
+% functions that change without a write, e.g., random() or
+% datetime('now'), must not run with the cache. The least recently used
+% results are evicted when the results exceed the capacity.
+%
+%    'Capacity'  Bytes of the cached results as staged in the driver. Zero
+%                disables and clears the cache.
+%    'Clear'     true to remove the cached results.
+%
+% The statistics are a struct of Capacity, Bytes, Entries, Hits, Misses,
+% Evictions, and HitRate, counted since the cache was enabled.
+%
+% Example:
+%     sqlite3.resultCache('Capacity', 2^28);
+%     results = sqlite3.execute('SELECT * FROM summary', 'Format', 'table');
+%     stats = sqlite3.resultCache();
+%
+% See also sqlite3.execute
+  stats = libsqlite3_('resultCache', varargin{:});
+end
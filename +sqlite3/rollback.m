@@ -0,0 +1,26 @@
+function rollback(varargin)
+%ROLLBACK Roll back the transaction or to the savepoint.
+%
+%    sqlite3.rollback()
+%    sqlite3.rollback(savepoint)
+%    sqlite3.rollback(database, ...)
+%
+% The rollback operation discards changes of the transaction in the database
+% specified by the connection id `database`. When the name of the savepoint
+% is given, only the changes after the savepoint are discarded and the
+% transaction stays open. When `database` is omitted, the default connection
+% is used.
+%
+% See also sqlite3.begin sqlite3.commit sqlite3.savepoint
+  if nargin > 0 && ~ischar(varargin{1})
+    database = varargin(1);
+    varargin = varargin(2:end);
+  else
+    database = {};
+  end
+  name = '';
+  if ~isempty(varargin)
+    name = varargin{1};
+  end
+  libsqlite3_('rollback', database{:}, name);
+end
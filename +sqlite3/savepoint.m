@@ -0,0 +1,14 @@
+function savepoint(varargin)
+%SAVEPOINT Start a savepoint.
+%
+%    sqlite3.savepoint(name)
+%    sqlite3.savepoint(database, name)
+%
+% The savepoint operation marks a named savepoint in the database specified
+% by the connection id `database`. When `database` is omitted, the default
+% connection is used. Use sqlite3.release to keep the changes since the
+% savepoint, or sqlite3.rollback(name) to discard them.
+%
+% See also sqlite3.release sqlite3.rollback sqlite3.begin
+  libsqlite3_('savepoint', varargin{:});
+end
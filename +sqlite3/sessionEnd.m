@@ -0,0 +1,13 @@
+function sessionEnd(session)
+%SESSIONEND End the session.
+%
+%    sqlite3.sessionEnd(session)
+%
+% The sessionEnd operation stops recording the changes of the session
+% `session` of sqlite3.sessionStart and deletes it. Sessions of a connection
+% also end when the connection is closed.
+%
+% See also sqlite3.sessionStart sqlite3.changeset
+  narginchk(1, 1);
+  libsqlite3_('sessionEnd', session);
+end
@@ -0,0 +1,44 @@
+function session = sessionStart(varargin)
+%SESSIONSTART Start recording the changes of tables into a changeset.
+%
+%    session = sqlite3.sessionStart(database, tables)
+%    session = sqlite3.sessionStart(tables)
+%    session = sqlite3.sessionStart(database)
+%    session = sqlite3.sessionStart()
+%
+% The sessionStart operation attaches a session of the SQLite session
+% extension to the tables `tables` of the connection specified by the
+% connection id `database`, and returns the session id. `tables` is a table
+% name or a cellstr of names, and all tables are attached when it is omitted
+% or empty. When `database` is omitted, the default connection is used.
+%
+% The session records the net changes of the tables made through the
+% connection until sqlite3.sessionEnd or close. Get the changes as a binary
+% changeset by sqlite3.changeset and apply them to another database by
+% sqlite3.applyChangeset. Only tables with a PRIMARY KEY are recorded.
+%
+% The session extension requires the driver built by
+% sqlite3.make('Session', true) with SQLite 3.13.0 or later.
+%
+% Example:
+%     session = sqlite3.sessionStart(database, {'records'});
+%     sqlite3.execute(database, 'UPDATE records SET name = ? WHERE id = ?', ...
+%                     'foo', 1);
+%     bytes = sqlite3.changeset(session);
+%     sqlite3.sessionEnd(session);
+%     sqlite3.applyChangeset(replica, bytes, 'replace');
+%
+% See also sqlite3.changeset sqlite3.sessionEnd sqlite3.applyChangeset
+  narginchk(0, 2);
+  if nargin > 0 && isnumeric(varargin{1})
+    database = varargin(1);
+    varargin = varargin(2:end);
+  else
+    database = {};
+  end
+  tables = {};
+  if ~isempty(varargin) && ~isempty(varargin{1})
+    tables = cellstr(varargin{1});
+  end
+  session = libsqlite3_('sessionStart', database{:}, tables);
+end
@@ -5,6 +5,9 @@ function timeout(varargin)
 %    sqlite3.timeout(millisecond)
 %
 % The timeout operation sets how long the driver should wait when the
-% database is locked by other processes.
+% database is locked by other processes. This replaces the handler of
+% sqlite3.busyHandler.
+%
+% See also sqlite3.busyHandler
   libsqlite3_('timeout', varargin{:});
 end
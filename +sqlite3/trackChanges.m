@@ -0,0 +1,32 @@
+function token = trackChanges(varargin)
+%TRACKCHANGES Record the row changes of the database connection.
+%
+%    token = sqlite3.trackChanges(database, 'Capacity', changes)
+%    token = sqlite3.trackChanges('Capacity', changes)
+%    token = sqlite3.trackChanges(database)
+%
+% The trackChanges operation starts recording the inserted, updated, and
+% deleted rows of the connection specified by the connection id `database`
+% and returns the token of the next change. Pass the token to
+% sqlite3.changesSince to get the rows changed since then. When `database`
+% is omitted, the default connection is used.
+%
+% Changes are recorded by the update hook of SQLite, kept once the
+% transaction has committed, and dropped when it rolls back. A COMMIT that
+% fails, e.g., on a busy lock, reports nothing until it is retried. Only the
+% changes made through this connection are recorded, and changes of WITHOUT
+% ROWID tables, of TRUNCATE style DELETE without WHERE, and by REPLACE
+% conflict resolution are not reported by SQLite. A transaction rolled back
+% to a savepoint may report rows that did not change in the end.
+%
+%    'Capacity'  Number of the latest changes kept. Default 100000. Zero
+%                stops recording.
+%
+% Example:
+%     token = sqlite3.trackChanges();
+%     sqlite3.execute('UPDATE records SET name = ? WHERE id = ?', 'foo', 1);
+%     changes = sqlite3.changesSince(token);
+%
+% See also sqlite3.changesSince
+  token = libsqlite3_('trackChanges', varargin{:});
+end
@@ -0,0 +1,45 @@
+function varargout = transaction(varargin)
+%TRANSACTION Run a function in a transaction.
+%
+%    varargout = sqlite3.transaction(database, body, mode)
+%    varargout = sqlite3.transaction(body, mode)
+%    varargout = sqlite3.transaction(body)
+%
+% The transaction operation calls the function handle `body` in a
+% transaction of the connection specified by the connection id `database`,
+% commits it when the body returns, and rolls it back when the body raises an
+% error. When `database` is omitted, the default connection is used. The
+% outputs of the body are returned.
+%
+% The mode is one of 'immediate' (default), 'deferred', or 'exclusive'. An
+% immediate transaction takes the write lock at the start, where the busy
+% handler waits for other writers, instead of upgrading a read lock at the
+% first write, where SQLite fails at once when another writer also holds a
+% read lock.
+%
+% Example:
+%     sqlite3.transaction(database, @() sqlite3.execute(database, ...
+%         'UPDATE counters SET n = n + 1 WHERE name = ?', 'runs'));
+%
+% See also sqlite3.begin sqlite3.commit sqlite3.busyHandler
+  narginchk(1, 3);
+  if ~isa(varargin{1}, 'function_handle')
+    database = varargin(1);
+    varargin = varargin(2:end);
+  else
+    database = {};
+  end
+  body = varargin{1};
+  mode = 'immediate';
+  if numel(varargin) > 1
+    mode = varargin{2};
+  end
+  sqlite3.begin(database{:}, mode);
+  try
+    [varargout{1:nargout}] = body();
+  catch e
+    sqlite3.rollback(database{:});
+    rethrow(e);
+  end
+  sqlite3.commit(database{:});
+end
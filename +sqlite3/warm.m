@@ -0,0 +1,55 @@
+function warm(varargin)
+%WARM Read the database into the cache ahead of the first queries.
+%
+%    sqlite3.warm(database, 'Tables', tables, 'Mode', mode, 'Wait', false)
+%    sqlite3.warm('Tables', tables, ...)
+%    sqlite3.warm(database)
+%    sqlite3.warm()
+%
+% The warm operation reads the database file of the connection specified by
+% the connection id `database` on a background thread, so that the first
+% queries after a cold open do not wait for random reads from a slow disk.
+% When `database` is omitted, the default connection is used. The call
+% returns immediately unless 'Wait' is true, and the next warm or close
+% stops the running one.
+%
+%    'Tables'  Table name or cellstr of names. Only the pages of the tables,
+%              their indexes, and the schema are read. Default all tables.
+%    'Mode'    'os' (default) reads the file with large sequential reads into
+%              the OS cache, where all connections and processes find it.
+%              The whole file is read when 'Tables' is omitted. 'pagecache'
+%              reads the tables and the indexes through SQLite into the page
+%              cache of the connection, which must be large enough to keep
+%              them, e.g., by PRAGMA cache_size. The tables and indexes
+%              are read in slices of about 50 ms, and queries on the
+%              connection wait for one slice at most.
+%    'Wait'    Wait until the warm-up finishes. Default false.
+%
+% Pages of large values that overflow the b-tree pages are not read in the
+% 'os' mode with 'Tables'.
+%
+% Example:
+%     database = sqlite3.open('results.sqlite3');
+%     sqlite3.warm(database, 'Tables', {'records', 'labels'});
+%
+% See also sqlite3.open sqlite3.descriptor
+  if nargin > 0 && isnumeric(varargin{1})
+    database = varargin(1);
+    varargin = varargin(2:end);
+  else
+    database = {};
+  end
+  if mod(numel(varargin), 2)
+    error('sqlite3:warm', 'Options must be name-value pairs.');
+  end
+  tables = {};
+  options = {};
+  for i = 1:2:numel(varargin)
+    if strcmp(varargin{i}, 'Tables')
+      tables = cellstr(varargin{i + 1});
+    else
+      options = [options, varargin(i:i + 1)];
+    end
+  end
+  libsqlite3_('warm', database{:}, tables, options{:});
+end
@@ -0,0 +1,155 @@
+function rows = writeTable(varargin)
+%WRITETABLE Create a table and load a matlab table into it.
+%
+%     rows = sqlite3.writeTable(name, data, ...)
+%     rows = sqlite3.writeTable(database, name, data, ...)
+%
+% The writeTable operation creates the table `name` in the database specified
+% by the connection id `database` from the variables of the matlab table
+% `data`, and loads all rows through one prepared statement. When `database`
+% is omitted, the default connection is used. The return value is the number
+% of rows loaded.
+%
+% Column types are inferred from the classes of the variables: integer and
+% logical variables are INTEGER, single and double variables are REAL,
+% string, char, cellstr, categorical, and datetime variables are TEXT, and
+% cell arrays of uint8 are BLOB. Other cell arrays have no declared type.
+% Values are bound as in sqlite3.insert.
+%
+% Creating the table, loading the rows, and building the indexes run in one
+% transaction, or in a savepoint within an open transaction, and nothing
+% changes when any of them fails. Indexes are built after the rows are loaded,
+% which is faster than maintaining them per row.
+%
+% Options:
+%
+%    'Mode'        'create' (default) fails if the table exists. 'append'
+%                  inserts into the table, creating it if it does not exist.
+%                  'replace' drops the existing table first.
+%    'PrimaryKey'  Variable name or cellstr of names of the primary key. The
+%                  table is created WITHOUT ROWID when a key is given.
+%    'Indexes'     Cell array of indexes to build. Each index is a variable
+%                  name or a cellstr of names, and is named after the table
+%                  and the columns, e.g., records_x_y.
+%
+% Example:
+%     data = table((1:3)', ["a"; "b"; "c"], [0.1; 0.2; 0.3], ...
+%                  'VariableNames', {'id', 'name', 'score'});
+%     sqlite3.writeTable('results', data, 'PrimaryKey', 'id', ...
+%                        'Indexes', {'name', {'score', 'name'}});
+%     sqlite3.writeTable(database, 'results', data, 'Mode', 'replace');
+%
+% See also sqlite3.insert sqlite3.execute
+  narginchk(2, inf);
+  if isnumeric(varargin{1})
+    database = varargin(1);
+    varargin = varargin(2:end);
+  else
+    database = {};
+  end
+  narginchk(numel(database) + 2, inf);
+  [name, data] = varargin{1:2};
+  name = char(name);
+  options = parseOptions(varargin(3:end));
+  if ~istable(data)
+    error('sqlite3:writeTable', 'Data must be a table.');
+  end
+  names = data.Properties.VariableNames;
+  table_name = quoteIdentifier(name);
+
+  sqlite3.savepoint(database{:}, 'sqlite3mex_write');
+  try
+    if strcmp(options.Mode, 'replace')
+      sqlite3.execute(database{:}, ['DROP TABLE IF EXISTS ', table_name]);
+    end
+    if strcmp(options.Mode, 'append')
+      create = 'CREATE TABLE IF NOT EXISTS ';
+    else
+      create = 'CREATE TABLE ';
+    end
+    sqlite3.execute(database{:}, [create, table_name, ' (', ...
+                    columnDefinitions(data, names, options.PrimaryKey), ')', ...
+                    withoutRowid(options.PrimaryKey)]);
+    rows = sqlite3.insert(database{:}, name, data);
+    for i = 1:numel(options.Indexes)
+      columns = cellstr(options.Indexes{i});
+      sqlite3.execute(database{:}, sprintf(...
+          'CREATE INDEX IF NOT EXISTS %s ON %s (%s)', ...
+          quoteIdentifier(strjoin([{name}, columns], '_')), table_name, ...
+          strjoin(cellfun(@quoteIdentifier, columns, ...
+                          'UniformOutput', false), ', ')));
+    end
+  catch e
+    sqlite3.rollback(database{:}, 'sqlite3mex_write');
+    sqlite3.release(database{:}, 'sqlite3mex_write');
+    rethrow(e);
+  end
+  sqlite3.release(database{:}, 'sqlite3mex_write');
+end
+
+function options = parseOptions(arguments)
+%PARSEOPTIONS Parse the name-value pairs of the options.
+  options = struct('Mode', 'create', 'PrimaryKey', {{}}, 'Indexes', {{}});
+  if mod(numel(arguments), 2)
+    error('sqlite3:writeTable', 'Options must be name-value pairs.');
+  end
+  for i = 1:2:numel(arguments)
+    switch arguments{i}
+      case 'Mode'
+        options.Mode = validatestring(arguments{i + 1}, ...
+                                      {'create', 'append', 'replace'});
+      case 'PrimaryKey'
+        options.PrimaryKey = cellstr(arguments{i + 1});
+      case 'Indexes'
+        options.Indexes = arguments{i + 1};
+        if ~iscell(options.Indexes)
+          options.Indexes = {options.Indexes};
+        end
+      otherwise
+        error('sqlite3:writeTable', 'Invalid option: %s', arguments{i});
+    end
+  end
+end
+
+function definitions = columnDefinitions(data, names, primary_key)
+%COLUMNDEFINITIONS Column definitions of the CREATE TABLE statement.
+  definitions = cell(1, numel(names));
+  for i = 1:numel(names)
+    definitions{i} = strtrim([quoteIdentifier(names{i}), ' ', ...
+                              columnType(data.(names{i}))]);
+  end
+  if ~isempty(primary_key)
+    definitions{end + 1} = ['PRIMARY KEY (', strjoin(cellfun(...
+        @quoteIdentifier, primary_key, 'UniformOutput', false), ', '), ')'];
+  end
+  definitions = strjoin(definitions, ', ');
+end
+
+function type = columnType(values)
+%COLUMNTYPE Declared type of the column from the class of the variable.
+  if islogical(values) || isinteger(values)
+    type = 'INTEGER';
+  elseif isfloat(values)
+    type = 'REAL';
+  elseif isstring(values) || ischar(values) || iscellstr(values) || ...
+         iscategorical(values) || isdatetime(values)
+    type = 'TEXT';
+  elseif iscell(values) && all(cellfun(@(x) isa(x, 'uint8'), values))
+    type = 'BLOB';
+  else
+    type = '';
+  end
+end
+
+function clause = withoutRowid(primary_key)
+%WITHOUTROWID Table option of the CREATE TABLE statement.
+  clause = '';
+  if ~isempty(primary_key)
+    clause = ' WITHOUT ROWID';
+  end
+end
+
+function quoted = quoteIdentifier(name)
+%QUOTEIDENTIFIER Quote the name as an SQL identifier.
+  quoted = ['"', strrep(name, '"', '""'), '"'];
+end
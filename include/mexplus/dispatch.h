@@ -59,10 +59,14 @@
 #ifndef __MEXPLUS_DISPATCH_H__
 #define __MEXPLUS_DISPATCH_H__
 
+#include <algorithm>
 #include <map>
 #include <memory>
 #include <mex.h>
+#include <stdint.h>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace mexplus {
 
@@ -91,7 +95,7 @@ class OperationCreator {
 public:
   /** Register an operation in the constructor.
    */
-  OperationCreator(const std::string& name) {
+  OperationCreator(const std::string& name) : name_(name) {
     CreateOperation(name, this);
   }
   /** Destructor.
@@ -100,6 +104,25 @@ public:
   /** Implementation must return a new instance of the operation.
    */
   virtual Operation* create() = 0;
+  /** Return the shared instance of the operation. Operations defined by
+   * MEX_DEFINE() carry no state, so one instance serves every call.
+   */
+  Operation* instance() {
+    if (!instance_.get())
+      instance_.reset(create());
+    return instance_.get();
+  }
+  /** Name of the operation.
+   */
+  const std::string& name() const { return name_; }
+
+private:
+  /** Name of the operation.
+   */
+  std::string name_;
+  /** Lazily created shared instance.
+   */
+  std::unique_ptr<Operation> instance_;
 };
 
 /** Implementation of the operation creator to be used as composition in an
@@ -116,6 +139,8 @@ public:
  */
 class OperationFactory {
 public:
+  typedef std::unordered_multimap<uint32_t, OperationCreator*> Registry;
+
   /** Register a new creator.
    */
   friend void CreateOperation(const std::string& name,
@@ -123,19 +148,54 @@ public:
   /** Create a new instance of the registered operation.
    */
   static Operation* create(const std::string& name) {
-    std::map<std::string, OperationCreator*>::const_iterator it =
-        registry()->find(name);
-    if (it == registry()->end())
-      return static_cast<Operation*>(NULL);
-    else
-      return it->second->create();
+    OperationCreator* creator = find(name.c_str(), name.size());
+    return (creator) ? creator->create() : static_cast<Operation*>(NULL);
+  }
+  /** Find the shared instance of the operation named by a MATLAB char
+   * array, without copying the name.
+   */
+  static Operation* find(const mxChar* name, size_t length) {
+    OperationCreator* creator = find<mxChar>(name, length);
+    return (creator) ? creator->instance() : static_cast<Operation*>(NULL);
   }
 
 private:
+  /** FNV-1a hash of the operation name.
+   */
+  template <typename CharType>
+  static uint32_t hash(const CharType* name, size_t length) {
+    uint32_t value = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+      value ^= static_cast<uint32_t>(name[i]);
+      value *= 16777619u;
+    }
+    return value;
+  }
+  /** Look up the creator of the given name.
+   */
+  template <typename CharType>
+  static OperationCreator* find(const CharType* name, size_t length) {
+    Registry* table = registry();
+    std::pair<Registry::const_iterator, Registry::const_iterator> range =
+        table->equal_range(hash(name, length));
+    for (Registry::const_iterator it = range.first; it != range.second; ++it) {
+      const std::string& candidate = it->second->name();
+      if (candidate.size() != length)
+        continue;
+      size_t i = 0;
+      while (i < length &&
+             static_cast<uint32_t>(static_cast<unsigned char>(candidate[i])) ==
+             static_cast<uint32_t>(name[i]))
+        ++i;
+      if (i == length)
+        return it->second;
+    }
+    return static_cast<OperationCreator*>(NULL);
+  }
   /** Obtain a pointer to the registration table.
    */
-  static std::map<std::string, OperationCreator*>* registry() {
-    static std::map<std::string, OperationCreator*> registry_table;
+  static Registry* registry() {
+    static Registry registry_table;
     return &registry_table;
   }
 };
@@ -144,7 +204,8 @@ private:
  */
 inline void CreateOperation(const std::string& name,
                             OperationCreator* creator) {
-  OperationFactory::registry()->insert(make_pair(name, creator));
+  OperationFactory::registry()->insert(std::make_pair(
+      OperationFactory::hash(name.c_str(), name.size()), creator));
 }
 
 /** Key-value storage to make a stateful MEX function.
@@ -182,21 +243,41 @@ inline void CreateOperation(const std::string& name,
 template<class T>
 class Session {
 public:
-  typedef std::map<intptr_t, std::shared_ptr<T> > InstanceMap;
-
-  /** Create an instance.
+  /** Create an instance. The returned id packs a slot index in the lower
+   * half and the generation of the slot in the upper half, so a lookup is
+   * an array access and an id kept after destroy() is detected as stale.
    */
   static intptr_t create(T* instance) {
-    InstanceMap* instances = getInstances();
-    intptr_t id = reinterpret_cast<intptr_t>(instance);
-    instances->insert(std::make_pair(id, std::shared_ptr<T>(instance)));
+    Table* table = getTable();
+    size_t index;
+    if (table->free_slots.empty()) {
+      index = table->slots.size();
+      table->slots.push_back(Slot());
+    }
+    else {
+      index = table->free_slots.back();
+      table->free_slots.pop_back();
+    }
+    Slot& slot = table->slots[index];
+    slot.instance.reset(instance);
+    intptr_t id = makeId(index, slot.generation);
+    table->order.push_back(id);
     mexLock();
     return id;
   }
   /** Destroy an instance.
    */
   static void destroy(intptr_t id) {
-    getInstances()->erase(id);
+    Slot* slot = find(id);
+    if (!slot)
+      return;
+    slot->instance.reset();
+    ++slot->generation;
+    Table* table = getTable();
+    table->free_slots.push_back(getIndex(id));
+    table->order.erase(std::find(table->order.begin(),
+                                 table->order.end(),
+                                 id));
     mexUnlock();
   }
   static void destroy(const mxArray* pointer) {
@@ -205,13 +286,17 @@ public:
   /** Retrieve an instance or throw if no instance is found.
    */
   static T* get(intptr_t id) {
-    InstanceMap* instances = getInstances();
-    typename InstanceMap::iterator instance = instances->find(id);
-    if (instance == instances->end())
+    Slot* slot = find(id);
+    if (!slot) {
+      if (getIndex(id) < getTable()->slots.size())
+        mexErrMsgIdAndTxt("mexplus:session:notFound",
+                          "Invalid id %lld. The instance is destroyed.",
+                          static_cast<long long>(id));
       mexErrMsgIdAndTxt("mexplus:session:notFound",
-                        "Invalid id %d. Did you create?",
-                        id);
-    return instance->second.get();
+                        "Invalid id %lld. Did you create?",
+                        static_cast<long long>(id));
+    }
+    return slot->instance.get();
   }
   static T* get(const mxArray* pointer) {
     return get(getIntPointer(pointer));
@@ -227,29 +312,76 @@ public:
   /** Check if the given id exists.
    */
   static bool exist(intptr_t id) {
-    InstanceMap* instances = getInstances();
-    typename InstanceMap::iterator instance = instances->find(id);
-    return instance != instances->end();
+    return find(id) != NULL;
   }
   static bool exist(const mxArray* pointer) {
     return exist(getIntPointer(pointer));
   }
+  /** Id of the most recently created instance that still exists, or 0.
+   */
+  static intptr_t latest() {
+    const std::vector<intptr_t>& order = getTable()->order;
+    return (order.empty()) ? 0 : order.back();
+  }
+  /** Ids of the existing instances in the order of creation.
+   */
+  static const std::vector<intptr_t>& ids() { return getTable()->order; }
   /** Clear all session instances.
    */
   static void clear() {
-    for (int i = 0; i < getInstances()->size(); ++i)
-      mexUnlock();
-    getInstances()->clear();
+    Table* table = getTable();
+    while (!table->order.empty())
+      destroy(table->order.back());
   }
-  /** Get instance map.
-   */
-  static const InstanceMap& getInstanceMap() { return *getInstances(); }
 
 private:
+  /** Instance storage with the generation counter of the slot.
+   */
+  struct Slot {
+    Slot() : generation(1) {}
+    std::shared_ptr<T> instance;
+    uint32_t generation;
+  };
+  /** Slot array, reusable slots, and existing ids in creation order.
+   */
+  struct Table {
+    std::vector<Slot> slots;
+    std::vector<size_t> free_slots;
+    std::vector<intptr_t> order;
+  };
+  /** Number of bits for the slot index in an id.
+   */
+  static const int kIndexBits = sizeof(intptr_t) * 4;
+
   /** Constructor prohibited.
    */
   Session() {}
   ~Session() {}
+  /** Pack a slot index and a generation into an id. Index is offset by one
+   * so that a valid id is never 0.
+   */
+  static intptr_t makeId(size_t index, uint32_t generation) {
+    uintptr_t mask = (static_cast<uintptr_t>(1) << kIndexBits) - 1;
+    return static_cast<intptr_t>(
+        ((static_cast<uintptr_t>(generation) & mask) << kIndexBits) |
+        (static_cast<uintptr_t>(index + 1) & mask));
+  }
+  static size_t getIndex(intptr_t id) {
+    uintptr_t mask = (static_cast<uintptr_t>(1) << kIndexBits) - 1;
+    return static_cast<size_t>(static_cast<uintptr_t>(id) & mask) - 1;
+  }
+  /** Find the slot of a live id, or NULL.
+   */
+  static Slot* find(intptr_t id) {
+    Table* table = getTable();
+    size_t index = getIndex(id);
+    if (index >= table->slots.size())
+      return static_cast<Slot*>(NULL);
+    Slot* slot = &table->slots[index];
+    if (!slot->instance || makeId(index, slot->generation) != id)
+      return static_cast<Slot*>(NULL);
+    return slot;
+  }
   /** Convert mxArray to intptr_t.
    */
   static intptr_t getIntPointer(const mxArray* pointer) {
@@ -267,9 +399,9 @@ private:
   }
   /** Get static instance storage.
    */
-  static InstanceMap* getInstances() {
-    static InstanceMap instances;
-    return &instances;
+  static Table* getTable() {
+    static Table table;
+    return &table;
   }
 };
 
@@ -306,14 +438,15 @@ void mexFunction(int nlhs, mxArray *plhs[], \
   if (nrhs < 1 || !mxIsChar(prhs[0])) \
     mexErrMsgIdAndTxt("mexplus:dispatch:argumentError", \
                       "Invalid argument: missing operation."); \
-  std::string operation_name( \
-      mxGetChars(prhs[0]), \
-      mxGetChars(prhs[0]) + mxGetNumberOfElements(prhs[0])); \
-  std::auto_ptr<mexplus::Operation> operation( \
-      mexplus::OperationFactory::create(operation_name)); \
-  if (operation.get() == NULL) \
+  mexplus::Operation* operation = mexplus::OperationFactory::find( \
+      mxGetChars(prhs[0]), mxGetNumberOfElements(prhs[0])); \
+  if (operation == NULL) { \
+    std::string operation_name( \
+        mxGetChars(prhs[0]), \
+        mxGetChars(prhs[0]) + mxGetNumberOfElements(prhs[0])); \
     mexErrMsgIdAndTxt("mexplus:dispatch:argumentError", \
         "Invalid operation: %s", operation_name.c_str()); \
+  } \
   (*operation)(nlhs, plhs, nrhs - 1, prhs + 1); \
 }
 
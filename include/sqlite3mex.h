@@ -5,43 +5,134 @@
 #ifndef __SQLITE3MEX_H__
 #define __SQLITE3MEX_H__
 
-#include "boost/variant.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
 #include <deque>
+#include <list>
 #include <map>
 #include <mex.h>
+#include <mutex>
+#include <random>
 #include <sqlite3.h>
 #include <stdint.h>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
 using namespace std;
 
+// Changeset session of the session extension, defined by sqlite3.h when
+// built with SQLITE_ENABLE_SESSION.
+struct sqlite3_session;
+
 // Alias for the mex error function.
 #define ERROR(...) mexErrMsgIdAndTxt("sqlite3:error", __VA_ARGS__)
 
 namespace sqlite3mex {
 
-// Integer type.
-typedef int64_t IntegerValue;
-// Float type.
-typedef double FloatValue;
-// Text type.
-typedef string TextValue;
-// Blob value class.
-typedef vector<uint8_t> BlobValue;
-// Null value class.
-typedef struct {} NullValue;
-// Value of the sqlite row. A pair of type and value.
-typedef pair<int, boost::variant<IntegerValue, FloatValue, TextValue,
-    BlobValue, NullValue> > Value;
-
-// Column of the query result.
+// Value of the query result. Text and blob bytes are kept in the data
+// buffer of the column at [offset, offset + size).
+typedef struct {
+  int type;       // SQLite type code.
+  uint32_t size;  // Bytes of the text or blob.
+  union {
+    int64_t integer;
+    double real;
+    uint64_t offset;
+  };
+} Datum;
+
+// Column of the query result. When the column is dictionary-encoded, the
+// offset of a text value is the code of the distinct text in entries.
 typedef struct {
-  string name;         // Name of the column.
-  deque<Value> values; // Values of the column.
+  string name;           // Name of the column usable as a matlab field.
+  string original_name;  // Name of the column reported by sqlite.
+  vector<Datum> values;  // Values of the column.
+  string data;           // Bytes of the text and blob values.
+  bool encoded;          // True if text values are dictionary-encoded.
+  double max_distinct;   // Ratio of distinct texts to rows to stay encoded.
+  vector<Datum> entries; // Distinct text values by code.
+  unordered_map<string, uint32_t> codes;  // Code of the distinct text.
 } Column;
 
+// Format of the query result.
+enum ResultFormat {
+  kFormatStruct = 0,  // Struct array of rows.
+  kFormatTable = 1    // Table of columns.
+};
+
+// Dictionary encoding of the text columns.
+enum DictionaryMode {
+  kDictionaryOff = 0,  // Text columns are string arrays.
+  kDictionaryOn = 1,   // Text columns are categorical arrays.
+  kDictionaryAuto = 2  // Categorical if distinct texts are few enough.
+};
+
+// Resource limits of a query. Zero is unlimited.
+struct QueryLimits {
+  QueryLimits() : max_rows(0), max_bytes(0), deadline(0) {}
+  int64_t max_rows;   // Maximum rows of the result.
+  int64_t max_bytes;  // Maximum bytes staged for the result.
+  double deadline;    // Maximum seconds of the call.
+};
+
+// Options of execute() given as name-value pairs after the parameters.
+struct ExecuteOptions {
+  ExecuteOptions() : format(kFormatStruct), dictionary(kDictionaryOff),
+      dictionary_threshold(0.1), spill_threshold(0) {}
+  ResultFormat format;
+  DictionaryMode dictionary;
+  // Ratio of distinct texts to rows below which auto mode encodes.
+  double dictionary_threshold;
+  QueryLimits limits;
+  // Staged bytes above which the result is written to the columnar file,
+  // or 0 to keep the result in memory.
+  int64_t spill_threshold;
+  // Columnar file of the spilled result, or empty for a temporary file.
+  string spill_file;
+};
+
+// Options of exportArrow().
+struct ArrowOptions {
+  ArrowOptions() : batch_rows(65536), file_format(false) {}
+  // Rows of a record batch.
+  int64_t batch_rows;
+  // True for the IPC file format, false for the stream format.
+  bool file_format;
+};
+
+// Quoting of text fields in exportCSV().
+enum CSVQuote {
+  kCSVQuoteMinimal = 0,  // Quote text with delimiters, quotes, or newlines.
+  kCSVQuoteAll = 1,      // Quote all text.
+  kCSVQuoteNone = 2      // Never quote.
+};
+
+// Options of importCSV() and exportCSV().
+struct CSVOptions {
+  CSVOptions() : delimiter(','), header(true), threads(0), sample_rows(1000),
+      batch_rows(0), quote(kCSVQuoteMinimal), gzip(false) {}
+  // Field delimiter.
+  char delimiter;
+  // True if the first record is the column names.
+  bool header;
+  // Parser threads of the import, or 0 for the number of cores.
+  int threads;
+  // Records to infer the column types from on import.
+  int64_t sample_rows;
+  // Rows of a transaction on import, or 0 to import in one transaction.
+  int64_t batch_rows;
+  // Text written for null on export.
+  string null_text;
+  // Quoting of text fields on export.
+  CSVQuote quote;
+  // True to compress the export with gzip.
+  bool gzip;
+};
+
 // SQL statement object. It manages execution and query results.
 class Statement {
 public:
@@ -51,14 +142,32 @@ public:
   ~Statement();
   // Prepare the statement.
   bool prepare(const string& statement, sqlite3* database);
+  // Prepare the first statement in the SQL text of the given length and set
+  // the tail to the beginning of the remaining text. get() is NULL when the
+  // text has only white spaces or comments.
+  bool prepare(const char* statement,
+               int length,
+               sqlite3* database,
+               const char** tail);
   // Finalize the statement.
   bool finalize();
   // Execute the prepared statement.
   bool step();
   // Reset the prepared statement.
   bool reset();
-  // Bind parameters.
+  // Bind parameters. A single struct binds the named parameters, e.g.,
+  // :name, @name, or $name, to the fields of the same name.
   bool bind(const vector<const mxArray*>& params);
+  // Check if the parameters are a struct to bind by name.
+  bool bindsByName(const vector<const mxArray*>& params) const;
+  // Bind the named parameters to the fields of the struct array element.
+  bool bindFields(const mxArray* record, size_t element);
+  // Bind the value to the parameter of the 1-based index. Null value binds
+  // null.
+  bool bindValue(int index, const mxArray* value);
+  // Error message of the last failure not reported by sqlite, e.g., a wrong
+  // number of parameters.
+  const string& errorMessage() const;
   // Check if the return code is ok.
   bool ok() const;
   // Check if the return code is done.
@@ -77,16 +186,20 @@ public:
   const char* columnName(int i) const;
   // Column type. The statement must be in ROW code. i.e., row() == true.
   int columnType(int i) const;
-  // Column value. The statement must be in ROW code. i.e., row() == true.
-  const Value& columnValue(int i);
+  // Append the column value to the column. The statement must be in ROW
+  // code. i.e., row() == true.
+  void columnValue(int i, Column* column) const;
+  // Get the column value without staging. Data points to the text or blob
+  // bytes until the next step. The statement must be in ROW code.
+  Datum columnDatum(int i, const char** data) const;
 
 private:
   // Prepared statement.
   sqlite3_stmt* statement_;
   // Return code.
   int code_;
-  // Current value.
-  Value value_;
+  // Error message of the last bind failure.
+  string error_message_;
 };
 
 // Cache for the prepared statements. It looks up the prepared SQL statement
@@ -118,6 +231,488 @@ private:
   size_t cache_size_;
 };
 
+// Waits of the busy handler when the database is locked. The delay doubles
+// from the initial delay on each retry up to the maximum delay, and the
+// jitter shortens each delay by a random fraction up to it. The handler
+// gives up when the next delay would pass the maximum wait, so a zero
+// maximum wait fails at once.
+struct BusyPolicy {
+  BusyPolicy() : initial_delay(1), max_delay(100), max_wait(5000),
+                 jitter(0.5) {}
+  double initial_delay;  // Milliseconds.
+  double max_delay;      // Milliseconds.
+  double max_wait;       // Milliseconds.
+  double jitter;         // Fraction between 0 and 1.
+};
+
+// Statistics of the busy handler.
+typedef struct {
+  uint64_t events;        // Locks found busy.
+  uint64_t retries;       // Retries after a wait.
+  uint64_t failures;      // Events given up with SQLITE_BUSY.
+  double wait_seconds;    // Total time waited.
+  double longest_seconds; // Longest wait of an event.
+} BusyStats;
+
+// Background maintenance of the database file. Every interval, up to the
+// given pages are freed by incremental_vacuum, and the WAL is checkpointed
+// in the PASSIVE mode, or in the TRUNCATE mode when the WAL exceeds the
+// maximum size.
+struct CheckpointPolicy {
+  CheckpointPolicy() : interval(1000), max_wal_size(64 << 20),
+                       vacuum_pages(0) {}
+  int interval;          // Milliseconds. Zero stops the maintenance.
+  int64_t max_wal_size;  // Bytes.
+  int vacuum_pages;      // Pages per interval.
+};
+
+// Statistics of the background maintenance.
+typedef struct {
+  uint64_t checkpoints;      // Checkpoints run.
+  uint64_t truncates;        // Checkpoints escalated to TRUNCATE.
+  uint64_t busy;             // Checkpoints not finished for busy locks.
+  uint64_t vacuumed_pages;   // Pages freed by incremental_vacuum.
+  int64_t wal_size;          // Bytes of the WAL after the last checkpoint.
+  int64_t max_wal_size;      // Largest bytes of the WAL seen.
+  double last_seconds;       // Duration of the last checkpoint.
+  double longest_seconds;    // Longest duration of a checkpoint.
+  double total_seconds;      // Total duration of the checkpoints.
+} CheckpointStats;
+
+// Version of the database that a cached result is valid for.
+typedef struct {
+  int64_t data_version;    // PRAGMA data_version, changed by others.
+  int64_t schema_version;  // PRAGMA schema_version.
+  int64_t total_changes;   // Changes by this connection.
+} DatabaseVersion;
+
+// Statistics of the result cache.
+typedef struct {
+  uint64_t hits;       // Results returned from the cache.
+  uint64_t misses;     // Cacheable queries executed.
+  uint64_t evictions;  // Entries removed for the capacity.
+  size_t entries;      // Number of cached results.
+  size_t bytes;        // Staged bytes of the cached results.
+  size_t capacity;     // Capacity in bytes.
+} ResultCacheStats;
+
+// Cache of the converted query results. Entries are persistent copies of
+// the results valid for the database version they were made at. The least
+// recently used entries are evicted when the bytes exceed the capacity.
+class ResultCache {
+public:
+  // Create a disabled cache.
+  ResultCache();
+  // Destroy the cached results.
+  ~ResultCache();
+  // Set the capacity in bytes of the staged results. Zero disables the
+  // cache.
+  void setCapacity(size_t capacity);
+  size_t capacity() const { return capacity_; }
+  // Get the cached result of the key, or NULL. A stale entry is removed.
+  const mxArray* get(const string& key, const DatabaseVersion& version);
+  // Keep a copy of the result of the given size.
+  void put(const string& key,
+           const DatabaseVersion& version,
+           const mxArray* result,
+           size_t bytes);
+  // Remove all entries.
+  void clear();
+  // Statistics of the cache.
+  ResultCacheStats stats() const;
+
+private:
+  typedef struct {
+    string key;
+    DatabaseVersion version;
+    mxArray* result;
+    size_t bytes;
+  } Entry;
+  // Remove the least recently used entries until the bytes fit.
+  void evict(size_t capacity);
+  // Entries in the order of use, the most recent first.
+  list<Entry> entries_;
+  // Lookup table.
+  unordered_map<string, list<Entry>::iterator> table_;
+  // Capacity and the total size of the entries.
+  size_t capacity_;
+  size_t bytes_;
+  // Counters since the cache was enabled.
+  uint64_t hits_;
+  uint64_t misses_;
+  uint64_t evictions_;
+};
+
+// Changed rows of a table. Rowids are sorted and each rowid is in one of
+// the vectors by the net change.
+typedef struct {
+  string table;
+  vector<int64_t> inserted;
+  vector<int64_t> updated;
+  vector<int64_t> deleted;
+} TableChanges;
+
+// Bounded log of the committed row changes recorded by the update hook.
+// Changes are numbered in the order of commits, and a token is the number
+// of the next change.
+class ChangeLog {
+public:
+  // Create a disabled log.
+  ChangeLog();
+  // Set the maximum number of changes kept. Zero disables and clears the
+  // log.
+  void setCapacity(size_t capacity);
+  size_t capacity() const { return capacity_; }
+  // Record the change of the open transaction.
+  void record(int operation, const char* table, sqlite3_int64 rowid);
+  // Mark the changes of the transaction to keep once the commit succeeded.
+  void prepareCommit();
+  // Keep the changes of the transaction if its commit was prepared.
+  void commit();
+  // Discard the changes of the transaction.
+  void rollback();
+  // Token of the next change.
+  uint64_t token() const { return first_ + committed_.size(); }
+  // Get the changes since the token. False if some of them were dropped.
+  bool since(uint64_t token, vector<TableChanges>* changes) const;
+
+private:
+  typedef struct {
+    uint32_t table;
+    int operation;
+    int64_t rowid;
+  } Change;
+  // Changes of the open transaction.
+  deque<Change> pending_;
+  // Number of the changes in the open transaction, including the dropped.
+  uint64_t pending_count_;
+  // True after the commit hook of the open transaction.
+  bool committing_;
+  // Committed changes from the number first_.
+  deque<Change> committed_;
+  uint64_t first_;
+  // Table names by code.
+  vector<string> tables_;
+  unordered_map<string, uint32_t> table_codes_;
+  // Maximum number of changes kept.
+  size_t capacity_;
+};
+
+// Resolution of the conflicts in applying a changeset.
+enum ConflictPolicy {
+  kConflictAbort = 0,    // Roll back the whole changeset.
+  kConflictOmit = 1,     // Skip the conflicting change.
+  kConflictReplace = 2   // Overwrite the conflicting row, or skip.
+};
+
+// Metric of the vector similarity functions.
+enum VectorMetric {
+  kVectorDot = 0,    // Dot product.
+  kVectorL2 = 1,     // Euclidean distance.
+  kVectorCosine = 2  // Cosine distance, 1 - cos(a, b).
+};
+
+// Compute the vector metric with the fastest kernel available on this CPU.
+double computeVectorMetric(VectorMetric metric,
+                           const float* a,
+                           const float* b,
+                           size_t size);
+double computeVectorMetric(VectorMetric metric,
+                           const double* a,
+                           const double* b,
+                           size_t size);
+// Name of the kernel selected at runtime, e.g., "avx2".
+const char* vectorKernelName();
+// Register vec_dot(), vec_l2(), vec_cosine() and top_k() SQL functions.
+bool registerVectorFunctions(sqlite3* database);
+// Register the ann virtual table module for the nearest neighbour search.
+bool registerAnnModule(sqlite3* database);
+
+// Text of the value with the sqlite conversion rules. Data is the text or
+// blob bytes.
+string convertToText(const Datum& value, const char* data);
+// Floating point number of the value with the sqlite conversion rules.
+double convertToFloat(const Datum& value, const char* data);
+// Integer of the value with the sqlite conversion rules.
+int64_t convertToInteger(const Datum& value, const char* data);
+
+// Read the pages of the b-trees of the root pages in the database file, or
+// the whole file when no root page is given, into the OS cache. Stops early
+// when stop is set.
+bool warmFile(const string& filename,
+              const vector<uint32_t>& root_pages,
+              const atomic<bool>& stop);
+
+// Column type of the columnar file for the declared type of a column. 0 if
+// the type is taken from the first non-null value.
+int columnarType(const char* declared_type);
+
+// Writer of the columnar result file that matlab maps with memmapfile. See
+// src/columnar.cc for the format.
+class ColumnarWriter {
+public:
+  // Create a new writer.
+  ColumnarWriter();
+  // Remove the temporary files. The output is written only on finish.
+  ~ColumnarWriter();
+  // Start writing columns of the given names and types. The type is
+  // SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT, SQLITE_BLOB, or 0 to take the
+  // type of the first non-null value. Other values are converted.
+  bool open(const string& filename,
+            const vector<string>& names,
+            const vector<int>& types);
+  // Append a value to the column. Data is the text or blob bytes.
+  bool append(size_t column, const Datum& value, const char* data);
+  // Append the staged columns and clear them.
+  bool append(vector<Column>* columns);
+  // Join the columns into the output file.
+  bool finish();
+  // Check if the writer is open and not finished.
+  bool isOpen() const;
+  // Number of rows written.
+  uint64_t rows() const;
+  // Output file name.
+  const string& filename() const;
+  // Error message of the last failure.
+  const string& errorMessage() const;
+
+private:
+  // Temporary storage of a column.
+  typedef struct {
+    string name;             // Name of the column.
+    int type;                // Type of the column, 0 if not known yet.
+    uint64_t rows;           // Rows appended.
+    uint64_t pending_nulls;  // Leading nulls before the type is known.
+    vector<uint8_t> validity;// Validity bitmap.
+    FILE* data;              // Temporary file of the data.
+    string data_path;        // Path of the temporary data file.
+    uint64_t data_bytes;     // Bytes of the text or blob data.
+    FILE* offsets;           // Temporary file of the offsets.
+    string offsets_path;     // Path of the temporary offsets file.
+  } ColumnFile;
+
+  // Set the type of the column and open the temporary files.
+  bool startColumn(ColumnFile* column, int type);
+  // Write a value in the type of the column.
+  bool writeValue(ColumnFile* column, const Datum& value, const char* data);
+  // Write bytes to the output and advance the position.
+  bool write(FILE* output, const void* data, size_t size, uint64_t* position);
+  // Write zeros to the next 8-byte boundary.
+  bool pad(FILE* output, uint64_t* position);
+  // Copy the temporary file to the output.
+  bool copy(FILE* input, FILE* output, uint64_t* position);
+  // Set the error message of the failed file operation.
+  bool setError(const string& path);
+  // Close and remove the temporary files.
+  void closeTemporaries();
+
+  // Columns being written.
+  vector<ColumnFile> columns_;
+  // Output file name.
+  string filename_;
+  // True if the output is complete.
+  bool finished_;
+  // Error message of the last failure.
+  string error_message_;
+};
+
+// Writer of the Arrow IPC stream or file. See src/arrow.cc for the format.
+class ArrowWriter {
+public:
+  // Create a new writer.
+  ArrowWriter();
+  // Close and remove the output unless finished.
+  ~ArrowWriter();
+  // Start writing columns of the given names and types. The type is
+  // SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT, SQLITE_BLOB, or 0 to take the
+  // type of the first non-null value in the first batch.
+  bool open(const string& filename,
+            bool file_format,
+            const vector<string>& names,
+            const vector<int>& types);
+  // Write the staged columns as a record batch and clear them.
+  bool write(vector<Column>* columns);
+  // Write the remaining columns and the end of the stream or file.
+  bool finish(vector<Column>* columns);
+  // Number of rows written.
+  uint64_t rows() const { return rows_; }
+  // Error message of the last failure.
+  const string& errorMessage() const { return error_message_; }
+
+private:
+  // Location of a record batch in the file.
+  typedef struct {
+    int64_t offset;           // Offset of the message.
+    int64_t metadata_length;  // Bytes of the prefix and metadata.
+    int64_t body_length;      // Bytes of the body.
+  } Block;
+
+  // Write an encapsulated message.
+  bool writeMessage(const string& metadata, const string& body, Block* block);
+  // Write bytes to the output and advance the position.
+  bool write(const void* data, size_t size);
+  // Set the error message of the failed file operation.
+  bool setError();
+
+  // Output file.
+  FILE* output_;
+  // Output file name.
+  string filename_;
+  // True for the file format, false for the stream format.
+  bool file_format_;
+  // Names and types of the columns.
+  vector<string> names_;
+  vector<int> types_;
+  // True once the schema message is written.
+  bool schema_written_;
+  // Bytes written.
+  uint64_t position_;
+  // Rows written.
+  uint64_t rows_;
+  // Record batches written.
+  vector<Block> blocks_;
+  // Error message of the last failure.
+  string error_message_;
+};
+
+// Read-only memory map of a file.
+class MappedFile {
+public:
+  // Create an empty map.
+  MappedFile();
+  // Unmap the file.
+  ~MappedFile();
+  // Map the whole file.
+  bool open(const string& filename);
+  // Unmap the file.
+  void close();
+  // Mapped bytes.
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+private:
+  const char* data_;
+  size_t size_;
+#ifdef _WIN32
+  // Handles of the file and the mapping.
+  void* file_;
+  void* mapping_;
+#endif
+};
+
+// Rows of a CSV block converted to values.
+typedef struct {
+  size_t rows;           // Rows in the block.
+  vector<Datum> values;  // Values of the rows, row by row.
+  string data;           // Bytes of the text values.
+  string error;          // Message of the malformed record, if any.
+} CSVBlock;
+
+// Parser of a CSV file. The mapped file is split into blocks at record
+// boundaries, and the blocks are parsed on threads and taken in file order.
+// Records follow RFC 4180: fields with delimiters, quotes, or newlines are
+// quoted, and quotes in them are doubled. Unquoted empty fields are null.
+class CSVParser {
+public:
+  // Create a new parser.
+  CSVParser();
+  // Stop the threads.
+  ~CSVParser();
+  // Map the file, read the header, and infer the column types.
+  bool open(const string& filename, const CSVOptions& options);
+  // Column names of the header, or Var1, Var2, ... without the header.
+  const vector<string>& names() const { return names_; }
+  // Column types inferred from the sample: SQLITE_INTEGER, SQLITE_FLOAT, or
+  // SQLITE_TEXT.
+  const vector<int>& types() const { return types_; }
+  // Start parsing the fields into values of the types.
+  void start(const vector<int>& types);
+  // Take the next block. False at the end of the file.
+  bool next(CSVBlock* block);
+  // Stop the threads.
+  void stop();
+  // Error message of the last failure.
+  const string& errorMessage() const { return error_message_; }
+
+private:
+  // Find the block boundaries at record ends.
+  void splitBlocks(const char* begin);
+  // Parse the records of the block up to the given rows.
+  void parseBlock(const char* begin,
+                  const char* end,
+                  size_t max_rows,
+                  CSVBlock* block) const;
+  // Loop of the parser thread.
+  void run();
+
+  // Mapped input.
+  MappedFile file_;
+  // Options of the import.
+  CSVOptions options_;
+  // Column names and types.
+  vector<string> names_;
+  vector<int> types_;
+  // Offsets of the blocks. Block i is [boundaries_[i], boundaries_[i + 1]).
+  vector<size_t> boundaries_;
+  // Parser threads.
+  vector<thread> threads_;
+  // Guards the fields below.
+  mutex mutex_;
+  condition_variable condition_;
+  // Next block to parse and to take.
+  size_t next_parse_;
+  size_t next_take_;
+  // Parsed blocks waiting to be taken.
+  map<size_t, CSVBlock> parsed_;
+  // True when the threads should stop.
+  bool stopping_;
+  // Error message of the last failure.
+  string error_message_;
+};
+
+// Writer of a CSV file. Rows are buffered and written in large chunks,
+// optionally through gzip.
+class CSVWriter {
+public:
+  // Create a new writer.
+  CSVWriter();
+  // Close and remove the output unless finished.
+  ~CSVWriter();
+  // Open the output file.
+  bool open(const string& filename, const CSVOptions& options);
+  // Write a record of the column names.
+  bool writeHeader(const vector<string>& names);
+  // Append a field of the value. Data is the text or blob bytes.
+  void appendValue(const Datum& value, const char* data);
+  // End the record and write the buffer when it is full.
+  bool endRow();
+  // Write the buffer and close the output.
+  bool finish();
+  // Error message of the last failure.
+  const string& errorMessage() const { return error_message_; }
+
+private:
+  // Append a text field, quoting it as needed.
+  void appendText(const char* data, size_t size);
+  // Write the buffer to the output.
+  bool flush();
+  // Close the output.
+  bool close();
+
+  // Output file, a FILE* or a gzFile.
+  void* output_;
+  // Output file name.
+  string filename_;
+  // Options of the export.
+  CSVOptions options_;
+  // Buffered records.
+  string buffer_;
+  // True at the start of a record.
+  bool row_start_;
+  // Error message of the last failure.
+  string error_message_;
+};
+
 // Database connection.
 class Database {
 public:
@@ -127,31 +722,344 @@ public:
   ~Database();
   // Open a connection.
   bool open(const string& filename, int flags);
+  // Run the pragma statements, e.g., "mmap_size = 1073741824", and load the
+  // schema so that the first query does not parse it.
+  bool configure(const vector<string>& pragmas);
   // Return the last error code.
   int errorCode() const;
   // Return the last error message.
   const char* errorMessage() const;
-  // Execute SQL statement.
+  // Return the matlab error id of the last error.
+  const char* errorId() const;
+  // Execute SQL statement. Name-value pairs following the parameters of the
+  // statement are execute options, e.g., 'Format', 'table'.
   bool execute(const string& statement,
                const vector<const mxArray*>& params,
                mxArray** result);
-  // Set timeout when busy.
+  // Execute SQL statement and write the result to the columnar file without
+  // creating matlab arrays. Rows is the number of rows written.
+  bool exportColumns(const string& statement,
+                     const vector<const mxArray*>& params,
+                     const string& filename,
+                     uint64_t* rows);
+  // Execute SQL statement and write the result to the Arrow IPC stream or
+  // file in record batches. Rows is the number of rows written.
+  bool exportArrow(const string& statement,
+                   const vector<const mxArray*>& params,
+                   const string& filename,
+                   const ArrowOptions& arrow_options,
+                   uint64_t* rows);
+  // Import the CSV file into the table, creating the table with the
+  // inferred column types if it does not exist. Rows is the number of rows
+  // imported.
+  bool importCSV(const string& table,
+                 const string& filename,
+                 const CSVOptions& options,
+                 uint64_t* rows);
+  // Insert the rows of the struct array into the table, or the rows of the
+  // scalar struct of column arrays when columns is true. Fields are bound to
+  // the columns of the same name through one cached statement. Rows is the
+  // number of rows inserted.
+  bool insert(const string& table,
+              const mxArray* data,
+              bool columns,
+              uint64_t* rows);
+  // Execute SQL statement and write the result rows to the CSV file as they
+  // are stepped. Rows is the number of rows written.
+  bool exportCSV(const string& statement,
+                 const vector<const mxArray*>& params,
+                 const string& filename,
+                 const CSVOptions& options,
+                 uint64_t* rows);
+  // Execute all statements in the SQL script in one transaction. Parameters
+  // are bound to the statements in order. The result is of the last
+  // statement.
+  bool executeScript(const string& script,
+                     const vector<const mxArray*>& params,
+                     mxArray** result);
+  // Set timeout when busy. This replaces the busy handler.
   bool busyTimeout(int milliseconds);
+  // Wait on busy locks by the policy and count the waits.
+  bool setBusyHandler(const BusyPolicy& policy);
+  // Statistics of the busy handler, optionally reset after taken.
+  BusyStats busyStats(bool reset);
+  // Limits applied to every query of this connection.
+  const QueryLimits& limits() const { return limits_; }
+  void setLimits(const QueryLimits& limits) { limits_ = limits; }
+  // Begin a transaction in "deferred", "immediate", or "exclusive" mode.
+  bool begin(const string& mode);
+  // Commit the transaction.
+  bool commit();
+  // Roll back the transaction.
+  bool rollback();
+  // Start a savepoint within the transaction.
+  bool savepoint(const string& name);
+  // Release the savepoint.
+  bool release(const string& name);
+  // Roll back to the savepoint.
+  bool rollbackTo(const string& name);
+  // Set the capacity in bytes of the cache of read-only query results in
+  // execute(). Zero disables and clears the cache.
+  void setResultCacheCapacity(size_t capacity);
+  // Remove the cached results.
+  void clearResultCache();
+  // Statistics of the result cache.
+  ResultCacheStats resultCacheStats();
+  // Record the committed row changes, keeping the given number of the
+  // latest. Zero stops recording. Token is of the next change.
+  void trackChanges(size_t capacity, uint64_t* token);
+  // Get the changes since the token, and the token of the next change.
+  // Overflow is true if some of the changes were dropped.
+  void changesSince(uint64_t since,
+                    vector<TableChanges>* changes,
+                    bool* overflow,
+                    uint64_t* token);
+  // Start recording the changes of the tables, or of all tables when
+  // empty, in a changeset session of the given id. Sessions need the driver
+  // built with the session extension.
+  bool startSession(const vector<string>& tables, uint64_t* id);
+  // Check if the session is of this connection.
+  bool hasSession(uint64_t id) const;
+  // Get the changeset, or the patchset, of the changes since the start.
+  bool changeset(uint64_t id, bool patchset, string* changeset);
+  // Delete the session.
+  void endSession(uint64_t id);
+  // Apply the changeset in one savepoint. Conflicts is the number of the
+  // conflicting changes resolved by the policy.
+  bool applyChangeset(const string& changeset,
+                      ConflictPolicy policy,
+                      int* conflicts);
+  // Start a bulk load into the tables. Their indexes are dropped, keeping
+  // the definitions in the sqlite3mex_bulkload table, and writes are not
+  // synced with the cache of the given bytes until endBulkLoad().
+  bool beginBulkLoad(const vector<string>& tables, int64_t cache_bytes);
+  // Restore the settings and rebuild the indexes dropped by beginBulkLoad(),
+  // including ones left by a load that did not end.
+  bool endBulkLoad();
+  // Run the maintenance by the policy on a background thread with its own
+  // connection to the database file, so that queries of this connection
+  // do not wait for it. A running maintenance is stopped first.
+  bool autoCheckpoint(const CheckpointPolicy& policy);
+  // Statistics of the maintenance, optionally reset after taken.
+  CheckpointStats checkpointStats(bool reset);
+  // Read the tables and their indexes, or the whole database when empty,
+  // into the OS cache, or into the page cache of the connection, on a
+  // background thread. A running warm-up is stopped first.
+  bool warm(const vector<string>& tables, bool page_cache, bool wait);
+  // Buffer writes outside of an explicit transaction in a transaction that
+  // is committed every given rows or milliseconds, whichever comes first.
+  // Zero disables the condition, and both zero disables group commit.
+  bool groupCommit(int rows, int milliseconds);
 
 private:
   // Close the connection.
   void close();
+  // Execute a transaction control statement.
+  bool executeControl(const char* sql);
+  // Open the group transaction before the statement if needed.
+  bool beginGroup(Statement* statement);
+  // Count changes and commit the group transaction when due.
+  bool endGroup(int changes, bool force);
+  // Background loop committing the group transaction on the interval.
+  void runGroupCommit();
+  // Stop the background group commit thread.
+  void stopGroupCommit();
+  // Background loop of the maintenance.
+  void runCheckpoint();
+  // Run one round of the maintenance on the connection of the thread.
+  void checkpointOnce(const CheckpointPolicy& policy,
+                      CheckpointStats* stats);
+  // Stop the maintenance thread and close its connection.
+  void stopCheckpoint();
+  // Background warm-up of the file, or of the b-trees by the queries. The
+  // flag of a query tells that it scans rowids from the bound one.
+  void runWarm(const string& filename,
+               const vector<uint32_t>& root_pages,
+               const vector<pair<string, bool> >& queries);
+  // Stop the background warm-up thread.
+  void stopWarm();
+  // Delete the session without locking the mutex, e.g., in close().
+  void deleteSession(uint64_t id);
+  // Step the statement to the end and keep rows in columns. Rows are
+  // written to the spill file when the staged bytes exceed the threshold.
+  bool fetchColumns(Statement* statement,
+                    const ExecuteOptions& options,
+                    vector<Column>* columns,
+                    ColumnarWriter* spill);
+  // Start writing the result to the spill file.
+  bool openSpill(Statement* statement,
+                 const ExecuteOptions& options,
+                 vector<Column>* columns,
+                 ColumnarWriter* spill);
+  // Step the statement to the end and write the rows to the columnar file.
+  bool writeColumns(Statement* statement,
+                    const QueryLimits& limits,
+                    const string& filename,
+                    ColumnarWriter* writer);
+  // Step the statement to the end and write the rows in record batches.
+  bool writeArrow(Statement* statement,
+                  const QueryLimits& limits,
+                  const string& filename,
+                  const ArrowOptions& arrow_options,
+                  ArrowWriter* writer);
+  // Step the statement to the end and write the rows to the CSV file.
+  bool writeCSV(Statement* statement,
+                const QueryLimits& limits,
+                const string& filename,
+                const CSVOptions& options,
+                uint64_t* rows);
+  // Match the CSV columns to the table and take the column types of it.
+  bool matchTable(const string& table,
+                  const CSVParser& parser,
+                  const CSVOptions& options,
+                  bool* exists,
+                  vector<int>* types);
+  // Insert the parsed rows through one prepared statement.
+  bool insertCSV(const string& table,
+                 const CSVOptions& options,
+                 bool exists,
+                 bool nested,
+                 CSVParser* parser,
+                 uint64_t* rows);
+  // Bind and step the rows of insert().
+  bool insertRows(Statement* statement,
+                  const mxArray* data,
+                  bool columns,
+                  const vector<int>& indices,
+                  size_t num_rows,
+                  uint64_t* rows);
+  // Get the version of the database to validate the cached results.
+  bool databaseVersion(DatabaseVersion* version);
+  // Get the integer result of the SQL statement, e.g., a pragma.
+  bool queryInteger(const char* sql, int64_t* value);
+  // Rebuild the indexes kept in the sqlite3mex_bulkload table.
+  bool rebuildIndexes();
+  // Set the error message that overrides the one from sqlite.
+  void setErrorMessage(const string& message);
+  // Set the error id and message.
+  void setError(const string& id, const string& message);
+  // Clear the last error.
+  void clearError();
+  // Scope of a query enforcing the limits and polling the interrupt.
+  class QueryScope;
+  // Start enforcing the limits and polling the interrupt.
+  void startQuery(const QueryLimits& limits);
+  // Stop enforcing the limits and polling the interrupt.
+  void finishQuery();
+  // Progress handler to stop the statement past the deadline or on Ctrl-C.
+  static int progressHandler(void* database);
+  // Hooks recording the row changes to the change log.
+  static void updateHook(void* database,
+                         int operation,
+                         const char* schema,
+                         const char* table,
+                         sqlite3_int64 rowid);
+  static int commitHook(void* database);
+  static void rollbackHook(void* database);
+  // Trace callback keeping the committed changes before the next statement.
+  static void traceHook(void* database, const char* statement);
+  // Busy handler waiting by the busy policy.
+  static int busyHandler(void* database, int count);
+  // Report the stopped query with how far it got.
+  void setQueryError(const char* id,
+                     const string& reason,
+                     size_t rows,
+                     size_t bytes);
+  // Report the query stopped by the progress handler.
+  void setInterruptError(const QueryLimits& limits, size_t rows, size_t bytes);
+  // Bind parameters and keep the error message of the failure.
+  bool bind(Statement* statement, const vector<const mxArray*>& params);
+  // Set an execute option from the name-value pair.
+  bool setOption(const string& name,
+                 const mxArray* value,
+                 ExecuteOptions* options);
+  // Separate trailing execute options from the bind parameters.
+  bool parseOptions(Statement* statement,
+                    vector<const mxArray*>* params,
+                    ExecuteOptions* options);
   // Make columns and fill in matlab-safe column names.
   void createColumns(const Statement& statement,
                       vector<Column>* columns) const;
-  // Convert vector<Column> to mxArray*.
+  // Convert vector<Column> to mxArray* in the requested format.
   bool convertColumnsToArray(vector<Column>* columns,
-                                mxArray** array) const;
-  // Convert Value object to mxArray*.
-  mxArray* convertValueToArray(const Value& value) const;
+                             const ExecuteOptions& options,
+                             mxArray** array) const;
+  // Convert vector<Column> to a struct array of rows.
+  mxArray* convertColumnsToStruct(vector<Column>* columns) const;
+  // Convert vector<Column> to a table.
+  mxArray* convertColumnsToTable(vector<Column>* columns) const;
+  // Convert a column to a numeric vector, a string array, a categorical
+  // array, or a cell array.
+  mxArray* convertColumnToArray(Column* column) const;
+  // Convert a value of the column to mxArray*.
+  mxArray* convertValueToArray(const Column& column, size_t row) const;
 
   // Statement cache.
   StatementCache statement_cache_;
+  // Result cache.
+  ResultCache result_cache_;
+  // Log of the committed row changes.
+  ChangeLog change_log_;
+  // Changeset sessions by id.
+  map<uint64_t, sqlite3_session*> sessions_;
+  // Error message of the last failure not reported by sqlite.
+  string error_message_;
+  // Error id of the last failure, or empty for the generic one.
+  string error_id_;
+  // Limits applied to every query.
+  QueryLimits limits_;
+  // True while a query runs on the matlab thread.
+  bool query_active_;
+  // True if the running query is interrupted by Ctrl-C.
+  bool query_interrupted_;
+  // Deadline of the running query, if query_deadline_active_.
+  bool query_deadline_active_;
+  chrono::steady_clock::time_point query_deadline_;
+  // Time the running query started.
+  chrono::steady_clock::time_point query_start_;
+  // Group commit condition in rows and milliseconds.
+  int group_rows_;
+  int group_milliseconds_;
+  // True if the open transaction is started by the group commit.
+  bool group_open_;
+  // Rows changed in the group transaction.
+  int group_changes_;
+  // Time the group transaction started.
+  chrono::steady_clock::time_point group_start_;
+  // Background thread to commit the group transaction in time.
+  thread group_thread_;
+  // Notification to the background thread.
+  condition_variable group_condition_;
+  // Flag to stop the background thread.
+  bool group_stopping_;
+  // Policy and statistics of the busy handler, the start of the current
+  // busy event, and the random numbers of the jitter.
+  BusyPolicy busy_policy_;
+  BusyStats busy_stats_;
+  chrono::steady_clock::time_point busy_start_;
+  minstd_rand busy_random_;
+  // Maintenance thread, its connection, policy, and statistics, guarded by
+  // the checkpoint mutex instead of the mutex of this connection.
+  thread checkpoint_thread_;
+  sqlite3* checkpoint_database_;
+  CheckpointPolicy checkpoint_policy_;
+  CheckpointStats checkpoint_stats_;
+  mutex checkpoint_mutex_;
+  condition_variable checkpoint_condition_;
+  bool checkpoint_stopping_;
+  // Background thread of warm() and the flag to stop it.
+  thread warm_thread_;
+  atomic<bool> warm_stopping_;
+  // True while a slice of the warm-up runs, and the end of the slice.
+  bool warm_active_;
+  chrono::steady_clock::time_point warm_deadline_;
+  // True between beginBulkLoad() and endBulkLoad().
+  bool bulk_loading_;
+  // Synchronous and cache size settings to restore after the bulk load.
+  int64_t bulk_synchronous_;
+  int64_t bulk_cache_size_;
+  // Mutex for the connection shared with the background thread.
+  mutex mutex_;
   // SQLite3 C object.
   sqlite3* database_;
 };
@@ -0,0 +1,868 @@
+// SQLite3 matlab driver approximate nearest neighbour index.
+//
+// The ann virtual table module implements an inverted file (IVF) index over
+// vectors stored as float blobs. Vectors are partitioned into lists by the
+// nearest k-means centroid, and a query scans only the lists of the closest
+// centroids. The index is persisted in two shadow tables, where the list
+// lookup uses the automatic index of the UNIQUE (list, id) constraint so that
+// renaming the table carries the index along.
+//
+//    CREATE VIRTUAL TABLE idx USING ann(dim=128, metric=l2, lists=1024);
+//    INSERT INTO idx(rowid, vector) VALUES (?, ?);
+//    SELECT rowid, distance FROM idx WHERE vector MATCH ? AND k = 10;
+//
+// Until enough vectors are inserted to train the centroids, queries fall back
+// to the exact scan of all vectors.
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdlib>
+#include <cstring>
+#include <sqlite3mex.h>
+
+namespace {
+
+using sqlite3mex::VectorMetric;
+
+// Number of vectors per list required before training the centroids.
+const int kTrainingFactor = 32;
+// Maximum number of sample vectors per list used in training.
+const int kSamplesPerList = 64;
+// Number of k-means iterations.
+const int kTrainingIterations = 10;
+// Default number of neighbours returned by a query.
+const int kDefaultK = 10;
+// List id of the vectors not assigned to any centroid.
+const int kUnassignedList = -1;
+
+// Column indices of the virtual table.
+enum AnnColumn {
+  kVectorColumn = 0,
+  kDistanceColumn = 1,
+  kKColumn = 2,
+  kProbesColumn = 3
+};
+
+// Query plan flags in idxNum.
+enum AnnPlan {
+  kFullScanPlan = 0,
+  kMatchPlan = 1,
+  kKPlan = 2,
+  kProbesPlan = 4,
+  kRowidPlan = 8
+};
+
+// Candidate of the nearest neighbour search.
+typedef pair<double, sqlite3_int64> Neighbour;
+
+// Virtual table object.
+struct AnnTable : public sqlite3_vtab {
+  AnnTable() : database(NULL), dimension(0), metric(sqlite3mex::kVectorL2),
+      lists(100), probes(8), element_size(sizeof(float)),
+      centroids_loaded(false), unassigned_count(-1), insert_statement(NULL),
+      list_statement(NULL), vector_statement(NULL) {
+    memset(static_cast<sqlite3_vtab*>(this), 0, sizeof(sqlite3_vtab));
+  }
+  ~AnnTable() {
+    sqlite3_finalize(insert_statement);
+    sqlite3_finalize(list_statement);
+    sqlite3_finalize(vector_statement);
+  }
+
+  // Connection and names.
+  sqlite3* database;
+  string schema;
+  string name;
+  // Index parameters.
+  int dimension;
+  VectorMetric metric;
+  int lists;
+  int probes;
+  size_t element_size;
+  // Cached centroids, lists * dimension elements. Empty when not trained.
+  vector<uint8_t> centroids;
+  bool centroids_loaded;
+  // Cached number of unassigned vectors, or -1 if unknown.
+  sqlite3_int64 unassigned_count;
+  // Cached statements.
+  sqlite3_stmt* insert_statement;
+  sqlite3_stmt* list_statement;
+  sqlite3_stmt* vector_statement;
+};
+
+// Cursor object.
+struct AnnCursor : public sqlite3_vtab_cursor {
+  AnnCursor() : plan(kFullScanPlan), position(0), k(0), probes(0),
+      statement(NULL) {
+    memset(static_cast<sqlite3_vtab_cursor*>(this), 0,
+           sizeof(sqlite3_vtab_cursor));
+  }
+  ~AnnCursor() { sqlite3_finalize(statement); }
+
+  // Plan of the current query.
+  int plan;
+  // Search results sorted by distance.
+  vector<Neighbour> neighbours;
+  size_t position;
+  int k;
+  int probes;
+  // Statement for the scan or the rowid lookup.
+  sqlite3_stmt* statement;
+};
+
+// Set the error message of the virtual table.
+void setError(sqlite3_vtab* table, const char* message) {
+  sqlite3_free(table->zErrMsg);
+  table->zErrMsg = sqlite3_mprintf("%s", message);
+}
+
+// Run a SQL statement formatted by sqlite3_mprintf.
+int executeFormat(sqlite3* database, const char* format, ...) {
+  va_list arguments;
+  va_start(arguments, format);
+  char* sql = sqlite3_vmprintf(format, arguments);
+  va_end(arguments);
+  if (!sql)
+    return SQLITE_NOMEM;
+  int code = sqlite3_exec(database, sql, NULL, NULL, NULL);
+  sqlite3_free(sql);
+  return code;
+}
+
+// Prepare a statement formatted by sqlite3_mprintf.
+int prepareFormat(sqlite3* database,
+                  sqlite3_stmt** statement,
+                  const char* format, ...) {
+  va_list arguments;
+  va_start(arguments, format);
+  char* sql = sqlite3_vmprintf(format, arguments);
+  va_end(arguments);
+  if (!sql)
+    return SQLITE_NOMEM;
+  int code = sqlite3_prepare_v2(database, sql, -1, statement, NULL);
+  sqlite3_free(sql);
+  return code;
+}
+
+// Distance between two vectors of the table. Smaller is nearer, so the dot
+// product is negated.
+double computeDistance(const AnnTable& table, const void* a, const void* b) {
+  double value = (table.element_size == sizeof(float)) ?
+      sqlite3mex::computeVectorMetric(table.metric,
+                                      static_cast<const float*>(a),
+                                      static_cast<const float*>(b),
+                                      table.dimension) :
+      sqlite3mex::computeVectorMetric(table.metric,
+                                      static_cast<const double*>(a),
+                                      static_cast<const double*>(b),
+                                      table.dimension);
+  return (table.metric == sqlite3mex::kVectorDot) ? -value : value;
+}
+
+// Parse a module argument `key=value`.
+bool parseArgument(const char* argument, string* key, string* value) {
+  string text(argument);
+  size_t separator = text.find('=');
+  if (separator == string::npos)
+    return false;
+  *key = text.substr(0, separator);
+  *value = text.substr(separator + 1);
+  key->erase(0, key->find_first_not_of(" \t"));
+  key->erase(key->find_last_not_of(" \t") + 1);
+  value->erase(0, value->find_first_not_of(" \t'\""));
+  value->erase(value->find_last_not_of(" \t'\"") + 1);
+  return true;
+}
+
+// Parse module arguments into the table.
+bool parseArguments(AnnTable* table, int argc, const char* const* argv,
+                    char** error) {
+  for (int i = 3; i < argc; ++i) {
+    string key, value;
+    if (!parseArgument(argv[i], &key, &value)) {
+      *error = sqlite3_mprintf("ann: invalid argument %s", argv[i]);
+      return false;
+    }
+    if (key == "dim")
+      table->dimension = atoi(value.c_str());
+    else if (key == "lists")
+      table->lists = atoi(value.c_str());
+    else if (key == "probes")
+      table->probes = atoi(value.c_str());
+    else if (key == "metric" && value == "l2")
+      table->metric = sqlite3mex::kVectorL2;
+    else if (key == "metric" && value == "cosine")
+      table->metric = sqlite3mex::kVectorCosine;
+    else if (key == "metric" && value == "dot")
+      table->metric = sqlite3mex::kVectorDot;
+    else if (key == "type" && value == "float32")
+      table->element_size = sizeof(float);
+    else if (key == "type" && value == "float64")
+      table->element_size = sizeof(double);
+    else {
+      *error = sqlite3_mprintf("ann: invalid argument %s", argv[i]);
+      return false;
+    }
+  }
+  if (table->dimension <= 0 || table->lists <= 0 || table->probes <= 0) {
+    *error = sqlite3_mprintf("ann: dim, lists and probes must be positive");
+    return false;
+  }
+  return true;
+}
+
+// Load the centroids from the shadow table unless cached.
+int loadCentroids(AnnTable* table) {
+  if (table->centroids_loaded)
+    return SQLITE_OK;
+  sqlite3_stmt* statement = NULL;
+  int code = prepareFormat(table->database, &statement,
+      "SELECT centroid FROM \"%w\".\"%w_centroids\" ORDER BY list",
+      table->schema.c_str(), table->name.c_str());
+  if (code != SQLITE_OK)
+    return code;
+  size_t vector_size = table->dimension * table->element_size;
+  table->centroids.clear();
+  while ((code = sqlite3_step(statement)) == SQLITE_ROW) {
+    const uint8_t* blob = static_cast<const uint8_t*>(
+        sqlite3_column_blob(statement, 0));
+    if (static_cast<size_t>(sqlite3_column_bytes(statement, 0)) !=
+        vector_size) {
+      code = SQLITE_CORRUPT_VTAB;
+      break;
+    }
+    table->centroids.insert(table->centroids.end(), blob, blob + vector_size);
+  }
+  sqlite3_finalize(statement);
+  if (code != SQLITE_DONE) {
+    table->centroids.clear();
+    return code;
+  }
+  table->centroids_loaded = true;
+  return SQLITE_OK;
+}
+
+// Number of trained lists.
+int trainedLists(const AnnTable& table) {
+  return table.centroids.size() / (table.dimension * table.element_size);
+}
+
+// Find the nearest list of the vector.
+int findNearestList(const AnnTable& table, const void* vector) {
+  int nearest = kUnassignedList;
+  double nearest_distance = 0.0;
+  size_t vector_size = table.dimension * table.element_size;
+  for (int i = 0; i < trainedLists(table); ++i) {
+    double distance = computeDistance(table,
+                                      vector,
+                                      &table.centroids[i * vector_size]);
+    if (nearest == kUnassignedList || distance < nearest_distance) {
+      nearest = i;
+      nearest_distance = distance;
+    }
+  }
+  return nearest;
+}
+
+// Store a mean vector in the element type of the table.
+void storeMean(const AnnTable& table, const vector<double>& sum, double count,
+               uint8_t* output) {
+  for (int j = 0; j < table.dimension; ++j) {
+    if (table.element_size == sizeof(float))
+      reinterpret_cast<float*>(output)[j] = sum[j] / count;
+    else
+      reinterpret_cast<double*>(output)[j] = sum[j] / count;
+  }
+}
+
+// Accumulate a vector in the element type of the table.
+void accumulate(const AnnTable& table, const uint8_t* input,
+                vector<double>* sum) {
+  for (int j = 0; j < table.dimension; ++j)
+    (*sum)[j] += (table.element_size == sizeof(float)) ?
+        reinterpret_cast<const float*>(input)[j] :
+        reinterpret_cast<const double*>(input)[j];
+}
+
+// Train centroids by k-means over a random sample and assign all vectors to
+// the nearest list.
+int trainCentroids(AnnTable* table) {
+  size_t vector_size = table->dimension * table->element_size;
+  // Load a sample.
+  sqlite3_stmt* statement = NULL;
+  int code = prepareFormat(table->database, &statement,
+      "SELECT vector FROM \"%w\".\"%w_vectors\" ORDER BY random() LIMIT %d",
+      table->schema.c_str(), table->name.c_str(),
+      table->lists * kSamplesPerList);
+  if (code != SQLITE_OK)
+    return code;
+  vector<uint8_t> samples;
+  while ((code = sqlite3_step(statement)) == SQLITE_ROW) {
+    if (static_cast<size_t>(sqlite3_column_bytes(statement, 0)) != vector_size)
+      continue;
+    const uint8_t* blob = static_cast<const uint8_t*>(
+        sqlite3_column_blob(statement, 0));
+    samples.insert(samples.end(), blob, blob + vector_size);
+  }
+  sqlite3_finalize(statement);
+  if (code != SQLITE_DONE)
+    return code;
+  size_t sample_count = samples.size() / vector_size;
+  if (sample_count < static_cast<size_t>(table->lists))
+    return SQLITE_OK;
+  // Lloyd iterations initialized by the first samples in random order.
+  table->centroids.assign(samples.begin(),
+                          samples.begin() + table->lists * vector_size);
+  vector<int> assignments(sample_count, kUnassignedList);
+  for (int iteration = 0; iteration < kTrainingIterations; ++iteration) {
+    bool changed = false;
+    for (size_t i = 0; i < sample_count; ++i) {
+      int list = findNearestList(*table, &samples[i * vector_size]);
+      changed |= (list != assignments[i]);
+      assignments[i] = list;
+    }
+    if (!changed)
+      break;
+    vector<vector<double> > sums(table->lists,
+                                 vector<double>(table->dimension, 0.0));
+    vector<size_t> counts(table->lists, 0);
+    for (size_t i = 0; i < sample_count; ++i) {
+      accumulate(*table, &samples[i * vector_size], &sums[assignments[i]]);
+      ++counts[assignments[i]];
+    }
+    for (int list = 0; list < table->lists; ++list) {
+      uint8_t* centroid = &table->centroids[list * vector_size];
+      if (counts[list] > 0)
+        storeMean(*table, sums[list], counts[list], centroid);
+      else
+        memcpy(centroid,
+               &samples[(rand() % sample_count) * vector_size],
+               vector_size);
+    }
+  }
+  // Save centroids.
+  code = executeFormat(table->database,
+                       "DELETE FROM \"%w\".\"%w_centroids\"",
+                       table->schema.c_str(), table->name.c_str());
+  if (code != SQLITE_OK)
+    return code;
+  code = prepareFormat(table->database, &statement,
+      "INSERT INTO \"%w\".\"%w_centroids\"(list, centroid) VALUES (?, ?)",
+      table->schema.c_str(), table->name.c_str());
+  if (code != SQLITE_OK)
+    return code;
+  for (int list = 0; list < table->lists && code == SQLITE_OK; ++list) {
+    sqlite3_bind_int(statement, 1, list);
+    sqlite3_bind_blob(statement, 2, &table->centroids[list * vector_size],
+                      vector_size, SQLITE_STATIC);
+    code = sqlite3_step(statement);
+    code = (code == SQLITE_DONE) ? sqlite3_reset(statement) : code;
+  }
+  sqlite3_finalize(statement);
+  if (code != SQLITE_OK)
+    return code;
+  table->centroids_loaded = true;
+  // Assign all vectors.
+  code = prepareFormat(table->database, &statement,
+      "SELECT id, vector FROM \"%w\".\"%w_vectors\"",
+      table->schema.c_str(), table->name.c_str());
+  if (code != SQLITE_OK)
+    return code;
+  vector<pair<sqlite3_int64, int> > lists;
+  while ((code = sqlite3_step(statement)) == SQLITE_ROW) {
+    if (static_cast<size_t>(sqlite3_column_bytes(statement, 1)) != vector_size)
+      continue;
+    lists.push_back(make_pair(
+        sqlite3_column_int64(statement, 0),
+        findNearestList(*table, sqlite3_column_blob(statement, 1))));
+  }
+  sqlite3_finalize(statement);
+  if (code != SQLITE_DONE)
+    return code;
+  code = prepareFormat(table->database, &statement,
+      "UPDATE \"%w\".\"%w_vectors\" SET list = ? WHERE id = ?",
+      table->schema.c_str(), table->name.c_str());
+  if (code != SQLITE_OK)
+    return code;
+  for (size_t i = 0; i < lists.size() && code == SQLITE_OK; ++i) {
+    sqlite3_bind_int(statement, 1, lists[i].second);
+    sqlite3_bind_int64(statement, 2, lists[i].first);
+    code = sqlite3_step(statement);
+    code = (code == SQLITE_DONE) ? sqlite3_reset(statement) : code;
+  }
+  sqlite3_finalize(statement);
+  table->unassigned_count = 0;
+  return code;
+}
+
+int annRollback(sqlite3_vtab* vtab);
+
+// Count unassigned vectors and train when there are enough of them.
+int trainIfReady(AnnTable* table) {
+  sqlite3_int64 threshold =
+      static_cast<sqlite3_int64>(table->lists) * kTrainingFactor;
+  if (table->unassigned_count >= 0 && table->unassigned_count < threshold)
+    return SQLITE_OK;
+  sqlite3_stmt* statement = NULL;
+  int code = prepareFormat(table->database, &statement,
+      "SELECT count(*) FROM \"%w\".\"%w_vectors\" WHERE list = %d",
+      table->schema.c_str(), table->name.c_str(), kUnassignedList);
+  if (code != SQLITE_OK)
+    return code;
+  if (sqlite3_step(statement) == SQLITE_ROW)
+    table->unassigned_count = sqlite3_column_int64(statement, 0);
+  code = sqlite3_finalize(statement);
+  if (code != SQLITE_OK || table->unassigned_count < threshold)
+    return code;
+  code = trainCentroids(table);
+  if (code != SQLITE_OK)
+    annRollback(table);
+  return code;
+}
+
+// Scan one list and keep the k nearest neighbours in the max-heap.
+int scanList(AnnTable* table, int list, const void* query, int k,
+             vector<Neighbour>* heap) {
+  if (!table->list_statement) {
+    int code = prepareFormat(table->database, &table->list_statement,
+        "SELECT id, vector FROM \"%w\".\"%w_vectors\" WHERE list = ?",
+        table->schema.c_str(), table->name.c_str());
+    if (code != SQLITE_OK)
+      return code;
+  }
+  size_t vector_size = table->dimension * table->element_size;
+  sqlite3_stmt* statement = table->list_statement;
+  sqlite3_bind_int(statement, 1, list);
+  int code;
+  while ((code = sqlite3_step(statement)) == SQLITE_ROW) {
+    if (static_cast<size_t>(sqlite3_column_bytes(statement, 1)) != vector_size)
+      continue;
+    Neighbour neighbour(
+        computeDistance(*table, query, sqlite3_column_blob(statement, 1)),
+        sqlite3_column_int64(statement, 0));
+    if (heap->size() < static_cast<size_t>(k)) {
+      heap->push_back(neighbour);
+      push_heap(heap->begin(), heap->end());
+    }
+    else if (neighbour < heap->front()) {
+      pop_heap(heap->begin(), heap->end());
+      heap->back() = neighbour;
+      push_heap(heap->begin(), heap->end());
+    }
+  }
+  sqlite3_reset(statement);
+  return (code == SQLITE_DONE) ? SQLITE_OK : code;
+}
+
+// Search k nearest neighbours by probing the nearest lists.
+int search(AnnTable* table, const void* query, int k, int probes,
+           vector<Neighbour>* neighbours) {
+  neighbours->clear();
+  int code = loadCentroids(table);
+  if (code != SQLITE_OK)
+    return code;
+  code = scanList(table, kUnassignedList, query, k, neighbours);
+  int list_count = trainedLists(*table);
+  if (code == SQLITE_OK && list_count > 0) {
+    size_t vector_size = table->dimension * table->element_size;
+    vector<pair<double, int> > lists(list_count);
+    for (int i = 0; i < list_count; ++i)
+      lists[i] = make_pair(
+          computeDistance(*table, query, &table->centroids[i * vector_size]),
+          i);
+    probes = min(probes, list_count);
+    partial_sort(lists.begin(), lists.begin() + probes, lists.end());
+    for (int i = 0; i < probes && code == SQLITE_OK; ++i)
+      code = scanList(table, lists[i].second, query, k, neighbours);
+  }
+  sort_heap(neighbours->begin(), neighbours->end());
+  return code;
+}
+
+// Common part of xCreate and xConnect.
+int connectTable(sqlite3* database,
+                 int argc,
+                 const char* const* argv,
+                 sqlite3_vtab** vtab,
+                 char** error,
+                 bool create) {
+  AnnTable* table = new AnnTable();
+  table->database = database;
+  table->schema = argv[1];
+  table->name = argv[2];
+  if (!parseArguments(table, argc, argv, error)) {
+    delete table;
+    return SQLITE_ERROR;
+  }
+  int code = sqlite3_declare_vtab(database,
+      "CREATE TABLE x(vector BLOB, distance HIDDEN REAL, "
+      "k HIDDEN INTEGER, probes HIDDEN INTEGER)");
+  if (code == SQLITE_OK && create) {
+    code = executeFormat(database,
+        "CREATE TABLE \"%w\".\"%w_centroids\"("
+        "list INTEGER PRIMARY KEY, centroid BLOB NOT NULL);"
+        "CREATE TABLE \"%w\".\"%w_vectors\"("
+        "id INTEGER PRIMARY KEY, list INTEGER NOT NULL, vector BLOB NOT NULL, "
+        "UNIQUE (list, id));",
+        argv[1], argv[2], argv[1], argv[2]);
+  }
+  if (code != SQLITE_OK) {
+    *error = sqlite3_mprintf("%s", sqlite3_errmsg(database));
+    delete table;
+    return code;
+  }
+  *vtab = table;
+  return SQLITE_OK;
+}
+
+int annCreate(sqlite3* database, void*, int argc, const char* const* argv,
+              sqlite3_vtab** vtab, char** error) {
+  return connectTable(database, argc, argv, vtab, error, true);
+}
+
+int annConnect(sqlite3* database, void*, int argc, const char* const* argv,
+               sqlite3_vtab** vtab, char** error) {
+  return connectTable(database, argc, argv, vtab, error, false);
+}
+
+int annDisconnect(sqlite3_vtab* vtab) {
+  delete static_cast<AnnTable*>(vtab);
+  return SQLITE_OK;
+}
+
+int annDestroy(sqlite3_vtab* vtab) {
+  AnnTable* table = static_cast<AnnTable*>(vtab);
+  int code = executeFormat(table->database,
+      "DROP TABLE \"%w\".\"%w_vectors\";"
+      "DROP TABLE \"%w\".\"%w_centroids\";",
+      table->schema.c_str(), table->name.c_str(),
+      table->schema.c_str(), table->name.c_str());
+  if (code == SQLITE_OK)
+    delete table;
+  return code;
+}
+
+int annBestIndex(sqlite3_vtab* vtab, sqlite3_index_info* info) {
+  AnnTable* table = static_cast<AnnTable*>(vtab);
+  int match = -1, k = -1, probes = -1, rowid = -1;
+  for (int i = 0; i < info->nConstraint; ++i) {
+    const sqlite3_index_info::sqlite3_index_constraint& constraint =
+        info->aConstraint[i];
+    if (!constraint.usable)
+      continue;
+    if (constraint.iColumn == kVectorColumn &&
+        constraint.op == SQLITE_INDEX_CONSTRAINT_MATCH)
+      match = i;
+    else if (constraint.iColumn == kKColumn &&
+             constraint.op == SQLITE_INDEX_CONSTRAINT_EQ)
+      k = i;
+    else if (constraint.iColumn == kProbesColumn &&
+             constraint.op == SQLITE_INDEX_CONSTRAINT_EQ)
+      probes = i;
+    else if (constraint.iColumn == -1 &&
+             constraint.op == SQLITE_INDEX_CONSTRAINT_EQ)
+      rowid = i;
+  }
+  if (match >= 0) {
+    int argument = 0;
+    info->idxNum = kMatchPlan;
+    info->aConstraintUsage[match].argvIndex = ++argument;
+    info->aConstraintUsage[match].omit = 1;
+    if (k >= 0) {
+      info->idxNum |= kKPlan;
+      info->aConstraintUsage[k].argvIndex = ++argument;
+      info->aConstraintUsage[k].omit = 1;
+    }
+    if (probes >= 0) {
+      info->idxNum |= kProbesPlan;
+      info->aConstraintUsage[probes].argvIndex = ++argument;
+      info->aConstraintUsage[probes].omit = 1;
+    }
+    // Results are sorted by the distance, or by the descending dot product.
+    if (info->nOrderBy == 1 &&
+        info->aOrderBy[0].iColumn == kDistanceColumn &&
+        info->aOrderBy[0].desc == (table->metric == sqlite3mex::kVectorDot))
+      info->orderByConsumed = 1;
+    info->estimatedCost = 1000.0 * table->probes / table->lists;
+    info->estimatedRows = kDefaultK;
+  }
+  else if (rowid >= 0) {
+    info->idxNum = kRowidPlan;
+    info->aConstraintUsage[rowid].argvIndex = 1;
+    info->aConstraintUsage[rowid].omit = 1;
+    info->estimatedCost = 1.0;
+    info->estimatedRows = 1;
+  }
+  else {
+    info->idxNum = kFullScanPlan;
+    info->estimatedCost = 1000000.0;
+  }
+  return SQLITE_OK;
+}
+
+int annOpen(sqlite3_vtab*, sqlite3_vtab_cursor** cursor) {
+  *cursor = new AnnCursor();
+  return SQLITE_OK;
+}
+
+int annClose(sqlite3_vtab_cursor* cursor) {
+  delete static_cast<AnnCursor*>(cursor);
+  return SQLITE_OK;
+}
+
+int annFilter(sqlite3_vtab_cursor* vtab_cursor, int plan, const char*,
+              int argc, sqlite3_value** argv) {
+  AnnCursor* cursor = static_cast<AnnCursor*>(vtab_cursor);
+  AnnTable* table = static_cast<AnnTable*>(cursor->pVtab);
+  sqlite3_finalize(cursor->statement);
+  cursor->statement = NULL;
+  cursor->neighbours.clear();
+  cursor->position = 0;
+  cursor->plan = plan;
+  if (plan & kMatchPlan) {
+    int argument = 0;
+    sqlite3_value* query = argv[argument++];
+    cursor->k = (plan & kKPlan) ?
+        sqlite3_value_int(argv[argument++]) : kDefaultK;
+    cursor->probes = (plan & kProbesPlan) ?
+        sqlite3_value_int(argv[argument++]) : table->probes;
+    if (static_cast<size_t>(sqlite3_value_bytes(query)) !=
+        table->dimension * table->element_size) {
+      setError(table, "ann: query vector size mismatch");
+      return SQLITE_ERROR;
+    }
+    if (cursor->k <= 0 || cursor->probes <= 0)
+      return SQLITE_OK;
+    int code = search(table, sqlite3_value_blob(query), cursor->k,
+                      cursor->probes, &cursor->neighbours);
+    if (code != SQLITE_OK)
+      setError(table, sqlite3_errmsg(table->database));
+    return code;
+  }
+  int code = prepareFormat(table->database, &cursor->statement,
+      "SELECT id, vector FROM \"%w\".\"%w_vectors\"%s",
+      table->schema.c_str(), table->name.c_str(),
+      (plan & kRowidPlan) ? " WHERE id = ?" : "");
+  if (code == SQLITE_OK && (plan & kRowidPlan))
+    code = sqlite3_bind_value(cursor->statement, 1, argv[0]);
+  if (code == SQLITE_OK) {
+    code = sqlite3_step(cursor->statement);
+    code = (code == SQLITE_ROW || code == SQLITE_DONE) ? SQLITE_OK : code;
+  }
+  if (code != SQLITE_OK)
+    setError(table, sqlite3_errmsg(table->database));
+  return code;
+}
+
+int annNext(sqlite3_vtab_cursor* vtab_cursor) {
+  AnnCursor* cursor = static_cast<AnnCursor*>(vtab_cursor);
+  if (cursor->plan & kMatchPlan) {
+    ++cursor->position;
+    return SQLITE_OK;
+  }
+  int code = sqlite3_step(cursor->statement);
+  return (code == SQLITE_ROW || code == SQLITE_DONE) ? SQLITE_OK : code;
+}
+
+int annEof(sqlite3_vtab_cursor* vtab_cursor) {
+  AnnCursor* cursor = static_cast<AnnCursor*>(vtab_cursor);
+  if (cursor->plan & kMatchPlan)
+    return cursor->position >= cursor->neighbours.size();
+  return !cursor->statement || !sqlite3_stmt_busy(cursor->statement);
+}
+
+int annRowid(sqlite3_vtab_cursor* vtab_cursor, sqlite3_int64* rowid) {
+  AnnCursor* cursor = static_cast<AnnCursor*>(vtab_cursor);
+  *rowid = (cursor->plan & kMatchPlan) ?
+      cursor->neighbours[cursor->position].second :
+      sqlite3_column_int64(cursor->statement, 0);
+  return SQLITE_OK;
+}
+
+int annColumn(sqlite3_vtab_cursor* vtab_cursor, sqlite3_context* context,
+              int column) {
+  AnnCursor* cursor = static_cast<AnnCursor*>(vtab_cursor);
+  AnnTable* table = static_cast<AnnTable*>(cursor->pVtab);
+  bool matched = (cursor->plan & kMatchPlan);
+  switch (column) {
+    case kVectorColumn: {
+      if (!matched) {
+        sqlite3_result_value(context,
+                             sqlite3_column_value(cursor->statement, 1));
+        break;
+      }
+      // Fetch the vector of the neighbour on demand.
+      if (!table->vector_statement) {
+        int code = prepareFormat(table->database, &table->vector_statement,
+            "SELECT vector FROM \"%w\".\"%w_vectors\" WHERE id = ?",
+            table->schema.c_str(), table->name.c_str());
+        if (code != SQLITE_OK)
+          return code;
+      }
+      sqlite3_bind_int64(table->vector_statement, 1,
+                         cursor->neighbours[cursor->position].second);
+      if (sqlite3_step(table->vector_statement) == SQLITE_ROW)
+        sqlite3_result_value(context,
+                             sqlite3_column_value(table->vector_statement, 0));
+      sqlite3_reset(table->vector_statement);
+      break;
+    }
+    case kDistanceColumn: {
+      if (!matched)
+        break;
+      double distance = cursor->neighbours[cursor->position].first;
+      sqlite3_result_double(context,
+          (table->metric == sqlite3mex::kVectorDot) ? -distance : distance);
+      break;
+    }
+    case kKColumn: {
+      if (matched)
+        sqlite3_result_int(context, cursor->k);
+      break;
+    }
+    case kProbesColumn: {
+      if (matched)
+        sqlite3_result_int(context, cursor->probes);
+      break;
+    }
+  }
+  return SQLITE_OK;
+}
+
+int annUpdate(sqlite3_vtab* vtab, int argc, sqlite3_value** argv,
+              sqlite3_int64* rowid) {
+  AnnTable* table = static_cast<AnnTable*>(vtab);
+  int code;
+  if (argc == 1) {
+    code = executeFormat(table->database,
+        "DELETE FROM \"%w\".\"%w_vectors\" WHERE id = %lld",
+        table->schema.c_str(), table->name.c_str(),
+        sqlite3_value_int64(argv[0]));
+    if (code != SQLITE_OK)
+      setError(table, sqlite3_errmsg(table->database));
+    return code;
+  }
+  sqlite3_value* vector = argv[2 + kVectorColumn];
+  if (sqlite3_value_type(vector) != SQLITE_BLOB ||
+      static_cast<size_t>(sqlite3_value_bytes(vector)) !=
+          table->dimension * table->element_size) {
+    setError(table, "ann: vector size mismatch");
+    return SQLITE_CONSTRAINT;
+  }
+  code = loadCentroids(table);
+  if (code != SQLITE_OK)
+    return code;
+  int list = findNearestList(*table, sqlite3_value_blob(vector));
+  if (sqlite3_value_type(argv[0]) != SQLITE_NULL) {
+    code = executeFormat(table->database,
+        "DELETE FROM \"%w\".\"%w_vectors\" WHERE id = %lld",
+        table->schema.c_str(), table->name.c_str(),
+        sqlite3_value_int64(argv[0]));
+    if (code != SQLITE_OK) {
+      setError(table, sqlite3_errmsg(table->database));
+      return code;
+    }
+  }
+  if (!table->insert_statement) {
+    code = prepareFormat(table->database, &table->insert_statement,
+        "INSERT INTO \"%w\".\"%w_vectors\"(id, list, vector) VALUES (?, ?, ?)",
+        table->schema.c_str(), table->name.c_str());
+    if (code != SQLITE_OK)
+      return code;
+  }
+  sqlite3_stmt* statement = table->insert_statement;
+  sqlite3_bind_value(statement, 1, argv[1]);
+  sqlite3_bind_int(statement, 2, list);
+  sqlite3_bind_value(statement, 3, vector);
+  code = sqlite3_step(statement);
+  sqlite3_reset(statement);
+  if (code != SQLITE_DONE) {
+    setError(table, sqlite3_errmsg(table->database));
+    return code;
+  }
+  *rowid = sqlite3_last_insert_rowid(table->database);
+  if (list != kUnassignedList)
+    return SQLITE_OK;
+  if (table->unassigned_count >= 0)
+    ++table->unassigned_count;
+  code = trainIfReady(table);
+  if (code != SQLITE_OK)
+    setError(table, sqlite3_errmsg(table->database));
+  return code;
+}
+
+int annBegin(sqlite3_vtab*) {
+  return SQLITE_OK;
+}
+
+// Invalidate cached state on rollback.
+int annRollback(sqlite3_vtab* vtab) {
+  AnnTable* table = static_cast<AnnTable*>(vtab);
+  table->centroids.clear();
+  table->centroids_loaded = false;
+  table->unassigned_count = -1;
+  return SQLITE_OK;
+}
+
+int annRollbackTo(sqlite3_vtab* vtab, int) {
+  return annRollback(vtab);
+}
+
+int annSavepoint(sqlite3_vtab*, int) {
+  return SQLITE_OK;
+}
+
+int annRename(sqlite3_vtab* vtab, const char* name) {
+  AnnTable* table = static_cast<AnnTable*>(vtab);
+  sqlite3_finalize(table->insert_statement);
+  sqlite3_finalize(table->list_statement);
+  sqlite3_finalize(table->vector_statement);
+  table->insert_statement = NULL;
+  table->list_statement = NULL;
+  table->vector_statement = NULL;
+  int code = executeFormat(table->database,
+      "ALTER TABLE \"%w\".\"%w_vectors\" RENAME TO \"%w_vectors\";"
+      "ALTER TABLE \"%w\".\"%w_centroids\" RENAME TO \"%w_centroids\";",
+      table->schema.c_str(), table->name.c_str(), name,
+      table->schema.c_str(), table->name.c_str(), name);
+  if (code == SQLITE_OK)
+    table->name = name;
+  return code;
+}
+
+sqlite3_module kAnnModule = {
+  2,               // iVersion
+  annCreate,       // xCreate
+  annConnect,      // xConnect
+  annBestIndex,    // xBestIndex
+  annDisconnect,   // xDisconnect
+  annDestroy,      // xDestroy
+  annOpen,         // xOpen
+  annClose,        // xClose
+  annFilter,       // xFilter
+  annNext,         // xNext
+  annEof,          // xEof
+  annColumn,       // xColumn
+  annRowid,        // xRowid
+  annUpdate,       // xUpdate
+  annBegin,        // xBegin
+  NULL,            // xSync
+  NULL,            // xCommit
+  annRollback,     // xRollback
+  NULL,            // xFindFunction
+  annRename,       // xRename
+  annSavepoint,    // xSavepoint
+  NULL,            // xRelease
+  annRollbackTo    // xRollbackTo
+};
+
+} // namespace
+
+namespace sqlite3mex {
+
+bool registerAnnModule(sqlite3* database) {
+  return sqlite3_create_module_v2(database, "ann", &kAnnModule, NULL,
+                                  NULL) == SQLITE_OK;
+}
+
+} // namespace sqlite3mex
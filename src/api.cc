@@ -2,9 +2,11 @@
 //
 // Kota Yamaguchi 2012 <kyamagu@cs.stonybrook.edu>
 
+#include <algorithm>
 #include <limits>
 #include <mexplus.h>
 #include <sqlite3mex.h>
+#include <sstream>
 
 using namespace mexplus;
 using namespace sqlite3mex;
@@ -27,13 +29,66 @@ void MxArray::to(const mxArray* cell_array, vector<const mxArray*>* arrays) {
 
 namespace {
 
+// The default connection is the most recently opened one that is still
+// open.
 intptr_t getDefaultId() {
-  intptr_t id = 0;
-  const Session<Database>::InstanceMap& map =
-      Session<Database>::getInstanceMap();
-  if (!map.empty())
-    id = map.rbegin()->first;
-  return id;
+  return Session<Database>::latest();
+}
+
+// Create an int64 column vector of the values.
+mxArray* createInt64Column(const vector<int64_t>& values) {
+  mxArray* array = mxCreateNumericMatrix(values.size(), 1, mxINT64_CLASS,
+                                         mxREAL);
+  if (!values.empty())
+    copy(values.begin(), values.end(),
+         static_cast<int64_t*>(mxGetData(array)));
+  return array;
+}
+
+// Find the connection of the changeset session.
+Database* getSessionDatabase(uint64_t session) {
+  const vector<intptr_t>& ids = Session<Database>::ids();
+  for (size_t i = 0; i < ids.size(); ++i) {
+    Database* database = Session<Database>::get(ids[i]);
+    if (database->hasSession(session))
+      return database;
+  }
+  mexErrMsgIdAndTxt("sqlite3:session", "Invalid session %llu.",
+                    static_cast<unsigned long long>(session));
+  return NULL;
+}
+
+// Connections opened by sqlite3.connect in this process, keyed by the
+// descriptor, so that a worker opens each database once.
+map<string, intptr_t> connection_registry;
+
+// URI of the file opened as immutable. Characters with a meaning in URIs are
+// escaped, and Windows drive paths get the leading slash.
+string immutableURI(const string& filename) {
+  string uri("file:");
+  if (filename.size() > 1 && filename[1] == ':')
+    uri += '/';
+  for (size_t i = 0; i < filename.size(); ++i) {
+    char c = filename[i];
+    if (c == '%' || c == '?' || c == '#') {
+      char escaped[4];
+      snprintf(escaped, sizeof(escaped), "%%%02X", c);
+      uri += escaped;
+    }
+    else
+      uri += (c == '\\') ? '/' : c;
+  }
+  return uri + "?immutable=1";
+}
+
+// Get the 'Delimiter' option of CSV operations. '\t' is a tab.
+char getDelimiter(const InputArguments& input) {
+  string delimiter(input.get<string>("Delimiter", ","));
+  if (delimiter == "\\t")
+    delimiter = "\t";
+  if (delimiter.size() != 1 || delimiter[0] == '"' || delimiter[0] == '\n')
+    ERROR("Delimiter must be a character other than quote and newline.");
+  return delimiter[0];
 }
 
 MEX_DEFINE(open) (int nlhs, mxArray* plhs[],
@@ -58,6 +113,52 @@ MEX_DEFINE(open) (int nlhs, mxArray* plhs[],
   output.set(0, Session<Database>::create(database.release()));
 }
 
+MEX_DEFINE(connect) (int nlhs, mxArray* plhs[],
+                     int nrhs, const mxArray* prhs[]) {
+  InputArguments input(nrhs, prhs, 2, 9, "ReadOnly", "ReadWrite", "Create",
+      "NoMutex", "FullMutex", "SharedCache", "PrivateCache", "OpenURI",
+      "Immutable");
+  OutputArguments output(nlhs, plhs, 1);
+  string filename(input.get<string>(0));
+  vector<string> pragmas(input.get<vector<string> >(1));
+  bool immutable = input.get<bool>("Immutable", false);
+  int flags =
+      ((input.get<bool>("ReadOnly", false)) ? SQLITE_OPEN_READONLY : 0) |
+      ((input.get<bool>("ReadWrite", nrhs == 2)) ? SQLITE_OPEN_READWRITE : 0) |
+      ((input.get<bool>("Create", nrhs == 2)) ? SQLITE_OPEN_CREATE : 0) |
+      ((input.get<bool>("NoMutex", false)) ? SQLITE_OPEN_NOMUTEX : 0) |
+      ((input.get<bool>("FullMutex", false)) ? SQLITE_OPEN_FULLMUTEX : 0) |
+      ((input.get<bool>("SharedCache", false)) ? SQLITE_OPEN_SHAREDCACHE : 0) |
+      ((input.get<bool>("PrivateCache", false)) ?
+          SQLITE_OPEN_PRIVATECACHE : 0) |
+      ((input.get<bool>("OpenURI", false)) ? SQLITE_OPEN_URI : 0);
+  if (immutable) {
+    // Immutable files are read only, and never locked or checked for
+    // changes by other processes.
+    flags = (flags & ~(SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE)) |
+            SQLITE_OPEN_READONLY | SQLITE_OPEN_URI;
+    filename = immutableURI(filename);
+  }
+  stringstream key;
+  key << filename << '\0' << flags;
+  for (size_t i = 0; i < pragmas.size(); ++i)
+    key << '\0' << pragmas[i];
+  map<string, intptr_t>::iterator entry = connection_registry.find(key.str());
+  if (entry != connection_registry.end()) {
+    if (Session<Database>::exist(entry->second)) {
+      output.set(0, entry->second);
+      return;
+    }
+    connection_registry.erase(entry);
+  }
+  unique_ptr<Database> database(new Database());
+  if (!database->open(filename, flags) || !database->configure(pragmas))
+    ERROR(database->errorMessage());
+  intptr_t id = Session<Database>::create(database.release());
+  connection_registry[key.str()] = id;
+  output.set(0, id);
+}
+
 MEX_DEFINE(close) (int nlhs, mxArray* plhs[],
                    int nrhs, const mxArray* prhs[]) {
   InputArguments input;
@@ -73,27 +174,205 @@ MEX_DEFINE(close) (int nlhs, mxArray* plhs[],
 
 MEX_DEFINE(execute) (int nlhs, mxArray* plhs[],
                      int nrhs, const mxArray* prhs[]) {
+  // The wrapper always passes (sql, params) or (id, sql, params), so the
+  // arguments are checked directly instead of going through InputArguments;
+  // this is the call that sits in tight logging loops.
+  bool id_given = (nrhs == 3);
+  if ((nrhs != 2 && nrhs != 3) ||
+      !mxIsChar(prhs[id_given]) ||
+      !mxIsCell(prhs[id_given + 1]))
+    mexErrMsgIdAndTxt("mexplus:arguments:error",
+                      "Invalid arguments to execute.");
+  if (nlhs > 1)
+    mexErrMsgIdAndTxt("mexplus:arguments:error",
+                      "Too many output arguments.");
+  intptr_t id = (id_given) ? MxArray::to<intptr_t>(prhs[0]) : getDefaultId();
+  string sql(MxArray::to<string>(prhs[id_given]));
+  vector<const mxArray*> params;
+  MxArray::to<vector<const mxArray*> >(prhs[id_given + 1], &params);
+  Database* database = Session<Database>::get(id);
+  if (!database->execute(sql, params, &plhs[0]))
+    mexErrMsgIdAndTxt(database->errorId(), "%s: %s",
+                      database->errorMessage(), sql.c_str());
+}
+
+MEX_DEFINE(executeScript) (int nlhs, mxArray* plhs[],
+                           int nrhs, const mxArray* prhs[]) {
   InputArguments input;
   input.define("default", 2);
   input.define("id-given", 3);
   input.parse(nrhs, prhs);
   OutputArguments output(nlhs, plhs, 1);
   intptr_t id = 0;
+  string script;
+  vector<const mxArray*> params;
+  if (input.is("default")) {
+    id = getDefaultId();
+    input.get<string>(0, &script);
+    input.get<vector<const mxArray*> >(1, &params);
+  }
+  else {
+    id = input.get<intptr_t>(0);
+    input.get<string>(1, &script);
+    input.get<vector<const mxArray*> >(2, &params);
+  }
+  Database* database = Session<Database>::get(id);
+  if (!database->executeScript(script, params, &plhs[0]))
+    mexErrMsgIdAndTxt(database->errorId(), "%s", database->errorMessage());
+}
+
+MEX_DEFINE(exportColumns) (int nlhs, mxArray* plhs[],
+                           int nrhs, const mxArray* prhs[]) {
+  InputArguments input;
+  input.define("default", 3);
+  input.define("id-given", 4);
+  input.parse(nrhs, prhs);
+  OutputArguments output(nlhs, plhs, 1);
+  intptr_t id = 0;
   string sql;
   vector<const mxArray*> params;
+  string filename;
   if (input.is("default")) {
     id = getDefaultId();
     input.get<string>(0, &sql);
     input.get<vector<const mxArray*> >(1, &params);
+    input.get<string>(2, &filename);
   }
   else {
     id = input.get<intptr_t>(0);
     input.get<string>(1, &sql);
     input.get<vector<const mxArray*> >(2, &params);
+    input.get<string>(3, &filename);
   }
   Database* database = Session<Database>::get(id);
-  if (!database->execute(sql, params, &plhs[0]))
-    ERROR("%s: %s", database->errorMessage(), sql.c_str());
+  uint64_t rows = 0;
+  if (!database->exportColumns(sql, params, filename, &rows))
+    mexErrMsgIdAndTxt(database->errorId(), "%s: %s",
+                      database->errorMessage(), sql.c_str());
+  output.set(0, static_cast<double>(rows));
+}
+
+MEX_DEFINE(exportArrow) (int nlhs, mxArray* plhs[],
+                         int nrhs, const mxArray* prhs[]) {
+  InputArguments input;
+  input.define("default", 3, 2, "BatchSize", "Format");
+  input.define("id-given", 4, 2, "BatchSize", "Format");
+  input.parse(nrhs, prhs);
+  OutputArguments output(nlhs, plhs, 1);
+  bool id_given = input.is("id-given");
+  intptr_t id = (id_given) ? input.get<intptr_t>(0) : getDefaultId();
+  string sql(input.get<string>(id_given));
+  vector<const mxArray*> params;
+  input.get<vector<const mxArray*> >(id_given + 1, &params);
+  string filename(input.get<string>(id_given + 2));
+  ArrowOptions options;
+  options.batch_rows = input.get<int64_t>("BatchSize", options.batch_rows);
+  if (options.batch_rows <= 0)
+    ERROR("BatchSize must be positive.");
+  string format(input.get<string>("Format", "stream"));
+  if (format != "stream" && format != "file")
+    ERROR("Format must be 'stream' or 'file': %s", format.c_str());
+  options.file_format = (format == "file");
+  Database* database = Session<Database>::get(id);
+  uint64_t rows = 0;
+  if (!database->exportArrow(sql, params, filename, options, &rows))
+    mexErrMsgIdAndTxt(database->errorId(), "%s: %s",
+                      database->errorMessage(), sql.c_str());
+  output.set(0, static_cast<double>(rows));
+}
+
+MEX_DEFINE(exportCSV) (int nlhs, mxArray* plhs[],
+                       int nrhs, const mxArray* prhs[]) {
+  InputArguments input;
+  input.define("default", 3, 5, "Delimiter", "Header", "Null", "Quote",
+               "Compression");
+  input.define("id-given", 4, 5, "Delimiter", "Header", "Null", "Quote",
+               "Compression");
+  input.parse(nrhs, prhs);
+  OutputArguments output(nlhs, plhs, 1);
+  bool id_given = input.is("id-given");
+  intptr_t id = (id_given) ? input.get<intptr_t>(0) : getDefaultId();
+  string sql(input.get<string>(id_given));
+  vector<const mxArray*> params;
+  input.get<vector<const mxArray*> >(id_given + 1, &params);
+  string filename(input.get<string>(id_given + 2));
+  CSVOptions options;
+  options.delimiter = getDelimiter(input);
+  options.header = input.get<bool>("Header", options.header);
+  options.null_text = input.get<string>("Null", options.null_text);
+  string quote(input.get<string>("Quote", "minimal"));
+  if (quote == "minimal")
+    options.quote = kCSVQuoteMinimal;
+  else if (quote == "all")
+    options.quote = kCSVQuoteAll;
+  else if (quote == "none")
+    options.quote = kCSVQuoteNone;
+  else
+    ERROR("Quote must be 'minimal', 'all', or 'none': %s", quote.c_str());
+  // Compress by default when the file name ends with .gz.
+  bool gzip_name = filename.size() > 3 &&
+                   filename.compare(filename.size() - 3, 3, ".gz") == 0;
+  string compression(input.get<string>("Compression",
+                                       (gzip_name) ? "gzip" : "none"));
+  if (compression != "none" && compression != "gzip")
+    ERROR("Compression must be 'none' or 'gzip': %s", compression.c_str());
+  options.gzip = (compression == "gzip");
+  Database* database = Session<Database>::get(id);
+  uint64_t rows = 0;
+  if (!database->exportCSV(sql, params, filename, options, &rows))
+    mexErrMsgIdAndTxt(database->errorId(), "%s: %s",
+                      database->errorMessage(), sql.c_str());
+  output.set(0, static_cast<double>(rows));
+}
+
+MEX_DEFINE(importCSV) (int nlhs, mxArray* plhs[],
+                       int nrhs, const mxArray* prhs[]) {
+  InputArguments input;
+  input.define("default", 2, 5, "Delimiter", "Header", "Threads",
+               "SampleRows", "BatchSize");
+  input.define("id-given", 3, 5, "Delimiter", "Header", "Threads",
+               "SampleRows", "BatchSize");
+  input.parse(nrhs, prhs);
+  OutputArguments output(nlhs, plhs, 1);
+  bool id_given = input.is("id-given");
+  intptr_t id = (id_given) ? input.get<intptr_t>(0) : getDefaultId();
+  string table(input.get<string>(id_given));
+  string filename(input.get<string>(id_given + 1));
+  CSVOptions options;
+  options.delimiter = getDelimiter(input);
+  options.header = input.get<bool>("Header", options.header);
+  options.threads = input.get<int>("Threads", options.threads);
+  options.sample_rows = input.get<int64_t>("SampleRows",
+                                           options.sample_rows);
+  options.batch_rows = input.get<int64_t>("BatchSize", options.batch_rows);
+  if (options.threads < 0 || options.sample_rows < 0 ||
+      options.batch_rows < 0)
+    ERROR("Threads, SampleRows, and BatchSize must be non-negative.");
+  Database* database = Session<Database>::get(id);
+  uint64_t rows = 0;
+  if (!database->importCSV(table, filename, options, &rows))
+    mexErrMsgIdAndTxt(database->errorId(), "%s: %s",
+                      database->errorMessage(), filename.c_str());
+  output.set(0, static_cast<double>(rows));
+}
+
+MEX_DEFINE(insert) (int nlhs, mxArray* plhs[],
+                    int nrhs, const mxArray* prhs[]) {
+  InputArguments input;
+  input.define("default", 2, 1, "Columns");
+  input.define("id-given", 3, 1, "Columns");
+  input.parse(nrhs, prhs);
+  OutputArguments output(nlhs, plhs, 1);
+  bool id_given = input.is("id-given");
+  intptr_t id = (id_given) ? input.get<intptr_t>(0) : getDefaultId();
+  string table(input.get<string>(id_given));
+  Database* database = Session<Database>::get(id);
+  uint64_t rows = 0;
+  if (!database->insert(table, input.get(id_given + 1),
+                        input.get<bool>("Columns", false), &rows))
+    mexErrMsgIdAndTxt(database->errorId(), "%s: %s",
+                      database->errorMessage(), table.c_str());
+  output.set(0, static_cast<double>(rows));
 }
 
 MEX_DEFINE(timeout) (int nlhs, mxArray* plhs[],
@@ -118,6 +397,434 @@ MEX_DEFINE(timeout) (int nlhs, mxArray* plhs[],
     ERROR("Failed to set timeout.");
 }
 
+MEX_DEFINE(busyHandler) (int nlhs, mxArray* plhs[],
+                         int nrhs, const mxArray* prhs[]) {
+  InputArguments input;
+  input.define("default", 0, 4, "InitialDelay", "MaxDelay", "MaxWait",
+               "Jitter");
+  input.define("id-given", 1, 4, "InitialDelay", "MaxDelay", "MaxWait",
+               "Jitter");
+  input.parse(nrhs, prhs);
+  OutputArguments output(nlhs, plhs, 0);
+  intptr_t id = (input.is("id-given")) ?
+      input.get<intptr_t>(0) : getDefaultId();
+  BusyPolicy policy;
+  policy.initial_delay = input.get<double>("InitialDelay",
+                                           policy.initial_delay);
+  policy.max_delay = input.get<double>("MaxDelay", policy.max_delay);
+  policy.max_wait = input.get<double>("MaxWait", policy.max_wait);
+  policy.jitter = input.get<double>("Jitter", policy.jitter);
+  Database* database = Session<Database>::get(id);
+  if (!database->setBusyHandler(policy))
+    ERROR("%s", database->errorMessage());
+}
+
+MEX_DEFINE(busyStats) (int nlhs, mxArray* plhs[],
+                       int nrhs, const mxArray* prhs[]) {
+  InputArguments input;
+  input.define("default", 0, 1, "Reset");
+  input.define("id-given", 1, 1, "Reset");
+  input.parse(nrhs, prhs);
+  OutputArguments output(nlhs, plhs, 1);
+  intptr_t id = (input.is("id-given")) ?
+      input.get<intptr_t>(0) : getDefaultId();
+  Database* database = Session<Database>::get(id);
+  BusyStats stats = database->busyStats(input.get<bool>("Reset", false));
+  const char* fields[] = {"Events", "Retries", "Failures", "WaitTime",
+                          "LongestWait"};
+  MxArray result(MxArray::Struct(5, fields));
+  result.set("Events", static_cast<double>(stats.events));
+  result.set("Retries", static_cast<double>(stats.retries));
+  result.set("Failures", static_cast<double>(stats.failures));
+  result.set("WaitTime", stats.wait_seconds);
+  result.set("LongestWait", stats.longest_seconds);
+  output.set(0, result.release());
+}
+
+MEX_DEFINE(begin) (int nlhs, mxArray* plhs[],
+                   int nrhs, const mxArray* prhs[]) {
+  InputArguments input;
+  input.define("default", 1);
+  input.define("id-given", 2);
+  input.parse(nrhs, prhs);
+  OutputArguments output(nlhs, plhs, 0);
+  intptr_t id = (input.is("id-given")) ?
+      input.get<intptr_t>(0) : getDefaultId();
+  string mode = input.get<string>((input.is("id-given")) ? 1 : 0);
+  Database* database = Session<Database>::get(id);
+  if (!database->begin(mode))
+    ERROR("%s", database->errorMessage());
+}
+
+MEX_DEFINE(commit) (int nlhs, mxArray* plhs[],
+                    int nrhs, const mxArray* prhs[]) {
+  InputArguments input;
+  input.define("default", 0);
+  input.define("id-given", 1);
+  input.parse(nrhs, prhs);
+  OutputArguments output(nlhs, plhs, 0);
+  intptr_t id = (input.is("id-given")) ?
+      input.get<intptr_t>(0) : getDefaultId();
+  Database* database = Session<Database>::get(id);
+  if (!database->commit())
+    ERROR("%s", database->errorMessage());
+}
+
+MEX_DEFINE(rollback) (int nlhs, mxArray* plhs[],
+                      int nrhs, const mxArray* prhs[]) {
+  InputArguments input;
+  input.define("default", 1);
+  input.define("id-given", 2);
+  input.parse(nrhs, prhs);
+  OutputArguments output(nlhs, plhs, 0);
+  intptr_t id = (input.is("id-given")) ?
+      input.get<intptr_t>(0) : getDefaultId();
+  string name = input.get<string>((input.is("id-given")) ? 1 : 0);
+  Database* database = Session<Database>::get(id);
+  if (!((name.empty()) ? database->rollback() : database->rollbackTo(name)))
+    ERROR("%s", database->errorMessage());
+}
+
+MEX_DEFINE(savepoint) (int nlhs, mxArray* plhs[],
+                       int nrhs, const mxArray* prhs[]) {
+  InputArguments input;
+  input.define("default", 1);
+  input.define("id-given", 2);
+  input.parse(nrhs, prhs);
+  OutputArguments output(nlhs, plhs, 0);
+  intptr_t id = (input.is("id-given")) ?
+      input.get<intptr_t>(0) : getDefaultId();
+  string name = input.get<string>((input.is("id-given")) ? 1 : 0);
+  Database* database = Session<Database>::get(id);
+  if (!database->savepoint(name))
+    ERROR("%s", database->errorMessage());
+}
+
+MEX_DEFINE(release) (int nlhs, mxArray* plhs[],
+                     int nrhs, const mxArray* prhs[]) {
+  InputArguments input;
+  input.define("default", 1);
+  input.define("id-given", 2);
+  input.parse(nrhs, prhs);
+  OutputArguments output(nlhs, plhs, 0);
+  intptr_t id = (input.is("id-given")) ?
+      input.get<intptr_t>(0) : getDefaultId();
+  string name = input.get<string>((input.is("id-given")) ? 1 : 0);
+  Database* database = Session<Database>::get(id);
+  if (!database->release(name))
+    ERROR("%s", database->errorMessage());
+}
+
+MEX_DEFINE(groupCommit) (int nlhs, mxArray* plhs[],
+                         int nrhs, const mxArray* prhs[]) {
+  InputArguments input;
+  input.define("default", 2);
+  input.define("id-given", 3);
+  input.parse(nrhs, prhs);
+  OutputArguments output(nlhs, plhs, 0);
+  intptr_t id = 0;
+  int rows = 0;
+  int milliseconds = 0;
+  if (input.is("default")) {
+    id = getDefaultId();
+    rows = input.get<int>(0);
+    milliseconds = input.get<int>(1);
+  }
+  else {
+    id = input.get<intptr_t>(0);
+    rows = input.get<int>(1);
+    milliseconds = input.get<int>(2);
+  }
+  Database* database = Session<Database>::get(id);
+  if (!database->groupCommit(rows, milliseconds))
+    ERROR("%s", database->errorMessage());
+}
+
+MEX_DEFINE(autoCheckpoint) (int nlhs, mxArray* plhs[],
+                            int nrhs, const mxArray* prhs[]) {
+  InputArguments input;
+  input.define("default", 0, 3, "Interval", "MaxWalSize", "VacuumPages");
+  input.define("id-given", 1, 3, "Interval", "MaxWalSize", "VacuumPages");
+  input.parse(nrhs, prhs);
+  OutputArguments output(nlhs, plhs, 0);
+  intptr_t id = (input.is("id-given")) ?
+      input.get<intptr_t>(0) : getDefaultId();
+  CheckpointPolicy policy;
+  policy.interval = input.get<int>("Interval", policy.interval);
+  policy.max_wal_size = input.get<int64_t>("MaxWalSize",
+                                           policy.max_wal_size);
+  policy.vacuum_pages = input.get<int>("VacuumPages", policy.vacuum_pages);
+  Database* database = Session<Database>::get(id);
+  if (!database->autoCheckpoint(policy))
+    ERROR("%s", database->errorMessage());
+}
+
+MEX_DEFINE(checkpointStats) (int nlhs, mxArray* plhs[],
+                             int nrhs, const mxArray* prhs[]) {
+  InputArguments input;
+  input.define("default", 0, 1, "Reset");
+  input.define("id-given", 1, 1, "Reset");
+  input.parse(nrhs, prhs);
+  OutputArguments output(nlhs, plhs, 1);
+  intptr_t id = (input.is("id-given")) ?
+      input.get<intptr_t>(0) : getDefaultId();
+  Database* database = Session<Database>::get(id);
+  CheckpointStats stats = database->checkpointStats(
+      input.get<bool>("Reset", false));
+  const char* fields[] = {"Checkpoints", "Truncates", "Busy", "VacuumedPages",
+                          "WalSize", "MaxWalSize", "LastDuration",
+                          "LongestDuration", "TotalDuration"};
+  MxArray result(MxArray::Struct(9, fields));
+  result.set("Checkpoints", static_cast<double>(stats.checkpoints));
+  result.set("Truncates", static_cast<double>(stats.truncates));
+  result.set("Busy", static_cast<double>(stats.busy));
+  result.set("VacuumedPages", static_cast<double>(stats.vacuumed_pages));
+  result.set("WalSize", static_cast<double>(stats.wal_size));
+  result.set("MaxWalSize", static_cast<double>(stats.max_wal_size));
+  result.set("LastDuration", stats.last_seconds);
+  result.set("LongestDuration", stats.longest_seconds);
+  result.set("TotalDuration", stats.total_seconds);
+  output.set(0, result.release());
+}
+
+MEX_DEFINE(warm) (int nlhs, mxArray* plhs[],
+                  int nrhs, const mxArray* prhs[]) {
+  InputArguments input;
+  input.define("default", 1, 2, "Mode", "Wait");
+  input.define("id-given", 2, 2, "Mode", "Wait");
+  input.parse(nrhs, prhs);
+  OutputArguments output(nlhs, plhs, 0);
+  bool id_given = input.is("id-given");
+  intptr_t id = (id_given) ? input.get<intptr_t>(0) : getDefaultId();
+  vector<string> tables(input.get<vector<string> >(id_given));
+  string mode(input.get<string>("Mode", "os"));
+  if (mode != "os" && mode != "pagecache")
+    ERROR("Mode must be 'os' or 'pagecache': %s", mode.c_str());
+  Database* database = Session<Database>::get(id);
+  if (!database->warm(tables, mode == "pagecache",
+                      input.get<bool>("Wait", false)))
+    ERROR("%s", database->errorMessage());
+}
+
+MEX_DEFINE(bulkLoadBegin) (int nlhs, mxArray* plhs[],
+                           int nrhs, const mxArray* prhs[]) {
+  InputArguments input;
+  input.define("default", 1, 1, "CacheSize");
+  input.define("id-given", 2, 1, "CacheSize");
+  input.parse(nrhs, prhs);
+  OutputArguments output(nlhs, plhs, 0);
+  bool id_given = input.is("id-given");
+  intptr_t id = (id_given) ? input.get<intptr_t>(0) : getDefaultId();
+  vector<string> tables(input.get<vector<string> >(id_given));
+  int64_t cache_bytes = input.get<int64_t>("CacheSize", 1LL << 30);
+  if (cache_bytes < 0)
+    ERROR("CacheSize must be non-negative.");
+  Database* database = Session<Database>::get(id);
+  if (!database->beginBulkLoad(tables, cache_bytes))
+    ERROR("%s", database->errorMessage());
+}
+
+MEX_DEFINE(bulkLoadEnd) (int nlhs, mxArray* plhs[],
+                         int nrhs, const mxArray* prhs[]) {
+  InputArguments input;
+  input.define("default", 0);
+  input.define("id-given", 1);
+  input.parse(nrhs, prhs);
+  OutputArguments output(nlhs, plhs, 0);
+  intptr_t id = (input.is("id-given")) ?
+      input.get<intptr_t>(0) : getDefaultId();
+  Database* database = Session<Database>::get(id);
+  if (!database->endBulkLoad())
+    ERROR("%s", database->errorMessage());
+}
+
+MEX_DEFINE(limits) (int nlhs, mxArray* plhs[],
+                    int nrhs, const mxArray* prhs[]) {
+  InputArguments input;
+  input.define("default", 0, 4, "MaxRows", "MaxBytes", "Deadline",
+               "SoftHeapLimit");
+  input.define("id-given", 1, 4, "MaxRows", "MaxBytes", "Deadline",
+               "SoftHeapLimit");
+  input.parse(nrhs, prhs);
+  OutputArguments output(nlhs, plhs, 1);
+  intptr_t id = (input.is("id-given")) ?
+      input.get<intptr_t>(0) : getDefaultId();
+  Database* database = Session<Database>::get(id);
+  QueryLimits limits = database->limits();
+  limits.max_rows = input.get<int64_t>("MaxRows", limits.max_rows);
+  limits.max_bytes = input.get<int64_t>("MaxBytes", limits.max_bytes);
+  limits.deadline = input.get<double>("Deadline", limits.deadline);
+  if (limits.max_rows < 0 || limits.max_bytes < 0 || limits.deadline < 0)
+    ERROR("Limits must be non-negative.");
+  database->setLimits(limits);
+  // The soft heap limit is shared by all connections in the process.
+  int64_t soft_heap_limit = input.get<int64_t>("SoftHeapLimit", -1);
+  if (soft_heap_limit >= 0)
+    sqlite3_soft_heap_limit64(soft_heap_limit);
+  const char* fields[] = {"MaxRows", "MaxBytes", "Deadline", "SoftHeapLimit"};
+  MxArray result(MxArray::Struct(4, fields));
+  result.set("MaxRows", static_cast<double>(limits.max_rows));
+  result.set("MaxBytes", static_cast<double>(limits.max_bytes));
+  result.set("Deadline", limits.deadline);
+  result.set("SoftHeapLimit",
+             static_cast<double>(sqlite3_soft_heap_limit64(-1)));
+  output.set(0, result.release());
+}
+
+MEX_DEFINE(resultCache) (int nlhs, mxArray* plhs[],
+                         int nrhs, const mxArray* prhs[]) {
+  InputArguments input;
+  input.define("default", 0, 2, "Capacity", "Clear");
+  input.define("id-given", 1, 2, "Capacity", "Clear");
+  input.parse(nrhs, prhs);
+  OutputArguments output(nlhs, plhs, 1);
+  intptr_t id = (input.is("id-given")) ?
+      input.get<intptr_t>(0) : getDefaultId();
+  Database* database = Session<Database>::get(id);
+  int64_t capacity = input.get<int64_t>("Capacity", -1);
+  if (capacity >= 0)
+    database->setResultCacheCapacity(capacity);
+  if (input.get<bool>("Clear", false))
+    database->clearResultCache();
+  ResultCacheStats stats = database->resultCacheStats();
+  const char* fields[] = {"Capacity", "Bytes", "Entries", "Hits", "Misses",
+                          "Evictions", "HitRate"};
+  MxArray result(MxArray::Struct(7, fields));
+  result.set("Capacity", static_cast<double>(stats.capacity));
+  result.set("Bytes", static_cast<double>(stats.bytes));
+  result.set("Entries", static_cast<double>(stats.entries));
+  result.set("Hits", static_cast<double>(stats.hits));
+  result.set("Misses", static_cast<double>(stats.misses));
+  result.set("Evictions", static_cast<double>(stats.evictions));
+  result.set("HitRate", (stats.hits + stats.misses > 0) ?
+      static_cast<double>(stats.hits) / (stats.hits + stats.misses) : 0.0);
+  output.set(0, result.release());
+}
+
+MEX_DEFINE(trackChanges) (int nlhs, mxArray* plhs[],
+                          int nrhs, const mxArray* prhs[]) {
+  InputArguments input;
+  input.define("default", 0, 1, "Capacity");
+  input.define("id-given", 1, 1, "Capacity");
+  input.parse(nrhs, prhs);
+  OutputArguments output(nlhs, plhs, 1);
+  intptr_t id = (input.is("id-given")) ?
+      input.get<intptr_t>(0) : getDefaultId();
+  int64_t capacity = input.get<int64_t>("Capacity", 100000);
+  if (capacity < 0)
+    ERROR("Capacity must be non-negative.");
+  Database* database = Session<Database>::get(id);
+  uint64_t token = 0;
+  database->trackChanges(capacity, &token);
+  output.set(0, static_cast<double>(token));
+}
+
+MEX_DEFINE(changesSince) (int nlhs, mxArray* plhs[],
+                          int nrhs, const mxArray* prhs[]) {
+  InputArguments input;
+  input.define("default", 1);
+  input.define("id-given", 2);
+  input.parse(nrhs, prhs);
+  OutputArguments output(nlhs, plhs, 1);
+  bool id_given = input.is("id-given");
+  intptr_t id = (id_given) ? input.get<intptr_t>(0) : getDefaultId();
+  double since = input.get<double>(id_given);
+  if (since < 0)
+    ERROR("Token must be non-negative.");
+  Database* database = Session<Database>::get(id);
+  vector<TableChanges> changes;
+  bool overflow = false;
+  uint64_t token = 0;
+  database->changesSince(since, &changes, &overflow, &token);
+  const char* table_fields[] = {"Table", "Inserted", "Updated", "Deleted"};
+  mxArray* tables = mxCreateStructMatrix(changes.size(), 1, 4, table_fields);
+  for (size_t i = 0; i < changes.size(); ++i) {
+    mxSetFieldByNumber(tables, i, 0,
+                       mxCreateString(changes[i].table.c_str()));
+    mxSetFieldByNumber(tables, i, 1, createInt64Column(changes[i].inserted));
+    mxSetFieldByNumber(tables, i, 2, createInt64Column(changes[i].updated));
+    mxSetFieldByNumber(tables, i, 3, createInt64Column(changes[i].deleted));
+  }
+  const char* fields[] = {"Token", "Overflow", "Tables"};
+  mxArray* result = mxCreateStructMatrix(1, 1, 3, fields);
+  mxSetFieldByNumber(result, 0, 0,
+                     mxCreateDoubleScalar(static_cast<double>(token)));
+  mxSetFieldByNumber(result, 0, 1, mxCreateLogicalScalar(overflow));
+  mxSetFieldByNumber(result, 0, 2, tables);
+  output.set(0, result);
+}
+
+MEX_DEFINE(sessionStart) (int nlhs, mxArray* plhs[],
+                          int nrhs, const mxArray* prhs[]) {
+  InputArguments input;
+  input.define("default", 1);
+  input.define("id-given", 2);
+  input.parse(nrhs, prhs);
+  OutputArguments output(nlhs, plhs, 1);
+  bool id_given = input.is("id-given");
+  intptr_t id = (id_given) ? input.get<intptr_t>(0) : getDefaultId();
+  vector<string> tables(input.get<vector<string> >(id_given));
+  Database* database = Session<Database>::get(id);
+  uint64_t session = 0;
+  if (!database->startSession(tables, &session))
+    mexErrMsgIdAndTxt(database->errorId(), "%s", database->errorMessage());
+  output.set(0, static_cast<double>(session));
+}
+
+MEX_DEFINE(changeset) (int nlhs, mxArray* plhs[],
+                       int nrhs, const mxArray* prhs[]) {
+  InputArguments input(nrhs, prhs, 1, 1, "Patchset");
+  OutputArguments output(nlhs, plhs, 1);
+  Database* database = getSessionDatabase(input.get<uint64_t>(0));
+  string changeset;
+  if (!database->changeset(input.get<uint64_t>(0),
+                           input.get<bool>("Patchset", false), &changeset))
+    mexErrMsgIdAndTxt(database->errorId(), "%s", database->errorMessage());
+  mxArray* bytes = mxCreateNumericMatrix(1, changeset.size(), mxUINT8_CLASS,
+                                         mxREAL);
+  copy(changeset.begin(), changeset.end(),
+       static_cast<char*>(mxGetData(bytes)));
+  output.set(0, bytes);
+}
+
+MEX_DEFINE(sessionEnd) (int nlhs, mxArray* plhs[],
+                        int nrhs, const mxArray* prhs[]) {
+  InputArguments input(nrhs, prhs, 1);
+  OutputArguments output(nlhs, plhs, 0);
+  uint64_t session = input.get<uint64_t>(0);
+  getSessionDatabase(session)->endSession(session);
+}
+
+MEX_DEFINE(applyChangeset) (int nlhs, mxArray* plhs[],
+                            int nrhs, const mxArray* prhs[]) {
+  InputArguments input;
+  input.define("default", 2);
+  input.define("id-given", 3);
+  input.parse(nrhs, prhs);
+  OutputArguments output(nlhs, plhs, 1);
+  bool id_given = input.is("id-given");
+  intptr_t id = (id_given) ? input.get<intptr_t>(0) : getDefaultId();
+  const mxArray* bytes = input.get(id_given);
+  if (!mxIsUint8(bytes))
+    ERROR("Changeset must be a uint8 array.");
+  string changeset(static_cast<const char*>(mxGetData(bytes)),
+                   mxGetNumberOfElements(bytes));
+  string policy_name(input.get<string>(id_given + 1));
+  ConflictPolicy policy = kConflictAbort;
+  if (policy_name == "omit")
+    policy = kConflictOmit;
+  else if (policy_name == "replace")
+    policy = kConflictReplace;
+  else if (policy_name != "abort")
+    ERROR("Conflict policy must be 'abort', 'omit', or 'replace': %s",
+          policy_name.c_str());
+  Database* database = Session<Database>::get(id);
+  int conflicts = 0;
+  if (!database->applyChangeset(changeset, policy, &conflicts))
+    mexErrMsgIdAndTxt(database->errorId(), "%s", database->errorMessage());
+  output.set(0, static_cast<double>(conflicts));
+}
+
 } // namespace
 
 MEX_DISPATCH
@@ -0,0 +1,443 @@
+// SQLite3 matlab driver Arrow IPC writer.
+//
+// Query results are written in the Apache Arrow IPC stream or file format
+// without the Arrow library. Metadata is a flatbuffer built by the small
+// builder below, and record batches are written from the staged columns of
+// the query, so memory use is bounded by the batch size.
+//
+// Stream format:
+//   For each message, 8-byte aligned:
+//     int32    continuation, -1
+//     int32    bytes of the metadata and its padding
+//     Message  flatbuffer, zero-padded to an 8-byte boundary
+//     body     buffers of the record batch, each 8-byte aligned
+//   Messages are the schema followed by record batches, and the stream ends
+//   with the continuation and a zero length.
+// File format:
+//   "ARROW1" and 2 zero bytes, the stream, the Footer flatbuffer with the
+//   schema and the blocks of the record batches, int32 bytes of the footer,
+//   and "ARROW1".
+//
+// Columns are Int64 for integer, Float64 for float, Utf8 for text, and
+// Binary for blob. The type of a column follows its declared type, or the
+// first non-null value of the first batch, and falls back to Utf8 when the
+// first batch has no value. Other values are converted by the sqlite rules.
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <sqlite3mex.h>
+
+namespace {
+
+using sqlite3mex::Column;
+using sqlite3mex::Datum;
+
+// Magic bytes of the Arrow file.
+const char kArrowMagic[8] = {'A', 'R', 'R', 'O', 'W', '1', 0, 0};
+// MetadataVersion.V5 of the schema.
+const int16_t kArrowMetadataVersion = 4;
+// MessageHeader union types.
+const uint8_t kArrowSchemaHeader = 1;
+const uint8_t kArrowRecordBatchHeader = 3;
+// Type union types.
+const uint8_t kArrowInt = 2;
+const uint8_t kArrowFloatingPoint = 3;
+const uint8_t kArrowBinary = 4;
+const uint8_t kArrowUtf8 = 5;
+// Precision.DOUBLE of FloatingPoint.
+const int16_t kArrowDouble = 2;
+// Buffer size of the output.
+const size_t kArrowBufferSize = 1 << 20;
+
+// Minimal flatbuffer builder. As in the flatbuffers library, the buffer is
+// built back to front so that references to the objects created earlier
+// point forward, and a reference is the offset of the object from the end
+// of the buffer. Arrow metadata is small, so bytes are simply inserted at
+// the front.
+class FlatBuilder {
+public:
+  typedef uint32_t Ref;
+
+  FlatBuilder() : min_align_(1) {}
+
+  // Add a string.
+  Ref createString(const string& value) {
+    align(value.size() + 1 + sizeof(uint32_t), sizeof(uint32_t));
+    prepend(value.c_str(), value.size() + 1);
+    uint32_t length = value.size();
+    prepend(&length, sizeof(length));
+    return size();
+  }
+  // Add a vector of structs of the given size in bytes.
+  Ref createStructs(const void* data, size_t count, size_t struct_size) {
+    align(count * struct_size, 8);
+    prepend(data, count * struct_size);
+    uint32_t length = count;
+    prepend(&length, sizeof(length));
+    return size();
+  }
+  // Add a vector of tables or strings.
+  Ref createVector(const vector<Ref>& refs) {
+    align(refs.size() * sizeof(uint32_t), sizeof(uint32_t));
+    for (size_t i = refs.size(); i > 0; --i)
+      prependRef(refs[i - 1]);
+    uint32_t length = refs.size();
+    prepend(&length, sizeof(length));
+    return size();
+  }
+  // Start a table.
+  void startTable() {
+    fields_.clear();
+    table_start_ = size();
+  }
+  // Add a scalar field to the table.
+  template <typename T>
+  void addScalar(int field, T value) {
+    align(sizeof(T), sizeof(T));
+    prepend(&value, sizeof(T));
+    fields_.push_back(make_pair(field, size()));
+  }
+  // Add a reference field to the table.
+  void addRef(int field, Ref ref) {
+    align(sizeof(uint32_t), sizeof(uint32_t));
+    prependRef(ref);
+    fields_.push_back(make_pair(field, size()));
+  }
+  // Finish the table with its vtable in front of it.
+  Ref endTable() {
+    align(sizeof(int32_t), sizeof(int32_t));
+    int32_t placeholder = 0;
+    prepend(&placeholder, sizeof(placeholder));
+    Ref table = size();
+    int num_fields = 0;
+    for (size_t i = 0; i < fields_.size(); ++i)
+      num_fields = max(num_fields, fields_[i].first + 1);
+    vector<uint16_t> vtable(2 + num_fields, 0);
+    vtable[0] = vtable.size() * sizeof(uint16_t);
+    vtable[1] = table - table_start_;
+    for (size_t i = 0; i < fields_.size(); ++i)
+      vtable[2 + fields_[i].first] = table - fields_[i].second;
+    prepend(vtable.data(), vtable.size() * sizeof(uint16_t));
+    // The vtable is at table - offset.
+    int32_t offset = size() - table;
+    memcpy(&bytes_[size() - table], &offset, sizeof(offset));
+    return table;
+  }
+  // Finish the buffer with the root table.
+  string finish(Ref root) {
+    align(sizeof(uint32_t), max(min_align_, sizeof(uint32_t)));
+    prependRef(root);
+    return bytes_;
+  }
+
+private:
+  size_t size() const { return bytes_.size(); }
+  // Pad so that the next bytes end at the alignment.
+  void align(size_t bytes, size_t alignment) {
+    min_align_ = max(min_align_, alignment);
+    bytes_.insert(0, (alignment - (size() + bytes) % alignment) % alignment,
+                  '\0');
+  }
+  void prepend(const void* data, size_t bytes) {
+    if (bytes)
+      bytes_.insert(0, static_cast<const char*>(data), bytes);
+  }
+  // References are relative to where they are stored.
+  void prependRef(Ref ref) {
+    uint32_t offset = size() + sizeof(uint32_t) - ref;
+    prepend(&offset, sizeof(offset));
+  }
+
+  string bytes_;
+  size_t min_align_;
+  Ref table_start_;
+  vector<pair<int, Ref> > fields_;
+};
+
+// Add the type table of the column type.
+FlatBuilder::Ref addType(FlatBuilder* builder, int type) {
+  builder->startTable();
+  if (type == SQLITE_INTEGER) {
+    builder->addScalar<int32_t>(0, 64);    // bitWidth
+    builder->addScalar<uint8_t>(1, 1);     // is_signed
+  }
+  else if (type == SQLITE_FLOAT)
+    builder->addScalar<int16_t>(0, kArrowDouble);  // precision
+  return builder->endTable();
+}
+
+// Type union type of the column type.
+uint8_t arrowType(int type) {
+  switch (type) {
+    case SQLITE_INTEGER: return kArrowInt;
+    case SQLITE_FLOAT: return kArrowFloatingPoint;
+    case SQLITE_BLOB: return kArrowBinary;
+  }
+  return kArrowUtf8;
+}
+
+// Add the Schema table of the columns.
+FlatBuilder::Ref addSchema(FlatBuilder* builder,
+                           const vector<string>& names,
+                           const vector<int>& types) {
+  vector<FlatBuilder::Ref> fields;
+  for (size_t i = 0; i < names.size(); ++i) {
+    FlatBuilder::Ref name = builder->createString(names[i]);
+    FlatBuilder::Ref type = addType(builder, types[i]);
+    FlatBuilder::Ref children = builder->createVector(
+        vector<FlatBuilder::Ref>());
+    builder->startTable();
+    builder->addRef(0, name);
+    builder->addScalar<uint8_t>(1, 1);                 // nullable
+    builder->addScalar<uint8_t>(2, arrowType(types[i]));
+    builder->addRef(3, type);
+    builder->addRef(5, children);
+    fields.push_back(builder->endTable());
+  }
+  FlatBuilder::Ref field_vector = builder->createVector(fields);
+  builder->startTable();
+  builder->addScalar<int16_t>(0, 0);                   // Little endian.
+  builder->addRef(1, field_vector);
+  return builder->endTable();
+}
+
+// Build a Message flatbuffer with the header table.
+string buildMessage(FlatBuilder* builder,
+                    uint8_t header_type,
+                    FlatBuilder::Ref header,
+                    int64_t body_length) {
+  builder->startTable();
+  builder->addScalar<int64_t>(3, body_length);
+  builder->addRef(2, header);
+  builder->addScalar<int16_t>(0, kArrowMetadataVersion);
+  builder->addScalar<uint8_t>(1, header_type);
+  return builder->finish(builder->endTable());
+}
+
+// Append zeros to the next 8-byte boundary.
+void padBody(string* body) {
+  body->append((8 - body->size() % 8) % 8, '\0');
+}
+
+} // namespace
+
+namespace sqlite3mex {
+
+ArrowWriter::ArrowWriter() : output_(NULL), file_format_(false),
+    schema_written_(false), position_(0), rows_(0) {}
+
+ArrowWriter::~ArrowWriter() {
+  if (output_) {
+    fclose(output_);
+    remove(filename_.c_str());
+  }
+}
+
+bool ArrowWriter::open(const string& filename,
+                       bool file_format,
+                       const vector<string>& names,
+                       const vector<int>& types) {
+  filename_ = filename;
+  file_format_ = file_format;
+  names_ = names;
+  types_ = types;
+  schema_written_ = false;
+  blocks_.clear();
+  position_ = 0;
+  rows_ = 0;
+  error_message_.clear();
+  output_ = fopen(filename_.c_str(), "wb");
+  if (!output_)
+    return setError();
+  setvbuf(output_, NULL, _IOFBF, kArrowBufferSize);
+  return !file_format_ || write(kArrowMagic, sizeof(kArrowMagic));
+}
+
+bool ArrowWriter::write(vector<Column>* columns) {
+  // The schema is written with the first batch that tells the types.
+  if (!schema_written_) {
+    for (size_t i = 0; i < types_.size(); ++i) {
+      const Column& column = (*columns)[i];
+      for (size_t j = 0; !types_[i] && j < column.values.size(); ++j)
+        if (column.values[j].type != SQLITE_NULL)
+          types_[i] = column.values[j].type;
+      if (!types_[i])
+        types_[i] = SQLITE_TEXT;
+    }
+    FlatBuilder builder;
+    FlatBuilder::Ref schema = addSchema(&builder, names_, types_);
+    Block block;
+    if (!writeMessage(buildMessage(&builder, kArrowSchemaHeader, schema, 0),
+                      string(),
+                      &block))
+      return false;
+    schema_written_ = true;
+  }
+  size_t num_rows = (columns->empty()) ? 0 : (*columns)[0].values.size();
+  if (num_rows == 0)
+    return true;
+  // Buffers of the columns in order: validity, offsets, and data.
+  string body;
+  vector<int64_t> nodes;
+  vector<int64_t> buffers;
+  for (size_t i = 0; i < columns->size(); ++i) {
+    Column* column = &(*columns)[i];
+    int type = types_[i];
+    string validity((num_rows + 7) / 8, '\0');
+    int64_t null_count = 0;
+    for (size_t j = 0; j < num_rows; ++j) {
+      if (column->values[j].type == SQLITE_NULL)
+        ++null_count;
+      else
+        validity[j / 8] |= 1 << (j % 8);
+    }
+    nodes.push_back(num_rows);
+    nodes.push_back(null_count);
+    buffers.push_back(body.size());
+    buffers.push_back(validity.size());
+    body.append(validity);
+    padBody(&body);
+    if (type == SQLITE_INTEGER || type == SQLITE_FLOAT) {
+      buffers.push_back(body.size());
+      buffers.push_back(num_rows * 8);
+      for (size_t j = 0; j < num_rows; ++j) {
+        const Datum& value = column->values[j];
+        const char* data = column->data.data() + value.offset;
+        if (type == SQLITE_INTEGER) {
+          int64_t integer = (value.type == SQLITE_NULL) ?
+              0 : convertToInteger(value, data);
+          body.append(reinterpret_cast<const char*>(&integer),
+                      sizeof(integer));
+        }
+        else {
+          double real = (value.type == SQLITE_NULL) ?
+              0 : convertToFloat(value, data);
+          body.append(reinterpret_cast<const char*>(&real), sizeof(real));
+        }
+      }
+      padBody(&body);
+    }
+    else {
+      string data;
+      vector<int32_t> offsets(1, 0);
+      for (size_t j = 0; j < num_rows; ++j) {
+        const Datum& value = column->values[j];
+        if (value.type == type)
+          data.append(column->data, value.offset, value.size);
+        else if (value.type != SQLITE_NULL)
+          data.append(convertToText(value,
+                                    column->data.data() + value.offset));
+        if (data.size() > INT_MAX) {
+          error_message_ = "Column " + names_[i] +
+                           " exceeds 2GB in a batch; use a smaller BatchSize";
+          return false;
+        }
+        offsets.push_back(data.size());
+      }
+      buffers.push_back(body.size());
+      buffers.push_back(offsets.size() * sizeof(int32_t));
+      body.append(reinterpret_cast<const char*>(offsets.data()),
+                  offsets.size() * sizeof(int32_t));
+      padBody(&body);
+      buffers.push_back(body.size());
+      buffers.push_back(data.size());
+      body.append(data);
+      padBody(&body);
+    }
+    column->values.clear();
+    column->data.clear();
+  }
+  FlatBuilder builder;
+  FlatBuilder::Ref buffer_vector = builder.createStructs(
+      buffers.data(), buffers.size() / 2, 2 * sizeof(int64_t));
+  FlatBuilder::Ref node_vector = builder.createStructs(
+      nodes.data(), nodes.size() / 2, 2 * sizeof(int64_t));
+  builder.startTable();
+  builder.addScalar<int64_t>(0, num_rows);
+  builder.addRef(1, node_vector);
+  builder.addRef(2, buffer_vector);
+  FlatBuilder::Ref batch = builder.endTable();
+  Block block;
+  if (!writeMessage(buildMessage(&builder, kArrowRecordBatchHeader, batch,
+                                 body.size()),
+                    body,
+                    &block))
+    return false;
+  blocks_.push_back(block);
+  rows_ += num_rows;
+  return true;
+}
+
+bool ArrowWriter::finish(vector<Column>* columns) {
+  if (!write(columns))
+    return false;
+  static const int32_t kEndOfStream[] = {-1, 0};
+  if (!write(kEndOfStream, sizeof(kEndOfStream)))
+    return false;
+  if (file_format_) {
+    FlatBuilder builder;
+    // Blocks are structs of offset, metaDataLength with padding, and
+    // bodyLength.
+    vector<int64_t> blocks;
+    for (size_t i = 0; i < blocks_.size(); ++i) {
+      blocks.push_back(blocks_[i].offset);
+      blocks.push_back(blocks_[i].metadata_length);
+      blocks.push_back(blocks_[i].body_length);
+    }
+    FlatBuilder::Ref block_vector = builder.createStructs(
+        blocks.data(), blocks_.size(), 3 * sizeof(int64_t));
+    FlatBuilder::Ref dictionaries = builder.createStructs(
+        NULL, 0, 3 * sizeof(int64_t));
+    FlatBuilder::Ref schema = addSchema(&builder, names_, types_);
+    builder.startTable();
+    builder.addRef(1, schema);
+    builder.addRef(2, dictionaries);
+    builder.addRef(3, block_vector);
+    builder.addScalar<int16_t>(0, kArrowMetadataVersion);
+    string footer = builder.finish(builder.endTable());
+    int32_t footer_length = footer.size();
+    if (!write(footer.data(), footer.size()) ||
+        !write(&footer_length, sizeof(footer_length)) ||
+        !write(kArrowMagic, 6))
+      return false;
+  }
+  FILE* output = output_;
+  output_ = NULL;
+  if (fclose(output) != 0) {
+    setError();
+    remove(filename_.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool ArrowWriter::writeMessage(const string& metadata,
+                               const string& body,
+                               Block* block) {
+  // The body starts at an 8-byte boundary after the prefix.
+  int32_t prefix[] = {-1, static_cast<int32_t>(
+      metadata.size() + (8 - metadata.size() % 8) % 8)};
+  block->offset = position_;
+  block->metadata_length = sizeof(prefix) + prefix[1];
+  block->body_length = body.size();
+  static const char zeros[8] = {0};
+  return write(prefix, sizeof(prefix)) &&
+         write(metadata.data(), metadata.size()) &&
+         write(zeros, prefix[1] - metadata.size()) &&
+         write(body.data(), body.size());
+}
+
+bool ArrowWriter::write(const void* data, size_t size) {
+  if (size && fwrite(data, size, 1, output_) != 1)
+    return setError();
+  position_ += size;
+  return true;
+}
+
+bool ArrowWriter::setError() {
+  error_message_ = "Failed to write " + filename_ + ": " + strerror(errno);
+  return false;
+}
+
+} // namespace sqlite3mex
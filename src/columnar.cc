@@ -0,0 +1,391 @@
+// SQLite3 matlab driver columnar result file.
+//
+// Query results that do not fit in memory are written to a columnar file
+// that matlab maps with memmapfile. Values are appended row by row to
+// temporary per-column files next to the output, and the columns are joined
+// into the output when the result is complete.
+//
+// File format, version 1. Integers are little-endian.
+//
+//   Header, 32 bytes:
+//     char[8]  magic "SQLMXCOL"
+//     uint32   version, 1
+//     uint32   number of columns
+//     uint64   number of rows
+//     uint64   offset of the column directory
+//   Column parts, each starting at an 8-byte boundary:
+//     validity ceil(rows / 8) bytes. Bit (i % 8) of byte (i / 8) is set if
+//              row i is not null.
+//     offsets  uint64[rows + 1] for text and blob columns. Row i is bytes
+//              [offsets[i], offsets[i + 1]) of the data.
+//     data     int64[rows] or double[rows] with 0 for null, or the bytes of
+//              text (UTF-8) or blob values.
+//   Column directory, for each column:
+//     uint32   type: 1 integer, 2 float, 3 text, 4 blob, 5 null
+//     uint32   bytes of the name
+//     char[]   name in UTF-8, zero-padded to an 8-byte boundary
+//     uint64   offset of the validity
+//     uint64   offset of the offsets, 0 for integer, float and null columns
+//     uint64   offset of the data
+//     uint64   bytes of the data
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sqlite3mex.h>
+
+namespace {
+
+// Magic bytes of the columnar file.
+const char kColumnarMagic[8] = {'S', 'Q', 'L', 'M', 'X', 'C', 'O', 'L'};
+// Version of the columnar file.
+const uint32_t kColumnarVersion = 1;
+// Type code of the column without any non-null value.
+const int kColumnarNull = 5;
+// Buffer size of the temporary files and the copy.
+const size_t kColumnarBufferSize = 1 << 20;
+
+// Open a temporary file with a large buffer.
+FILE* openTemporary(const string& path) {
+  FILE* file = fopen(path.c_str(), "w+b");
+  if (file)
+    setvbuf(file, NULL, _IOFBF, kColumnarBufferSize);
+  return file;
+}
+
+} // namespace
+
+namespace sqlite3mex {
+
+// Text of the value with the sqlite conversion rules.
+string convertToText(const Datum& value, const char* data) {
+  char buffer[32];
+  switch (value.type) {
+    case SQLITE_INTEGER:
+      sqlite3_snprintf(sizeof(buffer), buffer, "%lld",
+                       static_cast<sqlite3_int64>(value.integer));
+      return buffer;
+    case SQLITE_FLOAT:
+      sqlite3_snprintf(sizeof(buffer), buffer, "%!.15g", value.real);
+      return buffer;
+    case SQLITE_TEXT:
+    case SQLITE_BLOB:
+      return string(data, value.size);
+  }
+  return string();
+}
+
+// Floating point number of the value with the sqlite conversion rules.
+double convertToFloat(const Datum& value, const char* data) {
+  switch (value.type) {
+    case SQLITE_INTEGER:
+      return static_cast<double>(value.integer);
+    case SQLITE_FLOAT:
+      return value.real;
+    case SQLITE_TEXT:
+    case SQLITE_BLOB:
+      return strtod(convertToText(value, data).c_str(), NULL);
+  }
+  return 0;
+}
+
+// Integer of the value with the sqlite conversion rules.
+int64_t convertToInteger(const Datum& value, const char* data) {
+  switch (value.type) {
+    case SQLITE_INTEGER:
+      return value.integer;
+    case SQLITE_FLOAT:
+      return static_cast<int64_t>(value.real);
+    case SQLITE_TEXT:
+    case SQLITE_BLOB: {
+      string text = convertToText(value, data);
+      char* end = NULL;
+      long long integer = strtoll(text.c_str(), &end, 10);
+      if (end && (*end == '.' || *end == 'e' || *end == 'E'))
+        integer = static_cast<long long>(strtod(text.c_str(), NULL));
+      return integer;
+    }
+  }
+  return 0;
+}
+
+int columnarType(const char* declared_type) {
+  // Affinity rules of sqlite, except that numeric affinity is float.
+  if (!declared_type || !*declared_type)
+    return 0;
+  string type(declared_type);
+  for (size_t i = 0; i < type.size(); ++i)
+    type[i] = toupper(type[i]);
+  if (type.find("INT") != string::npos)
+    return SQLITE_INTEGER;
+  if (type.find("CHAR") != string::npos ||
+      type.find("CLOB") != string::npos ||
+      type.find("TEXT") != string::npos)
+    return SQLITE_TEXT;
+  if (type.find("BLOB") != string::npos)
+    return 0;
+  return SQLITE_FLOAT;
+}
+
+ColumnarWriter::ColumnarWriter() : finished_(false) {}
+
+ColumnarWriter::~ColumnarWriter() {
+  closeTemporaries();
+}
+
+bool ColumnarWriter::open(const string& filename,
+                          const vector<string>& names,
+                          const vector<int>& types) {
+  closeTemporaries();
+  filename_ = filename;
+  finished_ = false;
+  error_message_.clear();
+  columns_.assign(names.size(), ColumnFile());
+  for (size_t i = 0; i < columns_.size(); ++i) {
+    ColumnFile* column = &columns_[i];
+    column->name = names[i];
+    column->type = 0;
+    column->rows = 0;
+    column->pending_nulls = 0;
+    column->data = NULL;
+    column->data_bytes = 0;
+    column->offsets = NULL;
+    if (types[i] && !startColumn(column, types[i]))
+      return false;
+  }
+  return true;
+}
+
+bool ColumnarWriter::isOpen() const {
+  return !filename_.empty() && !finished_;
+}
+
+uint64_t ColumnarWriter::rows() const {
+  return (columns_.empty()) ? 0 : columns_[0].rows;
+}
+
+const string& ColumnarWriter::filename() const {
+  return filename_;
+}
+
+const string& ColumnarWriter::errorMessage() const {
+  return error_message_;
+}
+
+bool ColumnarWriter::append(size_t index, const Datum& value,
+                            const char* data) {
+  ColumnFile* column = &columns_[index];
+  if (column->rows % 8 == 0)
+    column->validity.push_back(0);
+  ++column->rows;
+  if (value.type == SQLITE_NULL) {
+    if (!column->type) {
+      ++column->pending_nulls;
+      return true;
+    }
+    return writeValue(column, value, data);
+  }
+  column->validity.back() |= 1 << ((column->rows - 1) % 8);
+  if (!column->type && !startColumn(column, value.type))
+    return false;
+  return writeValue(column, value, data);
+}
+
+bool ColumnarWriter::append(vector<Column>* columns) {
+  for (size_t i = 0; i < columns->size(); ++i) {
+    Column* column = &(*columns)[i];
+    for (size_t j = 0; j < column->values.size(); ++j) {
+      const Datum& value = column->values[j];
+      if (!append(i, value, column->data.data() +
+          ((value.type == SQLITE_TEXT || value.type == SQLITE_BLOB) ?
+           value.offset : 0)))
+        return false;
+    }
+    column->values.clear();
+    column->data.clear();
+  }
+  return true;
+}
+
+bool ColumnarWriter::finish() {
+  FILE* output = fopen(filename_.c_str(), "wb");
+  if (!output)
+    return setError(filename_);
+  setvbuf(output, NULL, _IOFBF, kColumnarBufferSize);
+  uint64_t position = 0;
+  uint64_t num_rows = rows();
+  vector<uint64_t> parts;
+  char header[32] = {0};
+  bool success = write(output, header, sizeof(header), &position);
+  for (size_t i = 0; success && i < columns_.size(); ++i) {
+    ColumnFile* column = &columns_[i];
+    if (!column->type)
+      column->type = kColumnarNull;
+    column->validity.resize((num_rows + 7) / 8, 0);
+    parts.push_back(position);
+    success = write(output, column->validity.data(),
+                    column->validity.size(), &position) &&
+              pad(output, &position);
+    bool variable = (column->type == SQLITE_TEXT ||
+                     column->type == SQLITE_BLOB);
+    parts.push_back((variable) ? position : 0);
+    if (success && variable)
+      success = copy(column->offsets, output, &position) &&
+                pad(output, &position);
+    parts.push_back(position);
+    parts.push_back(column->data_bytes);
+    if (success && column->data)
+      success = copy(column->data, output, &position) &&
+                pad(output, &position);
+  }
+  uint64_t directory = position;
+  for (size_t i = 0; success && i < columns_.size(); ++i) {
+    const ColumnFile& column = columns_[i];
+    uint32_t entry[] = {static_cast<uint32_t>(column.type),
+                        static_cast<uint32_t>(column.name.size())};
+    success = write(output, entry, sizeof(entry), &position) &&
+              write(output, column.name.data(), column.name.size(),
+                    &position) &&
+              pad(output, &position) &&
+              write(output, &parts[4 * i], 4 * sizeof(uint64_t), &position);
+  }
+  if (success) {
+    uint32_t counts[] = {kColumnarVersion,
+                         static_cast<uint32_t>(columns_.size())};
+    uint64_t locations[] = {num_rows, directory};
+    memcpy(header, kColumnarMagic, sizeof(kColumnarMagic));
+    memcpy(header + 8, counts, sizeof(counts));
+    memcpy(header + 16, locations, sizeof(locations));
+    success = fseek(output, 0, SEEK_SET) == 0 &&
+              fwrite(header, sizeof(header), 1, output) == 1;
+  }
+  if (fclose(output) != 0)
+    success = false;
+  if (!success) {
+    // Do not leave a truncated file behind.
+    setError(filename_);
+    remove(filename_.c_str());
+    return false;
+  }
+  closeTemporaries();
+  finished_ = true;
+  return true;
+}
+
+bool ColumnarWriter::startColumn(ColumnFile* column, int type) {
+  column->type = type;
+  size_t index = column - &columns_[0];
+  char suffix[32];
+  sqlite3_snprintf(sizeof(suffix), suffix, ".%d.tmp", static_cast<int>(index));
+  column->data_path = filename_ + suffix;
+  column->data = openTemporary(column->data_path);
+  if (!column->data)
+    return setError(column->data_path);
+  if (type == SQLITE_TEXT || type == SQLITE_BLOB) {
+    sqlite3_snprintf(sizeof(suffix), suffix, ".%d.offsets.tmp",
+                     static_cast<int>(index));
+    column->offsets_path = filename_ + suffix;
+    column->offsets = openTemporary(column->offsets_path);
+    uint64_t start = 0;
+    if (!column->offsets ||
+        fwrite(&start, sizeof(start), 1, column->offsets) != 1)
+      return setError(column->offsets_path);
+  }
+  // Nulls before the first value.
+  Datum null_value;
+  null_value.type = SQLITE_NULL;
+  null_value.size = 0;
+  null_value.integer = 0;
+  for (; column->pending_nulls > 0; --column->pending_nulls)
+    if (!writeValue(column, null_value, NULL))
+      return false;
+  return true;
+}
+
+bool ColumnarWriter::writeValue(ColumnFile* column,
+                                const Datum& value,
+                                const char* data) {
+  bool null = (value.type == SQLITE_NULL);
+  bool success = true;
+  switch (column->type) {
+    case SQLITE_INTEGER: {
+      int64_t integer = (null) ? 0 : convertToInteger(value, data);
+      success = fwrite(&integer, sizeof(integer), 1, column->data) == 1;
+      break;
+    }
+    case SQLITE_FLOAT: {
+      double real = (null) ? 0 : convertToFloat(value, data);
+      success = fwrite(&real, sizeof(real), 1, column->data) == 1;
+      break;
+    }
+    default: {
+      if (!null && value.type == column->type) {
+        success = value.size == 0 ||
+            fwrite(data, value.size, 1, column->data) == 1;
+        column->data_bytes += value.size;
+      }
+      else if (!null) {
+        string bytes = convertToText(value, data);
+        success = bytes.empty() ||
+            fwrite(bytes.data(), bytes.size(), 1, column->data) == 1;
+        column->data_bytes += bytes.size();
+      }
+      success = success && fwrite(&column->data_bytes,
+                                  sizeof(column->data_bytes),
+                                  1,
+                                  column->offsets) == 1;
+      break;
+    }
+  }
+  return success || setError(column->data_path);
+}
+
+bool ColumnarWriter::write(FILE* output,
+                           const void* data,
+                           size_t size,
+                           uint64_t* position) {
+  if (size && fwrite(data, size, 1, output) != 1)
+    return false;
+  *position += size;
+  return true;
+}
+
+bool ColumnarWriter::pad(FILE* output, uint64_t* position) {
+  static const char zeros[8] = {0};
+  return write(output, zeros, (8 - *position % 8) % 8, position);
+}
+
+bool ColumnarWriter::copy(FILE* input, FILE* output, uint64_t* position) {
+  if (fflush(input) != 0)
+    return false;
+  rewind(input);
+  vector<char> buffer(kColumnarBufferSize);
+  size_t size = 0;
+  while ((size = fread(&buffer[0], 1, buffer.size(), input)) > 0)
+    if (!write(output, &buffer[0], size, position))
+      return false;
+  return !ferror(input);
+}
+
+bool ColumnarWriter::setError(const string& path) {
+  error_message_ = "Failed to write " + path + ": " + strerror(errno);
+  return false;
+}
+
+void ColumnarWriter::closeTemporaries() {
+  for (size_t i = 0; i < columns_.size(); ++i) {
+    ColumnFile* column = &columns_[i];
+    if (column->data) {
+      fclose(column->data);
+      remove(column->data_path.c_str());
+      column->data = NULL;
+    }
+    if (column->offsets) {
+      fclose(column->offsets);
+      remove(column->offsets_path.c_str());
+      column->offsets = NULL;
+    }
+  }
+}
+
+} // namespace sqlite3mex
@@ -0,0 +1,704 @@
+// SQLite3 matlab driver CSV parser and writer.
+//
+// The input file is memory-mapped and split into blocks at record
+// boundaries. A boundary is a newline outside of quotes, which is found by
+// the parity of the quotes before it, so the split only counts quotes and
+// does not parse. Blocks are parsed on threads into typed values, and the
+// writer takes them in file order. The number of parsed blocks waiting for
+// the writer is bounded, so memory use does not grow with the file.
+//
+// The export writes rows as they are stepped into a buffer that is written
+// in large chunks, through zlib when built with SQLITE3MEX_ZLIB. Floats are
+// written with the fewest digits that read back to the same value, and the
+// output reads back with the import: unquoted empty fields are null, and
+// text equal to the null text is quoted.
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sqlite3mex.h>
+#include <sstream>
+#ifdef SQLITE3MEX_ZLIB
+#include <zlib.h>
+#endif
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+#define SQLITE3MEX_CSV_SSE2 1
+#include <emmintrin.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+using sqlite3mex::CSVBlock;
+using sqlite3mex::Datum;
+
+// Target size of a block.
+const size_t kCSVBlockSize = 4 << 20;
+// Parsed blocks per thread that may wait for the writer.
+const size_t kCSVBlocksPerThread = 2;
+// Buffer size of the export.
+const size_t kCSVBufferSize = 1 << 20;
+
+// Field of a record. A quoted field with doubled quotes is unescaped into
+// the scratch buffer at the offset, and data is NULL.
+typedef struct {
+  const char* data;
+  size_t offset;
+  size_t size;
+  bool quoted;
+} CSVField;
+
+// Find the first delimiter or newline.
+const char* findFieldEnd(const char* p, const char* end, char delimiter) {
+#ifdef SQLITE3MEX_CSV_SSE2
+  const __m128i delimiters = _mm_set1_epi8(delimiter);
+  const __m128i newlines = _mm_set1_epi8('\n');
+  for (; p + 16 <= end; p += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    int mask = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, delimiters),
+                     _mm_cmpeq_epi8(chunk, newlines)));
+    if (mask)
+      return p + __builtin_ctz(mask);
+  }
+#endif
+  for (; p < end; ++p)
+    if (*p == delimiter || *p == '\n')
+      return p;
+  return end;
+}
+
+// Count the quotes in the range.
+size_t countQuotes(const char* p, const char* end) {
+  size_t count = 0;
+#ifdef SQLITE3MEX_CSV_SSE2
+  const __m128i quotes = _mm_set1_epi8('"');
+  for (; p + 16 <= end; p += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    count += __builtin_popcount(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, quotes)));
+  }
+#endif
+  for (; p < end; ++p)
+    count += (*p == '"');
+  return count;
+}
+
+// Parse a record at the position and move it to the next record.
+bool parseRecord(const char** position,
+                 const char* end,
+                 char delimiter,
+                 vector<CSVField>* fields,
+                 string* scratch,
+                 string* error) {
+  fields->clear();
+  scratch->clear();
+  const char* p = *position;
+  while (true) {
+    CSVField field;
+    field.offset = 0;
+    field.quoted = (p < end && *p == '"');
+    if (field.quoted) {
+      const char* start = ++p;
+      size_t scratch_start = scratch->size();
+      bool escaped = false;
+      while (true) {
+        const char* quote = static_cast<const char*>(
+            memchr(p, '"', end - p));
+        if (!quote) {
+          *error = "Unterminated quoted field";
+          return false;
+        }
+        if (quote + 1 < end && quote[1] == '"') {
+          scratch->append(p, quote + 1 - p);
+          p = quote + 2;
+          escaped = true;
+          continue;
+        }
+        if (escaped)
+          scratch->append(p, quote - p);
+        field.data = (escaped) ? NULL : start;
+        field.offset = scratch_start;
+        field.size = (escaped) ? scratch->size() - scratch_start :
+                                 quote - start;
+        p = quote + 1;
+        break;
+      }
+      if (p < end && *p == '\r')
+        ++p;
+      if (p < end && *p != delimiter && *p != '\n') {
+        *error = "Unexpected character after a quoted field";
+        return false;
+      }
+    }
+    else {
+      const char* field_end = findFieldEnd(p, end, delimiter);
+      field.data = p;
+      field.size = field_end - p;
+      // Drop the carriage return of CRLF.
+      if ((field_end == end || *field_end == '\n') && field.size &&
+          field_end[-1] == '\r')
+        --field.size;
+      p = field_end;
+    }
+    fields->push_back(field);
+    if (p >= end || *p == '\n') {
+      *position = (p < end) ? p + 1 : end;
+      return true;
+    }
+    ++p;
+  }
+}
+
+// Parse a decimal integer of the whole text.
+bool parseInteger(const char* text, size_t size, int64_t* value) {
+  if (size == 0 || size > 20)
+    return false;
+  size_t i = 0;
+  bool negative = (text[0] == '-');
+  if (text[0] == '-' || text[0] == '+')
+    if (++i == size)
+      return false;
+  uint64_t magnitude = 0;
+  for (; i < size; ++i) {
+    unsigned digit = static_cast<unsigned char>(text[i]) - '0';
+    if (digit > 9 || magnitude > (UINT64_MAX - digit) / 10)
+      return false;
+    magnitude = magnitude * 10 + digit;
+  }
+  if (magnitude > static_cast<uint64_t>(INT64_MAX) + negative)
+    return false;
+  *value = (negative) ? static_cast<int64_t>(0 - magnitude) :
+                        static_cast<int64_t>(magnitude);
+  return true;
+}
+
+// Parse a decimal floating point number of the whole text.
+bool parseReal(const char* text, size_t size, double* value) {
+  char buffer[64];
+  if (size == 0 || size >= sizeof(buffer))
+    return false;
+  // strtod also takes spaces, hex, inf and nan, which stay text.
+  for (size_t i = 0; i < size; ++i)
+    if (!strchr("0123456789+-.eE", text[i]) || !text[i])
+      return false;
+  memcpy(buffer, text, size);
+  buffer[size] = '\0';
+  char* tail = NULL;
+  *value = strtod(buffer, &tail);
+  return tail == buffer + size;
+}
+
+// Append the value of the field converted to the column type. Numeric
+// columns keep text that is not a number, as the sqlite affinity does.
+void appendValue(const CSVField& field,
+                 const string& scratch,
+                 int type,
+                 CSVBlock* block) {
+  const char* text = (field.data) ? field.data : scratch.data() + field.offset;
+  Datum value;
+  value.type = SQLITE_TEXT;
+  value.size = 0;
+  value.integer = 0;
+  if (field.size == 0 && !field.quoted)
+    value.type = SQLITE_NULL;
+  else if (type == SQLITE_INTEGER &&
+           parseInteger(text, field.size, &value.integer))
+    value.type = SQLITE_INTEGER;
+  else if ((type == SQLITE_INTEGER || type == SQLITE_FLOAT) &&
+           parseReal(text, field.size, &value.real))
+    value.type = SQLITE_FLOAT;
+  if (value.type == SQLITE_TEXT) {
+    value.size = field.size;
+    value.offset = block->data.size();
+    block->data.append(text, field.size);
+  }
+  block->values.push_back(value);
+}
+
+// Skip a blank line at the position.
+bool skipBlankLine(const char** position, const char* end) {
+  const char* p = *position;
+  if (p < end && *p == '\r')
+    ++p;
+  if (p < end && *p == '\n') {
+    *position = p + 1;
+    return true;
+  }
+  return false;
+}
+
+// Append the decimal integer.
+void appendInteger(int64_t value, string* output) {
+  char buffer[24];
+  char* end = buffer + sizeof(buffer);
+  char* p = end;
+  uint64_t magnitude = (value < 0) ? 0 - static_cast<uint64_t>(value) :
+                                     static_cast<uint64_t>(value);
+  do {
+    *--p = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude);
+  if (value < 0)
+    *--p = '-';
+  output->append(p, end - p);
+}
+
+// Append the shortest of 15 to 17 significant digits that reads back to the
+// same double.
+void appendReal(double value, string* output) {
+  if (!std::isfinite(value)) {
+    output->append((value > 0) ? "Inf" : (value < 0) ? "-Inf" : "NaN");
+    return;
+  }
+  char buffer[32];
+  int size = 0;
+  for (int precision = 15; precision <= 17; ++precision) {
+    size = snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+    if (precision == 17 || strtod(buffer, NULL) == value)
+      break;
+  }
+  output->append(buffer, size);
+}
+
+// Append the bytes in hex.
+void appendHex(const char* data, size_t size, string* output) {
+  static const char kDigits[] = "0123456789abcdef";
+  for (size_t i = 0; i < size; ++i) {
+    unsigned char byte = data[i];
+    output->push_back(kDigits[byte >> 4]);
+    output->push_back(kDigits[byte & 15]);
+  }
+}
+
+} // namespace
+
+namespace sqlite3mex {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() : data_(NULL), size_(0),
+    file_(INVALID_HANDLE_VALUE), mapping_(NULL) {}
+
+bool MappedFile::open(const string& filename) {
+  close();
+  file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                      OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (file_ == INVALID_HANDLE_VALUE)
+    return false;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file_, &size))
+    return false;
+  size_ = static_cast<size_t>(size.QuadPart);
+  if (size_ == 0)
+    return true;
+  mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (!mapping_)
+    return false;
+  data_ = static_cast<const char*>(
+      MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+  return data_ != NULL;
+}
+
+void MappedFile::close() {
+  if (data_)
+    UnmapViewOfFile(data_);
+  if (mapping_)
+    CloseHandle(mapping_);
+  if (file_ != INVALID_HANDLE_VALUE)
+    CloseHandle(file_);
+  data_ = NULL;
+  size_ = 0;
+  mapping_ = NULL;
+  file_ = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile() : data_(NULL), size_(0) {}
+
+bool MappedFile::open(const string& filename) {
+  close();
+  int descriptor = ::open(filename.c_str(), O_RDONLY);
+  if (descriptor < 0)
+    return false;
+  struct stat status;
+  if (fstat(descriptor, &status) != 0) {
+    ::close(descriptor);
+    return false;
+  }
+  size_ = status.st_size;
+  if (size_ > 0) {
+    void* data = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    if (data == MAP_FAILED)
+      size_ = 0;
+    else {
+      data_ = static_cast<const char*>(data);
+      madvise(data, size_, MADV_SEQUENTIAL);
+    }
+  }
+  int error = errno;
+  ::close(descriptor);
+  errno = error;
+  return data_ || status.st_size == 0;
+}
+
+void MappedFile::close() {
+  if (data_)
+    munmap(const_cast<char*>(data_), size_);
+  data_ = NULL;
+  size_ = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+  close();
+}
+
+CSVParser::CSVParser() : next_parse_(0), next_take_(0), stopping_(false) {}
+
+CSVParser::~CSVParser() {
+  stop();
+}
+
+bool CSVParser::open(const string& filename, const CSVOptions& options) {
+  options_ = options;
+  if (!file_.open(filename)) {
+    error_message_ = "Failed to open " + filename + ": " + strerror(errno);
+    return false;
+  }
+  const char* p = file_.data();
+  const char* end = p + file_.size();
+  // Skip the byte order mark.
+  if (end - p >= 3 && memcmp(p, "\xEF\xBB\xBF", 3) == 0)
+    p += 3;
+  while (skipBlankLine(&p, end)) {}
+  if (p == end) {
+    error_message_ = "Empty file: " + filename;
+    return false;
+  }
+  vector<CSVField> fields;
+  string scratch;
+  const char* record = p;
+  if (!parseRecord(&record, end, options_.delimiter, &fields, &scratch,
+                   &error_message_))
+    return false;
+  names_.clear();
+  for (size_t i = 0; i < fields.size(); ++i) {
+    if (options_.header)
+      names_.push_back((fields[i].data) ?
+          string(fields[i].data, fields[i].size) :
+          scratch.substr(fields[i].offset, fields[i].size));
+    else {
+      stringstream name;
+      name << "Var" << (i + 1);
+      names_.push_back(name.str());
+    }
+  }
+  if (options_.header)
+    p = record;
+  splitBlocks(p);
+  // Integer parsing falls back to float and text, which tells the widest
+  // type of each column in the sample.
+  CSVBlock sample;
+  types_.clear();
+  parseBlock(p, file_.data() + boundaries_[1], options_.sample_rows, &sample);
+  if (!sample.error.empty()) {
+    stringstream message;
+    message << sample.error << " at row " << (sample.rows + 1);
+    error_message_ = message.str();
+    return false;
+  }
+  types_.assign(names_.size(), 0);
+  for (size_t i = 0; i < sample.values.size(); ++i) {
+    int* type = &types_[i % names_.size()];
+    int value_type = sample.values[i].type;
+    if (value_type == SQLITE_TEXT ||
+        (value_type == SQLITE_FLOAT && *type != SQLITE_TEXT) ||
+        (value_type == SQLITE_INTEGER && !*type))
+      *type = value_type;
+  }
+  for (size_t i = 0; i < types_.size(); ++i)
+    if (!types_[i])
+      types_[i] = SQLITE_TEXT;
+  return true;
+}
+
+void CSVParser::splitBlocks(const char* begin) {
+  const char* data = file_.data();
+  const char* end = data + file_.size();
+  boundaries_.assign(1, begin - data);
+  const char* p = begin;
+  bool quoted = false;
+  while (p < end) {
+    const char* target = (static_cast<size_t>(end - p) > kCSVBlockSize) ?
+        p + kCSVBlockSize : end;
+    quoted ^= countQuotes(p, target) & 1;
+    p = target;
+    // Move to the next newline outside of quotes.
+    while (p < end) {
+      const char* newline = static_cast<const char*>(
+          memchr(p, '\n', end - p));
+      if (!newline)
+        newline = end;
+      quoted ^= countQuotes(p, newline) & 1;
+      p = (newline < end) ? newline + 1 : end;
+      if (!quoted)
+        break;
+    }
+    boundaries_.push_back(p - data);
+  }
+  if (boundaries_.size() == 1)
+    boundaries_.push_back(boundaries_[0]);
+}
+
+void CSVParser::parseBlock(const char* begin,
+                           const char* end,
+                           size_t max_rows,
+                           CSVBlock* block) const {
+  block->rows = 0;
+  block->values.clear();
+  block->data.clear();
+  block->error.clear();
+  vector<CSVField> fields;
+  string scratch;
+  const char* p = begin;
+  while (p < end && block->rows < max_rows) {
+    if (skipBlankLine(&p, end))
+      continue;
+    if (!parseRecord(&p, end, options_.delimiter, &fields, &scratch,
+                     &block->error))
+      return;
+    if (fields.size() != names_.size()) {
+      stringstream message;
+      message << "Record has " << fields.size() << " fields, expected "
+              << names_.size();
+      block->error = message.str();
+      return;
+    }
+    for (size_t i = 0; i < fields.size(); ++i)
+      appendValue(fields[i], scratch,
+                  (types_.empty()) ? SQLITE_INTEGER : types_[i], block);
+    ++block->rows;
+  }
+}
+
+void CSVParser::start(const vector<int>& types) {
+  stop();
+  types_ = types;
+  stopping_ = false;
+  next_parse_ = 0;
+  next_take_ = 0;
+  parsed_.clear();
+  if (options_.threads <= 0)
+    options_.threads = max(1u, thread::hardware_concurrency());
+  for (int i = 0; i < options_.threads; ++i)
+    threads_.push_back(thread(&CSVParser::run, this));
+}
+
+void CSVParser::run() {
+  size_t window = kCSVBlocksPerThread * options_.threads;
+  size_t num_blocks = boundaries_.size() - 1;
+  while (true) {
+    size_t index = 0;
+    {
+      unique_lock<mutex> lock(mutex_);
+      while (!stopping_ && next_parse_ < num_blocks &&
+             next_parse_ >= next_take_ + window)
+        condition_.wait(lock);
+      if (stopping_ || next_parse_ >= num_blocks)
+        return;
+      index = next_parse_++;
+    }
+    CSVBlock block;
+    parseBlock(file_.data() + boundaries_[index],
+               file_.data() + boundaries_[index + 1],
+               static_cast<size_t>(-1),
+               &block);
+    lock_guard<mutex> lock(mutex_);
+    parsed_[index] = move(block);
+    condition_.notify_all();
+  }
+}
+
+bool CSVParser::next(CSVBlock* block) {
+  unique_lock<mutex> lock(mutex_);
+  if (next_take_ >= boundaries_.size() - 1)
+    return false;
+  while (parsed_.find(next_take_) == parsed_.end())
+    condition_.wait(lock);
+  map<size_t, CSVBlock>::iterator entry = parsed_.find(next_take_++);
+  *block = move(entry->second);
+  parsed_.erase(entry);
+  condition_.notify_all();
+  return true;
+}
+
+void CSVParser::stop() {
+  {
+    lock_guard<mutex> lock(mutex_);
+    stopping_ = true;
+    condition_.notify_all();
+  }
+  for (size_t i = 0; i < threads_.size(); ++i)
+    threads_[i].join();
+  threads_.clear();
+}
+
+CSVWriter::CSVWriter() : output_(NULL), row_start_(true) {}
+
+CSVWriter::~CSVWriter() {
+  if (output_) {
+    close();
+    remove(filename_.c_str());
+  }
+}
+
+bool CSVWriter::open(const string& filename, const CSVOptions& options) {
+  filename_ = filename;
+  options_ = options;
+  buffer_.clear();
+  buffer_.reserve(kCSVBufferSize + kCSVBufferSize / 4);
+  row_start_ = true;
+  error_message_.clear();
+  if (options_.gzip) {
+#ifdef SQLITE3MEX_ZLIB
+    output_ = gzopen(filename_.c_str(), "wb6");
+#else
+    error_message_ = "Gzip is not available: the driver is built without "
+                     "zlib";
+    return false;
+#endif
+  }
+  else
+    output_ = fopen(filename_.c_str(), "wb");
+  if (!output_) {
+    error_message_ = "Failed to open " + filename_ + ": " + strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool CSVWriter::writeHeader(const vector<string>& names) {
+  for (size_t i = 0; i < names.size(); ++i) {
+    if (!row_start_)
+      buffer_.push_back(options_.delimiter);
+    row_start_ = false;
+    appendText(names[i].data(), names[i].size());
+  }
+  return endRow();
+}
+
+void CSVWriter::appendValue(const Datum& value, const char* data) {
+  if (!row_start_)
+    buffer_.push_back(options_.delimiter);
+  row_start_ = false;
+  switch (value.type) {
+    case SQLITE_INTEGER:
+      appendInteger(value.integer, &buffer_);
+      break;
+    case SQLITE_FLOAT:
+      appendReal(value.real, &buffer_);
+      break;
+    case SQLITE_TEXT:
+      appendText(data, value.size);
+      break;
+    case SQLITE_BLOB:
+      appendHex(data, value.size, &buffer_);
+      break;
+    default:
+      buffer_.append(options_.null_text);
+  }
+}
+
+void CSVWriter::appendText(const char* data, size_t size) {
+  bool quoted = (options_.quote == kCSVQuoteAll);
+  if (options_.quote == kCSVQuoteMinimal) {
+    // Text that reads as null is quoted as well.
+    quoted = (size == options_.null_text.size() &&
+              memcmp(data, options_.null_text.data(), size) == 0);
+    for (size_t i = 0; !quoted && i < size; ++i) {
+      char c = data[i];
+      quoted = (c == options_.delimiter || c == '"' || c == '\n' ||
+                c == '\r');
+    }
+  }
+  if (!quoted) {
+    buffer_.append(data, size);
+    return;
+  }
+  buffer_.push_back('"');
+  const char* end = data + size;
+  while (data < end) {
+    const char* quote = static_cast<const char*>(
+        memchr(data, '"', end - data));
+    if (!quote) {
+      buffer_.append(data, end - data);
+      break;
+    }
+    buffer_.append(data, quote + 1 - data);
+    buffer_.push_back('"');
+    data = quote + 1;
+  }
+  buffer_.push_back('"');
+}
+
+bool CSVWriter::endRow() {
+  buffer_.push_back('\n');
+  row_start_ = true;
+  return buffer_.size() < kCSVBufferSize || flush();
+}
+
+bool CSVWriter::flush() {
+  bool success = true;
+  if (!buffer_.empty()) {
+#ifdef SQLITE3MEX_ZLIB
+    if (options_.gzip)
+      success = gzwrite(static_cast<gzFile>(output_), buffer_.data(),
+                        buffer_.size()) == static_cast<int>(buffer_.size());
+    else
+#endif
+      success = fwrite(buffer_.data(), buffer_.size(), 1,
+                       static_cast<FILE*>(output_)) == 1;
+  }
+  buffer_.clear();
+  if (!success)
+    error_message_ = "Failed to write " + filename_ + ": " + strerror(errno);
+  return success;
+}
+
+bool CSVWriter::close() {
+  bool success = true;
+#ifdef SQLITE3MEX_ZLIB
+  if (options_.gzip)
+    success = gzclose(static_cast<gzFile>(output_)) == Z_OK;
+  else
+#endif
+    success = fclose(static_cast<FILE*>(output_)) == 0;
+  output_ = NULL;
+  return success;
+}
+
+bool CSVWriter::finish() {
+  if (!flush() || !close()) {
+    if (error_message_.empty())
+      error_message_ = "Failed to write " + filename_ + ": " +
+                       strerror(errno);
+    if (output_)
+      close();
+    remove(filename_.c_str());
+    return false;
+  }
+  return true;
+}
+
+} // namespace sqlite3mex
@@ -11,10 +11,19 @@ using boost::regex_replace;
 #else
 #include <regex>
 #endif
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
 #include <set>
 #include <sqlite3mex.h>
 #include <sstream>
 
+// Undocumented matlab API in libut to poll Ctrl-C.
+extern "C" bool utIsInterruptPending();
+extern "C" bool utSetInterruptPending(bool);
+
 namespace {
 
 // Create a persistent mxArray.
@@ -34,25 +43,372 @@ class PersistentMxArray {
   mxArray* array_;
 };
 
-// Label for unicode2native() and native2unicode().
-PersistentMxArray kUTF8Label(mxCreateString("utf8"));
+// Create a char array from UTF-8 text. Invalid sequences become U+FFFD.
+mxArray* createCharArray(const char* text, size_t size) {
+  const uint8_t* input = reinterpret_cast<const uint8_t*>(text);
+  size_t ascii = 0;
+  while (ascii < size && input[ascii] < 0x80)
+    ++ascii;
+  vector<mxChar> chars;
+  if (ascii < size) {
+    chars.reserve(size);
+    chars.assign(input, input + ascii);
+    size_t i = ascii;
+    while (i < size) {
+      uint32_t code = input[i];
+      int trailing = (code >= 0xF0 && code < 0xF8) ? 3 :
+                     (code >= 0xE0) ? 2 :
+                     (code >= 0xC0) ? 1 : 0;
+      if (code >= 0xF8 || (code >= 0x80 && code < 0xC0) ||
+          i + trailing >= size + (trailing == 0)) {
+        chars.push_back(0xFFFD);
+        ++i;
+        continue;
+      }
+      if (trailing)
+        code &= (0x3F >> trailing);
+      int j = 1;
+      for (; j <= trailing && (input[i + j] & 0xC0) == 0x80; ++j)
+        code = (code << 6) | (input[i + j] & 0x3F);
+      if (j <= trailing) {
+        chars.push_back(0xFFFD);
+        i += j;
+        continue;
+      }
+      i += j;
+      if (code >= 0x10000) {
+        code -= 0x10000;
+        chars.push_back(static_cast<mxChar>(0xD800 | (code >> 10)));
+        chars.push_back(static_cast<mxChar>(0xDC00 | (code & 0x3FF)));
+      }
+      else
+        chars.push_back(static_cast<mxChar>(code));
+    }
+  }
+  mwSize dimensions[] = {1, static_cast<mwSize>(
+      (ascii < size) ? chars.size() : size)};
+  mxArray* array = mxCreateCharArray(2, dimensions);
+  if (array == NULL)
+    ERROR("Failed to create mxArray.");
+  mxChar* output = mxGetChars(array);
+  if (ascii < size)
+    copy(chars.begin(), chars.end(), output);
+  else
+    copy(input, input + size, output);
+  return array;
+}
+
+// Append the UTF-8 text of the char array. Unpaired surrogates become
+// U+FFFD.
+void appendUTF8(const mxArray* array, string* text) {
+  const mxChar* chars = mxGetChars(array);
+  size_t size = mxGetNumberOfElements(array);
+  text->reserve(text->size() + size);
+  for (size_t i = 0; i < size; ++i) {
+    uint32_t code = chars[i];
+    if (code < 0x80) {
+      text->push_back(static_cast<char>(code));
+      continue;
+    }
+    if (code >= 0xD800 && code < 0xE000) {
+      if (code < 0xDC00 && i + 1 < size && chars[i + 1] >= 0xDC00 &&
+          chars[i + 1] < 0xE000)
+        code = 0x10000 + ((code - 0xD800) << 10) + (chars[++i] - 0xDC00);
+      else
+        code = 0xFFFD;
+    }
+    if (code < 0x800) {
+      text->push_back(static_cast<char>(0xC0 | (code >> 6)));
+    }
+    else if (code < 0x10000) {
+      text->push_back(static_cast<char>(0xE0 | (code >> 12)));
+      text->push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+    }
+    else {
+      text->push_back(static_cast<char>(0xF0 | (code >> 18)));
+      text->push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+      text->push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+    }
+    text->push_back(static_cast<char>(0x80 | (code & 0x3F)));
+  }
+}
+
+// Bind the element of the numeric or logical array. NaN is null.
+int bindElement(sqlite3_stmt* statement,
+                int index,
+                const mxArray* array,
+                size_t i) {
+  const void* data = mxGetData(array);
+  switch (mxGetClassID(array)) {
+    case mxDOUBLE_CLASS: {
+      double value = static_cast<const double*>(data)[i];
+      return (value != value) ? sqlite3_bind_null(statement, index) :
+                                sqlite3_bind_double(statement, index, value);
+    }
+    case mxSINGLE_CLASS: {
+      float value = static_cast<const float*>(data)[i];
+      return (value != value) ? sqlite3_bind_null(statement, index) :
+                                sqlite3_bind_double(statement, index, value);
+    }
+    case mxLOGICAL_CLASS:
+      return sqlite3_bind_int64(statement, index,
+                                static_cast<const mxLogical*>(data)[i]);
+    case mxINT8_CLASS:
+      return sqlite3_bind_int64(statement, index,
+                                static_cast<const int8_t*>(data)[i]);
+    case mxUINT8_CLASS:
+      return sqlite3_bind_int64(statement, index,
+                                static_cast<const uint8_t*>(data)[i]);
+    case mxINT16_CLASS:
+      return sqlite3_bind_int64(statement, index,
+                                static_cast<const int16_t*>(data)[i]);
+    case mxUINT16_CLASS:
+      return sqlite3_bind_int64(statement, index,
+                                static_cast<const uint16_t*>(data)[i]);
+    case mxINT32_CLASS:
+      return sqlite3_bind_int64(statement, index,
+                                static_cast<const int32_t*>(data)[i]);
+    case mxUINT32_CLASS:
+      return sqlite3_bind_int64(statement, index,
+                                static_cast<const uint32_t*>(data)[i]);
+    case mxINT64_CLASS:
+      return sqlite3_bind_int64(statement, index,
+                                static_cast<const int64_t*>(data)[i]);
+    case mxUINT64_CLASS:
+      return sqlite3_bind_int64(statement, index,
+                                static_cast<const uint64_t*>(data)[i]);
+    default:
+      return SQLITE_MISMATCH;
+  }
+}
+
+// Create a cell array of strings.
+mxArray* createCellString(const vector<string>& values) {
+  mxArray* array = mxCreateCellMatrix(1, values.size());
+  for (size_t i = 0; i < values.size(); ++i)
+    mxSetCell(array, i, createCharArray(values[i].data(), values[i].size()));
+  return array;
+}
+
+// Assign a value to target(subs) or target.subs1.subs2 via subsasgn.
+mxArray* assignTo(mxArray* target,
+                  const char* type,
+                  const vector<mxArray*>& subs,
+                  mxArray* value) {
+  const char* fields[] = {"type", "subs"};
+  mxArray* index = mxCreateStructMatrix(1, subs.size(), 2, fields);
+  for (size_t i = 0; i < subs.size(); ++i) {
+    mxSetFieldByNumber(index, i, 0, mxCreateString(type));
+    mxSetFieldByNumber(index, i, 1, subs[i]);
+  }
+  mxArray* result = NULL;
+  mxArray* rhs[] = {target, index, value};
+  mexCallMATLAB(1, &result, 3, rhs, "subsasgn");
+  mxDestroyArray(index);
+  mxDestroyArray(target);
+  mxDestroyArray(value);
+  return result;
+}
+
+// Decode the dictionary-encoded text values of the column back to offsets.
+void decodeColumn(sqlite3mex::Column* column) {
+  if (!column->encoded)
+    return;
+  for (size_t i = 0; i < column->values.size(); ++i) {
+    sqlite3mex::Datum* value = &column->values[i];
+    if (value->type == SQLITE_TEXT)
+      value->offset = column->entries[value->offset].offset;
+  }
+  column->encoded = false;
+  vector<sqlite3mex::Datum>().swap(column->entries);
+  unordered_map<string, uint32_t>().swap(column->codes);
+}
+
+// Check if categorical keeps the text as a category name. Names are trimmed
+// of white space, so ' ' is not a valid name and 'a' and 'a ' collide.
+bool isCategoryName(const char* text, size_t size) {
+  return size == 0 || (!isspace(static_cast<unsigned char>(text[0])) &&
+                       !isspace(static_cast<unsigned char>(text[size - 1])));
+}
+
+// Number of virtual machine instructions between progress handler calls.
+const int kProgressInterval = 1000;
+// Milliseconds a slice of the page cache warm-up holds the connection.
+const int kWarmSliceMilliseconds = 50;
+
+// Rows to stage before auto dictionary encoding may give up.
+const size_t kDictionaryMinRows = 1024;
+
+// Names of the execute options.
+const char* kOptionNames[] = {"Format", "Dictionary", "DictionaryThreshold",
+                              "MaxRows", "MaxBytes", "Deadline",
+                              "SpillThreshold", "SpillFile"};
+
+// Unique file name in the temporary directory.
+string temporaryFilename() {
+  const char* directory = getenv("TMPDIR");
+  if (!directory)
+    directory = getenv("TEMP");
+  if (!directory)
+    directory = getenv("TMP");
+  if (!directory)
+    directory = "/tmp";
+  sqlite3_uint64 random = 0;
+  sqlite3_randomness(sizeof(random), &random);
+  char name[32];
+  sqlite3_snprintf(sizeof(name), name, "sqlite3mex-%016llx.col", random);
+  return string(directory) + "/" + name;
+}
+
+// Quote the name as an SQL identifier.
+string quoteIdentifier(const string& name) {
+  string quoted("\"");
+  for (size_t i = 0; i < name.size(); ++i) {
+    if (name[i] == '"')
+      quoted += '"';
+    quoted += name[i];
+  }
+  return quoted + "\"";
+}
+
+// Declared type of the column type.
+const char* declaredType(int type) {
+  switch (type) {
+    case SQLITE_INTEGER: return "INTEGER";
+    case SQLITE_FLOAT: return "REAL";
+  }
+  return "TEXT";
+}
+
+// Append the class, dimensions, and bytes of the parameter to the result
+// cache key. False if the parameter can't be a part of the key.
+bool appendCacheKey(const mxArray* array, string* key) {
+  if (!array) {
+    key->push_back('\0');
+    return true;
+  }
+  mxClassID class_id = mxGetClassID(array);
+  mwSize num_dimensions = mxGetNumberOfDimensions(array);
+  key->append(reinterpret_cast<const char*>(&class_id), sizeof(class_id));
+  key->append(reinterpret_cast<const char*>(&num_dimensions),
+              sizeof(num_dimensions));
+  key->append(reinterpret_cast<const char*>(mxGetDimensions(array)),
+              num_dimensions * sizeof(mwSize));
+  size_t size = mxGetNumberOfElements(array);
+  if (mxIsStruct(array)) {
+    int num_fields = mxGetNumberOfFields(array);
+    for (int i = 0; i < num_fields; ++i)
+      key->append(mxGetFieldNameByNumber(array, i)).push_back('\0');
+    for (size_t i = 0; i < size; ++i)
+      for (int j = 0; j < num_fields; ++j)
+        if (!appendCacheKey(mxGetFieldByNumber(array, i, j), key))
+          return false;
+    return true;
+  }
+  if (mxIsCell(array)) {
+    for (size_t i = 0; i < size; ++i)
+      if (!appendCacheKey(mxGetCell(array, i), key))
+        return false;
+    return true;
+  }
+  if ((!mxIsNumeric(array) && !mxIsChar(array) && !mxIsLogical(array)) ||
+      mxIsComplex(array) || mxIsSparse(array))
+    return false;
+  if (size > 0)
+    key->append(static_cast<const char*>(mxGetData(array)),
+                size * mxGetElementSize(array));
+  return true;
+}
+
+// Check if the result of the statement can be cached: a read-only query
+// that is not a pragma. Transaction statements are read-only but have no
+// columns.
+bool isCacheable(sqlite3mex::Statement* statement) {
+  const char* sql = sqlite3_sql(statement->get());
+  sql += strspn(sql, " \t\r\n");
+  return sqlite3_stmt_readonly(statement->get()) &&
+         sqlite3_column_count(statement->get()) > 0 &&
+         sqlite3_strnicmp(sql, "PRAGMA", 6) != 0;
+}
+
+#ifdef SQLITE_ENABLE_SESSION
+#if SQLITE_VERSION_NUMBER < 3013000
+#error "The session extension needs SQLite 3.13.0 or later."
+#endif
+
+// Id of the next changeset session, unique in the process.
+uint64_t next_session_id = 1;
+
+// Conflict handler of sqlite3changeset_apply() counting the conflicts.
+typedef struct {
+  sqlite3mex::ConflictPolicy policy;
+  int conflicts;
+} ConflictContext;
+
+int resolveConflict(void* context,
+                    int conflict,
+                    sqlite3_changeset_iter* iterator) {
+  ConflictContext* resolution = static_cast<ConflictContext*>(context);
+  ++resolution->conflicts;
+  switch (resolution->policy) {
+    case sqlite3mex::kConflictOmit:
+      return SQLITE_CHANGESET_OMIT;
+    case sqlite3mex::kConflictReplace:
+      // Only a row of different values or keys can be replaced.
+      return (conflict == SQLITE_CHANGESET_DATA ||
+              conflict == SQLITE_CHANGESET_CONFLICT) ?
+          SQLITE_CHANGESET_REPLACE : SQLITE_CHANGESET_OMIT;
+    default:
+      return SQLITE_CHANGESET_ABORT;
+  }
+}
+#else
+// Error message of the session operations without the extension.
+const char* kNoSession = "The driver is built without the session "
+                         "extension. Build with SESSION=1 and SQLite 3.13.0 "
+                         "or later";
+#endif
+
+// Check if the name is an execute option.
+bool isOptionName(const string& name) {
+  for (size_t i = 0; i < sizeof(kOptionNames) / sizeof(kOptionNames[0]); ++i)
+    if (sqlite3_stricmp(name.c_str(), kOptionNames[i]) == 0)
+      return true;
+  return false;
+}
+
+// Get the option value as a string, or empty if not a string.
+string getOptionString(const mxArray* value) {
+  char* value_string = (mxIsChar(value)) ? mxArrayToString(value) : NULL;
+  string option((value_string) ? value_string : "");
+  mxFree(value_string);
+  return option;
+}
 
 }
 
 namespace sqlite3mex {
 
-Statement::Statement() : statement_(NULL) {}
+Statement::Statement() : statement_(NULL), code_(SQLITE_OK) {}
 
 Statement::~Statement() {
   finalize();
 }
 
 bool Statement::prepare(const string& statement, sqlite3* database) {
+  return prepare(statement.c_str(), statement.length() + 1, database, NULL);
+}
+
+bool Statement::prepare(const char* statement,
+                        int length,
+                        sqlite3* database,
+                        const char** tail) {
+  finalize();
   code_ = sqlite3_prepare_v2(database,
-                             statement.c_str(),
-                             statement.length() + 1,
+                             statement,
+                             length,
                              &statement_,
-                             NULL);
+                             tail);
   return ok();
 }
 
@@ -78,50 +434,102 @@ bool Statement::reset() {
 }
 
 bool Statement::bind(const vector<const mxArray*>& params) {
+  error_message_.clear();
   int num_binds = sqlite3_bind_parameter_count(statement_);
-  if (params.size() != num_binds)
-    ERROR("Wrong number of parameters: %d for %d.", params.size(), num_binds);
+  bool by_name = bindsByName(params);
+  if (params.size() != ((by_name) ? 1 : num_binds)) {
+    stringstream message;
+    message << "Wrong number of parameters: " << params.size() << " for "
+            << num_binds;
+    error_message_ = message.str();
+    code_ = SQLITE_RANGE;
+    return false;
+  }
   code_ = sqlite3_clear_bindings(statement_);
   if (!ok())
     return false;
+  if (by_name)
+    return bindFields(params[0], 0);
   for (int i = 0; i < params.size(); ++i) {
-    if (mxGetNumberOfElements(params[i]) == 1 && mxIsNumeric(params[i])) {
-      if (mxIsDouble(params[i]) || mxIsSingle(params[i]))
-        code_ = sqlite3_bind_double(statement_, i + 1, mxGetScalar(params[i]));
+    if (!bindValue(i + 1, params[i]))
+      return false;
+  }
+  return true;
+}
+
+bool Statement::bindsByName(const vector<const mxArray*>& params) const {
+  if (params.empty() || !mxIsStruct(params[0]) ||
+      mxGetNumberOfElements(params[0]) != 1 ||
+      sqlite3_bind_parameter_count(statement_) == 0)
+    return false;
+  const char* name = sqlite3_bind_parameter_name(statement_, 1);
+  return name && name[0] != '?';
+}
+
+bool Statement::bindFields(const mxArray* record, size_t element) {
+  error_message_.clear();
+  int num_binds = sqlite3_bind_parameter_count(statement_);
+  for (int i = 1; i <= num_binds; ++i) {
+    const char* name = sqlite3_bind_parameter_name(statement_, i);
+    int field = (name && name[0] != '?') ?
+        mxGetFieldNumber(record, name + 1) : -1;
+    if (field < 0) {
+      stringstream message;
+      if (name && name[0] != '?')
+        message << "No field for parameter " << name;
       else
-        code_ = sqlite3_bind_int64(statement_, i + 1, mxGetScalar(params[i]));
-    }
-    else if (mxIsChar(params[i])) {
-      mxArray* blob = mxCreateNumericMatrix(1,
-                                            mxGetNumberOfElements(params[i]),
-                                            mxUINT8_CLASS,
-                                            mxREAL);
-      mxArray* lhs[] = {const_cast<mxArray*>(params[i]), kUTF8Label.get()};
-      mexCallMATLAB(1, &blob, 2, lhs, "unicode2native");
-      code_ = sqlite3_bind_text(statement_,
-                                i + 1,
-                                reinterpret_cast<char*>(mxGetData(blob)),
-                                -1,
-                                SQLITE_TRANSIENT);
-      mxDestroyArray(blob);
-    }
-    else if (mxIsUint8(params[i])) {
-      code_ = sqlite3_bind_blob(statement_,
-                                i + 1,
-                                mxGetData(params[i]),
-                                mxGetNumberOfElements(params[i]),
-                                SQLITE_STATIC);
-    }
-    else if (mxIsEmpty(params[i]))
-      code_ = sqlite3_bind_null(statement_, i + 1);
-    else
-      ERROR("Can't bind parameter %d.", i + 1);
-    if (!ok())
+        message << "Parameter " << i << " has no name";
+      error_message_ = message.str();
+      code_ = SQLITE_RANGE;
+      return false;
+    }
+    if (!bindValue(i, mxGetFieldByNumber(record, element, field)))
       return false;
   }
   return true;
 }
 
+bool Statement::bindValue(int index, const mxArray* value) {
+  if (!value)
+    code_ = sqlite3_bind_null(statement_, index);
+  else if (mxGetNumberOfElements(value) == 1 &&
+           (mxIsNumeric(value) || mxIsLogical(value))) {
+    if (mxIsDouble(value) || mxIsSingle(value))
+      code_ = sqlite3_bind_double(statement_, index, mxGetScalar(value));
+    else
+      code_ = bindElement(statement_, index, value, 0);
+  }
+  else if (mxIsChar(value)) {
+    string text;
+    appendUTF8(value, &text);
+    code_ = sqlite3_bind_text(statement_, index, text.data(), text.size(),
+                              SQLITE_TRANSIENT);
+  }
+  else if (mxIsUint8(value) || (mxIsNumeric(value) && !mxIsEmpty(value))) {
+    // Numeric arrays are bound as a blob of their raw bytes, e.g., uint8
+    // data or single vectors for vec_l2().
+    code_ = sqlite3_bind_blob(statement_,
+                              index,
+                              mxGetData(value),
+                              mxGetNumberOfElements(value) *
+                                  mxGetElementSize(value),
+                              SQLITE_STATIC);
+  }
+  else if (mxIsEmpty(value))
+    code_ = sqlite3_bind_null(statement_, index);
+  else {
+    stringstream message;
+    message << "Can't bind parameter " << index;
+    error_message_ = message.str();
+    code_ = SQLITE_MISMATCH;
+  }
+  return ok();
+}
+
+const string& Statement::errorMessage() const {
+  return error_message_;
+}
+
 bool Statement::ok() const {
   return code_ == SQLITE_OK;
 }
@@ -158,45 +566,72 @@ int Statement::columnType(int i) const {
   return sqlite3_column_type(statement_, i);
 }
 
-const Value& Statement::columnValue(int i) {
+void Statement::columnValue(int i, Column* column) const {
   // It is possible to directly create an mxArray* here. However, due to the
   // memory allocation pattern in Matlab, it is faster to keep the result into
   // a temporary storage and convert the values to mxArray* after we find
   // the number of rows.
-  switch (columnType(i)) {
-    case SQLITE_INTEGER: {
-      value_.first = SQLITE_INTEGER;
-      value_.second = static_cast<int64_t>(
-          sqlite3_column_int64(statement_, i));
+  const char* data = NULL;
+  Datum value = columnDatum(i, &data);
+  switch (value.type) {
+    case SQLITE_TEXT:
+    case SQLITE_BLOB: {
+      value.offset = column->data.size();
+      if (value.type == SQLITE_TEXT && column->encoded) {
+        // Keep one copy of each distinct text and refer to it by code.
+        pair<unordered_map<string, uint32_t>::iterator, bool> entry =
+            column->codes.insert(make_pair(string(data, value.size),
+                                           column->entries.size()));
+        if (entry.second) {
+          column->entries.push_back(value);
+          column->data.append(data, value.size);
+        }
+        value.offset = entry.first->second;
+        // Give up when the texts turn out to be mostly distinct.
+        size_t rows = column->values.size() + 1;
+        if (entry.second && rows >= kDictionaryMinRows &&
+            column->entries.size() > column->max_distinct * rows) {
+          column->values.push_back(value);
+          decodeColumn(column);
+          return;
+        }
+        break;
+      }
+      column->data.append(data, value.size);
       break;
     }
-    case SQLITE_FLOAT: {
-      value_.first = SQLITE_FLOAT;
-      value_.second = sqlite3_column_double(statement_, i);
+  }
+  column->values.push_back(value);
+}
+
+Datum Statement::columnDatum(int i, const char** data) const {
+  Datum value;
+  value.type = columnType(i);
+  value.size = 0;
+  value.integer = 0;
+  switch (value.type) {
+    case SQLITE_INTEGER: {
+      value.integer = sqlite3_column_int64(statement_, i);
       break;
     }
-    case SQLITE_TEXT: {
-      const char* data = reinterpret_cast<const char*>(
-          sqlite3_column_text(statement_, i));
-      value_.first = SQLITE_TEXT;
-      value_.second = string(data);
+    case SQLITE_FLOAT: {
+      value.real = sqlite3_column_double(statement_, i);
       break;
     }
+    case SQLITE_TEXT:
     case SQLITE_BLOB: {
-      const uint8_t* blob = reinterpret_cast<const uint8_t*>(
+      *data = reinterpret_cast<const char*>(
+          (value.type == SQLITE_TEXT) ?
+          sqlite3_column_text(statement_, i) :
           sqlite3_column_blob(statement_, i));
-      int bytes = sqlite3_column_bytes(statement_, i);
-      value_.first = SQLITE_BLOB;
-      value_.second = vector<uint8_t>(blob, blob + bytes);
-      break;
-    }
-    case SQLITE_NULL: {
-      value_.first = SQLITE_NULL;
-      value_.second = NullValue();
+      value.size = sqlite3_column_bytes(statement_, i);
+      // Empty blob is a null pointer.
+      if (!*data)
+        *data = "";
       break;
     }
   }
-  return value_;
+  return value;
 }
 
 StatementCache::StatementCache() :
@@ -231,7 +666,212 @@ void StatementCache::clear() {
   fifo_.clear();
 }
 
-Database::Database() : database_(NULL) {}
+ResultCache::ResultCache() : capacity_(0), bytes_(0), hits_(0),
+    misses_(0), evictions_(0) {}
+
+ResultCache::~ResultCache() {
+  clear();
+}
+
+void ResultCache::setCapacity(size_t capacity) {
+  if (capacity_ == 0)
+    hits_ = misses_ = evictions_ = 0;
+  capacity_ = capacity;
+  if (capacity_ == 0)
+    clear();
+  else
+    evict(capacity_);
+}
+
+const mxArray* ResultCache::get(const string& key,
+                                const DatabaseVersion& version) {
+  unordered_map<string, list<Entry>::iterator>::iterator entry =
+      table_.find(key);
+  if (entry != table_.end()) {
+    list<Entry>::iterator position = entry->second;
+    if (position->version.data_version == version.data_version &&
+        position->version.schema_version == version.schema_version &&
+        position->version.total_changes == version.total_changes) {
+      entries_.splice(entries_.begin(), entries_, position);
+      ++hits_;
+      return position->result;
+    }
+    bytes_ -= position->bytes;
+    mxDestroyArray(position->result);
+    entries_.erase(position);
+    table_.erase(entry);
+  }
+  ++misses_;
+  return NULL;
+}
+
+void ResultCache::put(const string& key,
+                      const DatabaseVersion& version,
+                      const mxArray* result,
+                      size_t bytes) {
+  if (bytes > capacity_ || table_.count(key))
+    return;
+  evict(capacity_ - bytes);
+  Entry entry;
+  entry.key = key;
+  entry.version = version;
+  entry.result = mxDuplicateArray(result);
+  entry.bytes = bytes;
+  mexMakeArrayPersistent(entry.result);
+  entries_.push_front(entry);
+  table_[key] = entries_.begin();
+  bytes_ += bytes;
+}
+
+void ResultCache::clear() {
+  for (list<Entry>::iterator entry = entries_.begin();
+       entry != entries_.end(); ++entry)
+    mxDestroyArray(entry->result);
+  entries_.clear();
+  table_.clear();
+  bytes_ = 0;
+}
+
+ResultCacheStats ResultCache::stats() const {
+  ResultCacheStats stats;
+  stats.hits = hits_;
+  stats.misses = misses_;
+  stats.evictions = evictions_;
+  stats.entries = entries_.size();
+  stats.bytes = bytes_;
+  stats.capacity = capacity_;
+  return stats;
+}
+
+void ResultCache::evict(size_t capacity) {
+  while (!entries_.empty() && bytes_ > capacity) {
+    bytes_ -= entries_.back().bytes;
+    mxDestroyArray(entries_.back().result);
+    table_.erase(entries_.back().key);
+    entries_.pop_back();
+    ++evictions_;
+  }
+}
+
+ChangeLog::ChangeLog()
+    : pending_count_(0), committing_(false), first_(0), capacity_(0) {}
+
+void ChangeLog::setCapacity(size_t capacity) {
+  capacity_ = capacity;
+  if (capacity_ == 0) {
+    first_ = token();
+    committed_.clear();
+    pending_.clear();
+    pending_count_ = 0;
+    committing_ = false;
+  }
+  while (committed_.size() > capacity_) {
+    committed_.pop_front();
+    ++first_;
+  }
+}
+
+void ChangeLog::record(int operation, const char* table,
+                       sqlite3_int64 rowid) {
+  ++pending_count_;
+  // A transaction beyond the capacity only advances the numbers.
+  if (pending_count_ > capacity_) {
+    pending_.clear();
+    return;
+  }
+  unordered_map<string, uint32_t>::iterator code = table_codes_.find(table);
+  if (code == table_codes_.end()) {
+    code = table_codes_.insert(make_pair(string(table),
+                                         tables_.size())).first;
+    tables_.push_back(table);
+  }
+  Change change;
+  change.table = code->second;
+  change.operation = operation;
+  change.rowid = rowid;
+  pending_.push_back(change);
+}
+
+void ChangeLog::prepareCommit() {
+  committing_ = true;
+}
+
+void ChangeLog::commit() {
+  if (!committing_)
+    return;
+  if (pending_count_ > capacity_) {
+    first_ = token() + pending_count_;
+    committed_.clear();
+  }
+  else {
+    committed_.insert(committed_.end(), pending_.begin(), pending_.end());
+    while (committed_.size() > capacity_) {
+      committed_.pop_front();
+      ++first_;
+    }
+  }
+  pending_.clear();
+  pending_count_ = 0;
+  committing_ = false;
+}
+
+void ChangeLog::rollback() {
+  pending_.clear();
+  pending_count_ = 0;
+  committing_ = false;
+}
+
+bool ChangeLog::since(uint64_t token, vector<TableChanges>* changes) const {
+  changes->clear();
+  // Net operation of each row in the order of the changes.
+  map<pair<uint32_t, int64_t>, int> rows;
+  size_t start = (token > first_) ? token - first_ : 0;
+  for (size_t i = start; i < committed_.size(); ++i) {
+    const Change& change = committed_[i];
+    pair<uint32_t, int64_t> row(change.table, change.rowid);
+    map<pair<uint32_t, int64_t>, int>::iterator entry = rows.find(row);
+    if (entry == rows.end()) {
+      rows[row] = change.operation;
+      continue;
+    }
+    int previous = entry->second;
+    if (previous == SQLITE_INSERT && change.operation == SQLITE_DELETE)
+      rows.erase(entry);
+    else if (previous == SQLITE_DELETE && change.operation == SQLITE_INSERT)
+      entry->second = SQLITE_UPDATE;
+    else if (previous != SQLITE_INSERT)
+      entry->second = change.operation;
+  }
+  for (map<pair<uint32_t, int64_t>, int>::const_iterator row = rows.begin();
+       row != rows.end(); ++row) {
+    const string& name = tables_[row->first.first];
+    if (changes->empty() || changes->back().table != name) {
+      changes->push_back(TableChanges());
+      changes->back().table = name;
+    }
+    TableChanges* table = &changes->back();
+    if (row->second == SQLITE_INSERT)
+      table->inserted.push_back(row->first.second);
+    else if (row->second == SQLITE_UPDATE)
+      table->updated.push_back(row->first.second);
+    else
+      table->deleted.push_back(row->first.second);
+  }
+  return token >= first_;
+}
+
+Database::Database() : query_active_(false), query_interrupted_(false),
+    query_deadline_active_(false), group_rows_(0),
+    group_milliseconds_(0), group_open_(false), group_changes_(0),
+    group_stopping_(false), busy_stats_(),
+    busy_random_(static_cast<unsigned>(
+        reinterpret_cast<uintptr_t>(this) ^
+        chrono::steady_clock::now().time_since_epoch().count())),
+    checkpoint_database_(NULL), checkpoint_stats_(),
+    checkpoint_stopping_(false), warm_stopping_(false), warm_active_(false),
+    bulk_loading_(false),
+    bulk_synchronous_(0),
+    bulk_cache_size_(0), database_(NULL) {}
 
 Database::~Database() {
   close();
@@ -241,12 +881,39 @@ bool Database::open(const string& filename, int flags) {
   return sqlite3_open_v2(filename.c_str(),
                          &database_,
                          flags,
-                         NULL) == SQLITE_OK;
+                         NULL) == SQLITE_OK &&
+         (sqlite3_progress_handler(database_,
+                                   kProgressInterval,
+                                   &Database::progressHandler,
+                                   this), true) &&
+         registerVectorFunctions(database_) &&
+         registerAnnModule(database_);
+}
+
+bool Database::configure(const vector<string>& pragmas) {
+  lock_guard<mutex> lock(mutex_);
+  clearError();
+  for (size_t i = 0; i < pragmas.size(); ++i) {
+    string sql("PRAGMA " + pragmas[i]);
+    if (sqlite3_exec(database_, sql.c_str(), NULL, NULL, NULL) != SQLITE_OK) {
+      setErrorMessage(string(sqlite3_errmsg(database_)) + " in " + sql);
+      return false;
+    }
+  }
+  return sqlite3_exec(database_, "SELECT count(*) FROM sqlite_master",
+                      NULL, NULL, NULL) == SQLITE_OK;
 }
 
 void Database::close() {
   if (database_) {
+    stopCheckpoint();
+    stopWarm();
+    stopGroupCommit();
+    endGroup(0, true);
+    while (!sessions_.empty())
+      deleteSession(sessions_.begin()->first);
     statement_cache_.clear();
+    result_cache_.clear();
     sqlite3_close(database_);
     database_ = NULL;
   }
@@ -257,134 +924,2110 @@ int Database::errorCode() const {
 }
 
 const char* Database::errorMessage() const {
-  return sqlite3_errmsg(database_);
+  return (error_message_.empty()) ?
+      sqlite3_errmsg(database_) : error_message_.c_str();
 }
 
-bool Database::execute(const string& statement_string,
-                       const vector<const mxArray*>& params,
-                       mxArray** result) {
-  if (!result)
-    return false;
-  Statement* statement = statement_cache_.get(statement_string, database_);
-  if (!statement || !statement->reset() || !statement->bind(params))
-    return false;
-  vector<Column> columns;
-  bool first_row = true;
-  while (statement->step()) {
-    if (first_row) {
-      createColumns(*statement, &columns);
-      first_row = false;
-    }
-    for (int i = 0; i < statement->columnCount(); ++i)
-      columns[i].values.push_back(statement->columnValue(i));
+const char* Database::errorId() const {
+  return (error_id_.empty()) ? "sqlite3:error" : error_id_.c_str();
+}
+
+void Database::setErrorMessage(const string& message) {
+  error_message_ = message;
+}
+
+void Database::setError(const string& id, const string& message) {
+  error_id_ = id;
+  error_message_ = message;
+}
+
+void Database::clearError() {
+  error_message_.clear();
+  error_id_.clear();
+}
+
+// Scope of a query enforcing the limits and polling the interrupt in the
+// progress handler.
+class Database::QueryScope {
+public:
+  QueryScope(Database* database, const QueryLimits& limits) :
+      database_(database) {
+    database_->startQuery(limits);
   }
-  // TODO: check if the columns are valid.
-  return statement->done() && convertColumnsToArray(&columns, result);
+  ~QueryScope() { database_->finishQuery(); }
+
+private:
+  Database* database_;
+};
+
+void Database::startQuery(const QueryLimits& limits) {
+  query_start_ = chrono::steady_clock::now();
+  query_active_ = true;
+  query_interrupted_ = false;
+  query_deadline_active_ = limits.deadline > 0;
+  if (query_deadline_active_)
+    query_deadline_ = query_start_ + chrono::duration_cast<
+        chrono::steady_clock::duration>(
+            chrono::duration<double>(limits.deadline));
 }
 
-bool Database::busyTimeout(int milliseconds) {
-  return sqlite3_busy_timeout(database_, milliseconds) == SQLITE_OK;
+void Database::finishQuery() {
+  query_active_ = false;
+  query_deadline_active_ = false;
 }
 
-void Database::createColumns(const Statement& statement,
-                             vector<Column>* columns) const {
-  columns->resize(statement.columnCount());
-  set<string> unique_names;
-  for (int i = 0; i < statement.columnCount(); ++i) {
-    // Clean the column name.
-    static const regex leading_non_alphabets("^[^a-zA-Z]+");
-    static const regex non_alphanumerics("[^a-zA-Z0-9]+");
-    string name(statement.columnName(i));
-    name = regex_replace(name, leading_non_alphabets, string(""));
-    name = regex_replace(name, non_alphanumerics, string(" "));
-    name.erase(0, name.find_first_not_of(' '));
-    name.erase(name.find_last_not_of(' ') + 1);
-    replace(name.begin(), name.end(), ' ', '_');
-    transform(name.begin(), name.end(), name.begin(), ::tolower);
-    if (name.empty())
-      name = "field";
-    // Ensure name fits in MATLAB 63-char limit. This truncates and leaves 1 character buffer for up to 10 name collisions below
-    if (name.length() > 62) {
-      name.resize(62);
-    }
-    // Find a unique name for the duplicated column.
-    int index = 0;
-    string original_name(name);
-    while (unique_names.find(name) != unique_names.end()) {
-      stringstream name_builder(stringstream::in | stringstream::out);
-      name_builder << original_name << ++index;
-      name = name_builder.str();
-    }
-    unique_names.insert(name);
-    (*columns)[i].name = name;
+int Database::progressHandler(void* database) {
+  // Statements outside of a query, e.g., the commit on the group commit
+  // thread, run to completion.
+  Database* self = static_cast<Database*>(database);
+  if (self->warm_active_)
+    return self->warm_stopping_ ||
+           chrono::steady_clock::now() >= self->warm_deadline_;
+  if (!self->query_active_)
+    return 0;
+  if (utIsInterruptPending()) {
+    utSetInterruptPending(false);
+    self->query_interrupted_ = true;
+    return 1;
   }
+  return self->query_deadline_active_ &&
+         chrono::steady_clock::now() >= self->query_deadline_;
 }
 
-bool Database::convertColumnsToArray(vector<Column>* columns,
-                                     mxArray** array) const {
-  if (array == NULL)
-    return false;
-  if (columns->empty()) {
-    *array = mxCreateStructMatrix(0, 0, 0, NULL);
+void Database::updateHook(void* database,
+                          int operation,
+                          const char* schema,
+                          const char* table,
+                          sqlite3_int64 rowid) {
+  // Hooks run in a statement of the connection, under the mutex.
+  Database* self = static_cast<Database*>(database);
+  if (strcmp(schema, "main") == 0)
+    self->change_log_.record(operation, table, rowid);
+  else
+    self->change_log_.record(operation,
+                             (string(schema) + "." + table).c_str(),
+                             rowid);
+}
+
+int Database::commitHook(void* database) {
+  // The commit may still fail, e.g., by a busy lock, and leave the
+  // transaction open. The changes are kept once no transaction is open.
+  static_cast<Database*>(database)->change_log_.prepareCommit();
+  return 0;
+}
+
+void Database::rollbackHook(void* database) {
+  static_cast<Database*>(database)->change_log_.rollback();
+}
+
+void Database::traceHook(void* database, const char*) {
+  Database* self = static_cast<Database*>(database);
+  if (sqlite3_get_autocommit(self->database_))
+    self->change_log_.commit();
+}
+
+int Database::busyHandler(void* database, int count) {
+  // The handler runs in a statement of the connection, under the mutex.
+  Database* self = static_cast<Database*>(database);
+  const BusyPolicy& policy = self->busy_policy_;
+  BusyStats& stats = self->busy_stats_;
+  chrono::steady_clock::time_point now = chrono::steady_clock::now();
+  if (count == 0) {
+    ++stats.events;
+    self->busy_start_ = now;
   }
-  else {
-    vector<const char*> fieldnames;
-    fieldnames.reserve(columns->size());
-    for (vector<Column>::iterator it = columns->begin();
-         it != columns->end(); ++it)
-      fieldnames.push_back(it->name.c_str());
-    *array = mxCreateStructMatrix(1, (*columns)[0].values.size(),
-                                  columns->size(), &fieldnames[0]);
-    for (size_t i = 0; i < columns->size(); ++i){
-      deque<Value>* values = &(*columns)[i].values;
-      mwSize j = 0;
-      while (!values->empty()) {
-        mxArray* element = convertValueToArray(values->front());
-        mxSetFieldByNumber(*array, j++, i, element);
-        values->pop_front();
+  double waited = chrono::duration<double, milli>(
+      now - self->busy_start_).count();
+  // Waiting stops on Ctrl-C and past the deadline of the query.
+  bool stopped =
+      (self->query_active_ && utIsInterruptPending()) ||
+      (self->query_deadline_active_ && now >= self->query_deadline_);
+  if (stopped || waited >= policy.max_wait) {
+    ++stats.failures;
+    return 0;
+  }
+  double delay = min(policy.max_delay,
+                     ldexp(policy.initial_delay, min(count, 30)));
+  delay *= 1.0 - policy.jitter *
+      uniform_real_distribution<double>(0.0, 1.0)(self->busy_random_);
+  delay = min(delay, policy.max_wait - waited);
+  this_thread::sleep_for(chrono::microseconds(
+      static_cast<int64_t>(delay * 1000)));
+  chrono::steady_clock::time_point end = chrono::steady_clock::now();
+  ++stats.retries;
+  stats.wait_seconds += chrono::duration<double>(end - now).count();
+  stats.longest_seconds = max(
+      stats.longest_seconds,
+      chrono::duration<double>(end - self->busy_start_).count());
+  return 1;
+}
+
+void Database::setQueryError(const char* id,
+                             const string& reason,
+                             size_t rows,
+                             size_t bytes) {
+  stringstream message;
+  message << reason << " after " << rows << " rows, " << bytes
+          << " bytes staged, "
+          << chrono::duration<double>(
+                 chrono::steady_clock::now() - query_start_).count()
+          << " seconds";
+  setError(id, message.str());
+}
+
+void Database::setInterruptError(const QueryLimits& limits,
+                                 size_t rows,
+                                 size_t bytes) {
+  if (query_interrupted_)
+    setQueryError("sqlite3:interrupted", "Query interrupted", rows, bytes);
+  else if (query_deadline_active_ &&
+           chrono::steady_clock::now() >= query_deadline_) {
+    stringstream reason;
+    reason << "Query stopped at Deadline " << limits.deadline;
+    setQueryError("sqlite3:deadline", reason.str(), rows, bytes);
+  }
+}
+
+bool Database::bind(Statement* statement,
+                    const vector<const mxArray*>& params) {
+  if (statement->bind(params))
+    return true;
+  if (!statement->errorMessage().empty())
+    setErrorMessage(statement->errorMessage());
+  return false;
+}
+
+bool Database::execute(const string& statement_string,
+                       const vector<const mxArray*>& params,
+                       mxArray** result) {
+  if (!result)
+    return false;
+  ExecuteOptions options;
+  vector<Column> columns;
+  ColumnarWriter spill;
+  // Results of read-only queries are cached by the SQL, the parameters,
+  // and the options.
+  string key;
+  DatabaseVersion version;
+  bool cacheable = false;
+  {
+    lock_guard<mutex> lock(mutex_);
+    clearError();
+    // The version is taken first as its statements may push the statement
+    // out of the statement cache.
+    if (result_cache_.capacity() > 0 && !databaseVersion(&version))
+      return false;
+    Statement* statement = statement_cache_.get(statement_string, database_);
+    if (!statement)
+      return false;
+    options.limits = limits_;
+    vector<const mxArray*> values(params);
+    if (!parseOptions(statement, &values, &options))
+      return false;
+    // Results in a transaction may include changes that are rolled back
+    // later without changing the version, so they bypass the cache.
+    if (result_cache_.capacity() > 0 && options.spill_threshold == 0 &&
+        sqlite3_get_autocommit(database_) && isCacheable(statement)) {
+      key = statement_string;
+      key.push_back('\0');
+      cacheable = true;
+      for (size_t i = 0; cacheable && i < params.size(); ++i)
+        cacheable = appendCacheKey(params[i], &key);
+      const mxArray* cached = (cacheable) ?
+          result_cache_.get(key, version) : NULL;
+      if (cached) {
+        *result = mxDuplicateArray(cached);
+        return true;
       }
     }
+    QueryScope scope(this, options.limits);
+    if (!statement->reset() || !beginGroup(statement) ||
+        !bind(statement, values))
+      return false;
+    int changes = sqlite3_total_changes(database_);
+    bool success = fetchColumns(statement, options, &columns, &spill);
+    if (!endGroup(sqlite3_total_changes(database_) - changes, false) ||
+        !success)
+      return false;
+  }
+  // The spilled result is returned as the file name.
+  if (!spill.filename().empty()) {
+    *result = mxCreateString(spill.filename().c_str());
+    return true;
+  }
+  size_t bytes = 0;
+  for (size_t i = 0; cacheable && i < columns.size(); ++i)
+    bytes += columns[i].data.size() +
+             (columns[i].values.size() + columns[i].entries.size()) *
+                 sizeof(Datum);
+  // The conversion may raise a matlab error, so it runs after the
+  // connection is released.
+  if (!convertColumnsToArray(&columns, options, result))
+    return false;
+  if (cacheable) {
+    lock_guard<mutex> lock(mutex_);
+    result_cache_.put(key, version, *result, bytes);
   }
   return true;
 }
 
-mxArray* Database::convertValueToArray(const Value& value) const {
+bool Database::exportColumns(const string& statement_string,
+                             const vector<const mxArray*>& params,
+                             const string& filename,
+                             uint64_t* rows) {
+  lock_guard<mutex> lock(mutex_);
+  clearError();
+  Statement* statement = statement_cache_.get(statement_string, database_);
+  if (!statement)
+    return false;
+  ExecuteOptions options;
+  options.limits = limits_;
+  vector<const mxArray*> values(params);
+  if (!parseOptions(statement, &values, &options))
+    return false;
+  QueryScope scope(this, options.limits);
+  if (!statement->reset() || !beginGroup(statement) ||
+      !bind(statement, values))
+    return false;
+  int changes = sqlite3_total_changes(database_);
+  ColumnarWriter writer;
+  bool success = writeColumns(statement, options.limits, filename, &writer);
+  if (!endGroup(sqlite3_total_changes(database_) - changes, false) ||
+      !success)
+    return false;
+  *rows = writer.rows();
+  return true;
+}
+
+bool Database::exportArrow(const string& statement_string,
+                           const vector<const mxArray*>& params,
+                           const string& filename,
+                           const ArrowOptions& arrow_options,
+                           uint64_t* rows) {
+  lock_guard<mutex> lock(mutex_);
+  clearError();
+  Statement* statement = statement_cache_.get(statement_string, database_);
+  if (!statement)
+    return false;
+  ExecuteOptions options;
+  options.limits = limits_;
+  vector<const mxArray*> values(params);
+  if (!parseOptions(statement, &values, &options))
+    return false;
+  QueryScope scope(this, options.limits);
+  if (!statement->reset() || !beginGroup(statement) ||
+      !bind(statement, values))
+    return false;
+  int changes = sqlite3_total_changes(database_);
+  ArrowWriter writer;
+  bool success = writeArrow(statement, options.limits, filename,
+                            arrow_options, &writer);
+  if (!endGroup(sqlite3_total_changes(database_) - changes, false) ||
+      !success)
+    return false;
+  *rows = writer.rows();
+  return true;
+}
+
+bool Database::exportCSV(const string& statement_string,
+                         const vector<const mxArray*>& params,
+                         const string& filename,
+                         const CSVOptions& csv_options,
+                         uint64_t* rows) {
+  lock_guard<mutex> lock(mutex_);
+  clearError();
+  Statement* statement = statement_cache_.get(statement_string, database_);
+  if (!statement)
+    return false;
+  ExecuteOptions options;
+  options.limits = limits_;
+  vector<const mxArray*> values(params);
+  if (!parseOptions(statement, &values, &options))
+    return false;
+  QueryScope scope(this, options.limits);
+  if (!statement->reset() || !beginGroup(statement) ||
+      !bind(statement, values))
+    return false;
+  int changes = sqlite3_total_changes(database_);
+  bool success = writeCSV(statement, options.limits, filename, csv_options,
+                          rows);
+  return endGroup(sqlite3_total_changes(database_) - changes, false) &&
+         success;
+}
+
+bool Database::writeCSV(Statement* statement,
+                        const QueryLimits& limits,
+                        const string& filename,
+                        const CSVOptions& options,
+                        uint64_t* rows) {
+  CSVWriter writer;
+  if (!writer.open(filename, options)) {
+    setError("sqlite3:export", writer.errorMessage());
+    return false;
+  }
+  int count = sqlite3_column_count(statement->get());
+  if (options.header) {
+    vector<string> names;
+    for (int i = 0; i < count; ++i)
+      names.push_back(sqlite3_column_name(statement->get(), i));
+    if (!writer.writeHeader(names)) {
+      setError("sqlite3:export", writer.errorMessage());
+      return false;
+    }
+  }
+  // Rows go from the statement to the buffer without staging.
+  *rows = 0;
+  while (statement->step()) {
+    if (limits.max_rows > 0 && *rows >= static_cast<uint64_t>(limits.max_rows)) {
+      stringstream reason;
+      reason << "Query stopped at MaxRows " << limits.max_rows;
+      setQueryError("sqlite3:maxRows", reason.str(), *rows, 0);
+      statement->reset();
+      return false;
+    }
+    ++*rows;
+    for (int i = 0; i < count; ++i) {
+      const char* data = NULL;
+      Datum value = statement->columnDatum(i, &data);
+      writer.appendValue(value, data);
+    }
+    if (!writer.endRow()) {
+      setQueryError("sqlite3:export", writer.errorMessage(), *rows, 0);
+      statement->reset();
+      return false;
+    }
+  }
+  if (statement->code() == SQLITE_INTERRUPT) {
+    setInterruptError(limits, *rows, 0);
+    statement->reset();
+    return false;
+  }
+  if (!statement->done())
+    return false;
+  if (!writer.finish()) {
+    setQueryError("sqlite3:export", writer.errorMessage(), *rows, 0);
+    return false;
+  }
+  return true;
+}
+
+bool Database::importCSV(const string& table,
+                         const string& filename,
+                         const CSVOptions& options,
+                         uint64_t* rows) {
+  // The file is mapped, split, and sampled before taking the connection.
+  CSVParser parser;
+  bool opened = parser.open(filename, options);
+  lock_guard<mutex> lock(mutex_);
+  clearError();
+  if (!opened) {
+    setError("sqlite3:import", parser.errorMessage());
+    return false;
+  }
+  bool exists = false;
+  vector<int> types(parser.types());
+  if (!matchTable(table, parser, options, &exists, &types))
+    return false;
+  QueryScope scope(this, limits_);
+  if (!beginGroup(NULL))
+    return false;
+  int changes = sqlite3_total_changes(database_);
+  // Use a savepoint when the caller already opened a transaction.
+  bool nested = !sqlite3_get_autocommit(database_);
+  if (sqlite3_exec(database_,
+                   (nested) ? "SAVEPOINT sqlite3mex_import" : "BEGIN IMMEDIATE",
+                   NULL, NULL, NULL) != SQLITE_OK)
+    return false;
+  parser.start(types);
+  bool success = insertCSV(table, options, exists, nested, &parser, rows);
+  parser.stop();
+  if (!success) {
+    // Keep the message of the failure over the one of the rollback.
+    string id(error_id_);
+    string message(errorMessage());
+    sqlite3_exec(database_,
+                 (nested) ? "ROLLBACK TO sqlite3mex_import; "
+                            "RELEASE sqlite3mex_import" : "ROLLBACK",
+                 NULL, NULL, NULL);
+    setError(id, message);
+    return false;
+  }
+  if (sqlite3_exec(database_,
+                   (nested) ? "RELEASE sqlite3mex_import" : "COMMIT",
+                   NULL, NULL, NULL) != SQLITE_OK)
+    return false;
+  return endGroup(sqlite3_total_changes(database_) - changes, false);
+}
+
+bool Database::matchTable(const string& table,
+                          const CSVParser& parser,
+                          const CSVOptions& options,
+                          bool* exists,
+                          vector<int>* types) {
+  Statement statement;
+  if (!statement.prepare("PRAGMA table_info(" + quoteIdentifier(table) + ")",
+                         database_))
+    return false;
+  vector<string> names;
+  vector<int> declared_types;
+  while (statement.step()) {
+    names.push_back(reinterpret_cast<const char*>(
+        sqlite3_column_text(statement.get(), 1)));
+    declared_types.push_back(columnarType(reinterpret_cast<const char*>(
+        sqlite3_column_text(statement.get(), 2))));
+  }
+  if (!statement.done())
+    return false;
+  *exists = !names.empty();
+  if (!*exists)
+    return true;
+  const vector<string>& columns = parser.names();
+  if (!options.header && columns.size() != names.size()) {
+    stringstream message;
+    message << "File has " << columns.size() << " columns but table " << table
+            << " has " << names.size();
+    setError("sqlite3:import", message.str());
+    return false;
+  }
+  // Values follow the affinity of the table, and the sample without it.
+  for (size_t i = 0; i < columns.size(); ++i) {
+    size_t index = i;
+    if (options.header) {
+      for (index = 0; index < names.size(); ++index)
+        if (sqlite3_stricmp(names[index].c_str(), columns[i].c_str()) == 0)
+          break;
+      if (index == names.size()) {
+        setError("sqlite3:import",
+                 "Column " + columns[i] + " not found in table " + table);
+        return false;
+      }
+    }
+    if (declared_types[index])
+      (*types)[i] = declared_types[index];
+  }
+  return true;
+}
+
+bool Database::insertCSV(const string& table,
+                         const CSVOptions& options,
+                         bool exists,
+                         bool nested,
+                         CSVParser* parser,
+                         uint64_t* rows) {
+  const vector<string>& columns = parser->names();
+  stringstream sql;
+  if (!exists) {
+    sql << "CREATE TABLE " << quoteIdentifier(table) << " (";
+    for (size_t i = 0; i < columns.size(); ++i)
+      sql << ((i) ? ", " : "") << quoteIdentifier(columns[i]) << " "
+          << declaredType(parser->types()[i]);
+    sql << ")";
+    if (sqlite3_exec(database_, sql.str().c_str(), NULL, NULL, NULL) !=
+        SQLITE_OK)
+      return false;
+    sql.str("");
+  }
+  sql << "INSERT INTO " << quoteIdentifier(table);
+  if (options.header) {
+    sql << " (";
+    for (size_t i = 0; i < columns.size(); ++i)
+      sql << ((i) ? ", " : "") << quoteIdentifier(columns[i]);
+    sql << ")";
+  }
+  sql << " VALUES (";
+  for (size_t i = 0; i < columns.size(); ++i)
+    sql << ((i) ? ", ?" : "?");
+  sql << ")";
+  Statement statement;
+  if (!statement.prepare(sql.str(), database_))
+    return false;
+  sqlite3_stmt* insert = statement.get();
+  *rows = 0;
+  CSVBlock block;
+  while (parser->next(&block)) {
+    for (size_t row = 0; row < block.rows; ++row) {
+      const Datum* values = &block.values[row * columns.size()];
+      for (size_t i = 0; i < columns.size(); ++i) {
+        const Datum& value = values[i];
+        int code = SQLITE_OK;
+        switch (value.type) {
+          case SQLITE_INTEGER:
+            code = sqlite3_bind_int64(insert, i + 1, value.integer);
+            break;
+          case SQLITE_FLOAT:
+            code = sqlite3_bind_double(insert, i + 1, value.real);
+            break;
+          case SQLITE_TEXT:
+            code = sqlite3_bind_text(insert, i + 1,
+                                     block.data.data() + value.offset,
+                                     value.size, SQLITE_STATIC);
+            break;
+          default:
+            code = sqlite3_bind_null(insert, i + 1);
+        }
+        if (code != SQLITE_OK)
+          return false;
+      }
+      statement.step();
+      if (statement.code() == SQLITE_INTERRUPT) {
+        setInterruptError(limits_, *rows, 0);
+        return false;
+      }
+      if (!statement.done()) {
+        stringstream message;
+        message << errorMessage() << " at row " << (*rows + 1);
+        setErrorMessage(message.str());
+        return false;
+      }
+      if (!statement.reset())
+        return false;
+      ++*rows;
+      if (!nested && options.batch_rows > 0 &&
+          *rows % options.batch_rows == 0 &&
+          sqlite3_exec(database_, "COMMIT; BEGIN IMMEDIATE", NULL, NULL,
+                       NULL) != SQLITE_OK)
+        return false;
+    }
+    if (!block.error.empty()) {
+      stringstream message;
+      message << block.error << " at row " << (*rows + 1);
+      setError("sqlite3:import", message.str());
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Database::insert(const string& table,
+                      const mxArray* data,
+                      bool columns,
+                      uint64_t* rows) {
+  lock_guard<mutex> lock(mutex_);
+  clearError();
+  *rows = 0;
+  int num_fields = (mxIsStruct(data)) ? mxGetNumberOfFields(data) : 0;
+  if (num_fields == 0 || (columns && mxGetNumberOfElements(data) != 1)) {
+    setError("sqlite3:insert", (columns) ?
+        "Columns must be a scalar struct of column arrays" :
+        "Rows must be a struct array with fields");
+    return false;
+  }
+  size_t num_rows = mxGetNumberOfElements(data);
+  if (columns) {
+    for (int i = 0; i < num_fields; ++i) {
+      const mxArray* column = mxGetFieldByNumber(data, 0, i);
+      size_t size = (column) ? mxGetNumberOfElements(column) : 0;
+      if (!column || (!mxIsCell(column) && !mxIsLogical(column) &&
+                      (!mxIsNumeric(column) || mxIsComplex(column))) ||
+          (i > 0 && size != num_rows)) {
+        setError("sqlite3:insert",
+                 string("Invalid column: ") + mxGetFieldNameByNumber(data, i));
+        return false;
+      }
+      num_rows = size;
+    }
+  }
+  // Fields are the columns and name the parameters.
+  stringstream sql;
+  sql << "INSERT INTO " << quoteIdentifier(table) << " (";
+  for (int i = 0; i < num_fields; ++i)
+    sql << ((i) ? ", " : "")
+        << quoteIdentifier(mxGetFieldNameByNumber(data, i));
+  sql << ") VALUES (";
+  for (int i = 0; i < num_fields; ++i)
+    sql << ((i) ? ", :" : ":") << mxGetFieldNameByNumber(data, i);
+  sql << ")";
+  Statement* statement = statement_cache_.get(sql.str(), database_);
+  if (!statement || !statement->reset())
+    return false;
+  vector<int> indices(num_fields);
+  for (int i = 0; i < num_fields; ++i) {
+    string parameter(":");
+    parameter += mxGetFieldNameByNumber(data, i);
+    indices[i] = sqlite3_bind_parameter_index(statement->get(),
+                                              parameter.c_str());
+  }
+  QueryScope scope(this, limits_);
+  if (!beginGroup(NULL))
+    return false;
+  int changes = sqlite3_total_changes(database_);
+  // Use a savepoint when the caller already opened a transaction.
+  bool nested = !sqlite3_get_autocommit(database_);
+  if (sqlite3_exec(database_,
+                   (nested) ? "SAVEPOINT sqlite3mex_insert" : "BEGIN IMMEDIATE",
+                   NULL, NULL, NULL) != SQLITE_OK)
+    return false;
+  bool success = insertRows(statement, data, columns, indices, num_rows, rows);
+  statement->reset();
+  if (!success) {
+    // Keep the message of the failure over the one of the rollback.
+    string id(error_id_);
+    string message(errorMessage());
+    sqlite3_exec(database_,
+                 (nested) ? "ROLLBACK TO sqlite3mex_insert; "
+                            "RELEASE sqlite3mex_insert" : "ROLLBACK",
+                 NULL, NULL, NULL);
+    setError(id, message);
+    *rows = 0;
+    return false;
+  }
+  if (sqlite3_exec(database_,
+                   (nested) ? "RELEASE sqlite3mex_insert" : "COMMIT",
+                   NULL, NULL, NULL) != SQLITE_OK)
+    return false;
+  return endGroup(sqlite3_total_changes(database_) - changes, false);
+}
+
+bool Database::insertRows(Statement* statement,
+                          const mxArray* data,
+                          bool columns,
+                          const vector<int>& indices,
+                          size_t num_rows,
+                          uint64_t* rows) {
+  sqlite3_stmt* insert = statement->get();
+  for (size_t row = 0; row < num_rows; ++row) {
+    for (size_t i = 0; i < indices.size(); ++i) {
+      bool bound = true;
+      if (!columns)
+        bound = statement->bindValue(indices[i],
+                                     mxGetFieldByNumber(data, row, i));
+      else {
+        const mxArray* column = mxGetFieldByNumber(data, 0, i);
+        if (mxIsCell(column))
+          bound = statement->bindValue(indices[i], mxGetCell(column, row));
+        else
+          bound = bindElement(insert, indices[i], column, row) == SQLITE_OK;
+      }
+      if (!bound) {
+        stringstream message;
+        message << ((statement->errorMessage().empty()) ?
+                    errorMessage() : statement->errorMessage().c_str())
+                << " of field " << mxGetFieldNameByNumber(data, i)
+                << " at row " << (row + 1);
+        setErrorMessage(message.str());
+        return false;
+      }
+    }
+    statement->step();
+    if (statement->code() == SQLITE_INTERRUPT) {
+      setInterruptError(limits_, *rows, 0);
+      return false;
+    }
+    if (!statement->done()) {
+      stringstream message;
+      message << errorMessage() << " at row " << (row + 1);
+      setErrorMessage(message.str());
+      return false;
+    }
+    if (!statement->reset())
+      return false;
+    ++*rows;
+  }
+  return true;
+}
+
+bool Database::executeScript(const string& script,
+                             const vector<const mxArray*>& params,
+                             mxArray** result) {
+  if (!result)
+    return false;
+  unique_lock<mutex> lock(mutex_);
+  clearError();
+  if (!beginGroup(NULL))
+    return false;
+  int changes = sqlite3_total_changes(database_);
+  // Use a savepoint when the caller already opened a transaction.
+  bool nested = !sqlite3_get_autocommit(database_);
+  if (sqlite3_exec(database_,
+                   (nested) ? "SAVEPOINT sqlite3mex_script" : "BEGIN",
+                   NULL, NULL, NULL) != SQLITE_OK)
+    return false;
+  const char* tail = script.c_str();
+  const char* end = tail + script.size();
+  size_t offset = 0;
+  int index = 0;
+  vector<Column> columns;
+  bool success = true;
+  ExecuteOptions options;
+  options.limits = limits_;
+  QueryScope scope(this, options.limits);
+  while (success && tail < end) {
+    Statement statement;
+    const char* head = tail;
+    success = statement.prepare(head, end - head, database_, &tail);
+    if (success && !statement.get())
+      continue;
+    ++index;
+    if (success) {
+      size_t count = sqlite3_bind_parameter_count(statement.get());
+      if (offset + count > params.size()) {
+        stringstream message;
+        message << "Too few parameters: " << params.size();
+        setErrorMessage(message.str());
+        success = false;
+      }
+      else {
+        vector<const mxArray*> statement_params(
+            params.begin() + offset, params.begin() + offset + count);
+        offset += count;
+        columns.clear();
+        success = bind(&statement, statement_params) &&
+                  fetchColumns(&statement, options, &columns, NULL);
+      }
+    }
+    if (!success) {
+      string text(head, (tail > head) ? tail - head : end - head);
+      text.erase(0, text.find_first_not_of(" \t\r\n"));
+      text.erase(text.find_last_not_of(" \t\r\n") + 1);
+      stringstream message;
+      message << "Statement " << index << " failed: " << errorMessage()
+              << ": " << text;
+      setError(error_id_, message.str());
+    }
+  }
+  if (success && offset != params.size()) {
+    stringstream message;
+    message << "Too many parameters: " << params.size() << " for " << offset
+            << ".";
+    setErrorMessage(message.str());
+    success = false;
+  }
+  if (!success) {
+    sqlite3_exec(database_,
+                 (nested) ? "ROLLBACK TO sqlite3mex_script; "
+                            "RELEASE sqlite3mex_script" : "ROLLBACK",
+                 NULL, NULL, NULL);
+    return false;
+  }
+  if (sqlite3_exec(database_,
+                   (nested) ? "RELEASE sqlite3mex_script" : "COMMIT",
+                   NULL, NULL, NULL) != SQLITE_OK)
+    return false;
+  if (!endGroup(sqlite3_total_changes(database_) - changes, false))
+    return false;
+  // The conversion may raise a matlab error, so it runs after the
+  // connection is released.
+  finishQuery();
+  lock.unlock();
+  return convertColumnsToArray(&columns, ExecuteOptions(), result);
+}
+
+bool Database::fetchColumns(Statement* statement,
+                            const ExecuteOptions& options,
+                            vector<Column>* columns,
+                            ColumnarWriter* spill) {
+  createColumns(*statement, columns);
+  const QueryLimits& limits = options.limits;
+  size_t rows = 0;
+  size_t bytes = 0;
+  // Dictionary encoding applies to the table format.
+  if (options.format == kFormatTable &&
+      options.dictionary != kDictionaryOff) {
+    for (size_t i = 0; i < columns->size(); ++i) {
+      (*columns)[i].encoded = true;
+      (*columns)[i].max_distinct = (options.dictionary == kDictionaryOn) ?
+          numeric_limits<double>::infinity() : options.dictionary_threshold;
+    }
+  }
+  while (statement->step()) {
+    ++rows;
+    if (limits.max_rows > 0 && rows > static_cast<size_t>(limits.max_rows)) {
+      stringstream reason;
+      reason << "Query stopped at MaxRows " << limits.max_rows;
+      setQueryError("sqlite3:maxRows", reason.str(), rows - 1, bytes);
+      statement->reset();
+      return false;
+    }
+    bytes = 0;
+    for (int i = 0; i < statement->columnCount(); ++i) {
+      Column* column = &(*columns)[i];
+      statement->columnValue(i, column);
+      bytes += column->data.size() + column->values.size() * sizeof(Datum);
+    }
+    if (spill && options.spill_threshold > 0 &&
+        bytes > static_cast<size_t>(options.spill_threshold)) {
+      if ((!spill->isOpen() &&
+           !openSpill(statement, options, columns, spill)) ||
+          !spill->append(columns)) {
+        setQueryError("sqlite3:spill", spill->errorMessage(), rows, bytes);
+        statement->reset();
+        return false;
+      }
+      bytes = 0;
+    }
+    if (limits.max_bytes > 0 && bytes > static_cast<size_t>(limits.max_bytes)) {
+      stringstream reason;
+      reason << "Query stopped at MaxBytes " << limits.max_bytes;
+      setQueryError("sqlite3:maxBytes", reason.str(), rows, bytes);
+      statement->reset();
+      return false;
+    }
+  }
+  if (statement->code() == SQLITE_INTERRUPT) {
+    setInterruptError(limits, rows, bytes);
+    // Reset the statement so that it stays usable in the cache.
+    statement->reset();
+    return false;
+  }
+  if (statement->done() && spill && spill->isOpen() &&
+      (!spill->append(columns) || !spill->finish())) {
+    setQueryError("sqlite3:spill", spill->errorMessage(), rows, bytes);
+    return false;
+  }
+  // TODO: check if the columns are valid.
+  return statement->done();
+}
+
+bool Database::openSpill(Statement* statement,
+                         const ExecuteOptions& options,
+                         vector<Column>* columns,
+                         ColumnarWriter* spill) {
+  vector<string> names;
+  vector<int> types;
+  for (size_t i = 0; i < columns->size(); ++i) {
+    // The file keeps the plain text values.
+    decodeColumn(&(*columns)[i]);
+    names.push_back((*columns)[i].original_name);
+    types.push_back(columnarType(
+        sqlite3_column_decltype(statement->get(), i)));
+  }
+  return spill->open((options.spill_file.empty()) ?
+                         temporaryFilename() : options.spill_file,
+                     names,
+                     types);
+}
+
+bool Database::writeColumns(Statement* statement,
+                            const QueryLimits& limits,
+                            const string& filename,
+                            ColumnarWriter* writer) {
+  int count = sqlite3_column_count(statement->get());
+  vector<string> names;
+  vector<int> types;
+  for (int i = 0; i < count; ++i) {
+    names.push_back(sqlite3_column_name(statement->get(), i));
+    types.push_back(columnarType(
+        sqlite3_column_decltype(statement->get(), i)));
+  }
+  if (!writer->open(filename, names, types)) {
+    setError("sqlite3:export", writer->errorMessage());
+    return false;
+  }
+  // Values go from the statement to the file without staging the rows.
+  size_t rows = 0;
+  while (statement->step()) {
+    ++rows;
+    if (limits.max_rows > 0 && rows > static_cast<size_t>(limits.max_rows)) {
+      stringstream reason;
+      reason << "Query stopped at MaxRows " << limits.max_rows;
+      setQueryError("sqlite3:maxRows", reason.str(), rows - 1, 0);
+      statement->reset();
+      return false;
+    }
+    for (int i = 0; i < count; ++i) {
+      const char* data = NULL;
+      Datum value = statement->columnDatum(i, &data);
+      if (!writer->append(i, value, data)) {
+        setQueryError("sqlite3:export", writer->errorMessage(), rows, 0);
+        statement->reset();
+        return false;
+      }
+    }
+  }
+  if (statement->code() == SQLITE_INTERRUPT) {
+    setInterruptError(limits, rows, 0);
+    statement->reset();
+    return false;
+  }
+  if (!statement->done())
+    return false;
+  if (!writer->finish()) {
+    setQueryError("sqlite3:export", writer->errorMessage(), rows, 0);
+    return false;
+  }
+  return true;
+}
+
+bool Database::writeArrow(Statement* statement,
+                          const QueryLimits& limits,
+                          const string& filename,
+                          const ArrowOptions& arrow_options,
+                          ArrowWriter* writer) {
+  vector<Column> columns;
+  createColumns(*statement, &columns);
+  vector<string> names;
+  vector<int> types;
+  for (size_t i = 0; i < columns.size(); ++i) {
+    names.push_back(columns[i].original_name);
+    types.push_back(columnarType(
+        sqlite3_column_decltype(statement->get(), i)));
+  }
+  if (!writer->open(filename, arrow_options.file_format, names, types)) {
+    setError("sqlite3:export", writer->errorMessage());
+    return false;
+  }
+  // Rows are staged as in execute and written every batch.
+  size_t rows = 0;
+  size_t batch_rows = 0;
+  while (statement->step()) {
+    ++rows;
+    if (limits.max_rows > 0 && rows > static_cast<size_t>(limits.max_rows)) {
+      stringstream reason;
+      reason << "Query stopped at MaxRows " << limits.max_rows;
+      setQueryError("sqlite3:maxRows", reason.str(), rows - 1, 0);
+      statement->reset();
+      return false;
+    }
+    for (int i = 0; i < statement->columnCount(); ++i)
+      statement->columnValue(i, &columns[i]);
+    if (++batch_rows < static_cast<size_t>(arrow_options.batch_rows))
+      continue;
+    batch_rows = 0;
+    if (!writer->write(&columns)) {
+      setQueryError("sqlite3:export", writer->errorMessage(), rows, 0);
+      statement->reset();
+      return false;
+    }
+  }
+  if (statement->code() == SQLITE_INTERRUPT) {
+    setInterruptError(limits, rows, 0);
+    statement->reset();
+    return false;
+  }
+  if (!statement->done())
+    return false;
+  if (!writer->finish(&columns)) {
+    setQueryError("sqlite3:export", writer->errorMessage(), rows, 0);
+    return false;
+  }
+  return true;
+}
+
+bool Database::setOption(const string& name,
+                         const mxArray* value,
+                         ExecuteOptions* options) {
+  if (sqlite3_stricmp(name.c_str(), "DictionaryThreshold") == 0) {
+    if (!mxIsNumeric(value) || mxGetNumberOfElements(value) != 1 ||
+        mxGetScalar(value) < 0) {
+      setErrorMessage("DictionaryThreshold must be a non-negative scalar");
+      return false;
+    }
+    options->dictionary_threshold = mxGetScalar(value);
+    return true;
+  }
+  if (sqlite3_stricmp(name.c_str(), "SpillFile") == 0) {
+    options->spill_file = getOptionString(value);
+    if (options->spill_file.empty()) {
+      setErrorMessage("SpillFile must be a file name");
+      return false;
+    }
+    return true;
+  }
+  if (sqlite3_stricmp(name.c_str(), "MaxRows") == 0 ||
+      sqlite3_stricmp(name.c_str(), "MaxBytes") == 0 ||
+      sqlite3_stricmp(name.c_str(), "Deadline") == 0 ||
+      sqlite3_stricmp(name.c_str(), "SpillThreshold") == 0) {
+    if (!mxIsNumeric(value) || mxGetNumberOfElements(value) != 1 ||
+        mxGetScalar(value) < 0) {
+      setErrorMessage(name + " must be a non-negative scalar");
+      return false;
+    }
+    if (sqlite3_stricmp(name.c_str(), "MaxRows") == 0)
+      options->limits.max_rows = mxGetScalar(value);
+    else if (sqlite3_stricmp(name.c_str(), "MaxBytes") == 0)
+      options->limits.max_bytes = mxGetScalar(value);
+    else if (sqlite3_stricmp(name.c_str(), "SpillThreshold") == 0)
+      options->spill_threshold = mxGetScalar(value);
+    else
+      options->limits.deadline = mxGetScalar(value);
+    return true;
+  }
+  string option = getOptionString(value);
+  const char* text = option.c_str();
+  if (sqlite3_stricmp(name.c_str(), "Format") == 0) {
+    if (sqlite3_stricmp(text, "struct") == 0)
+      options->format = kFormatStruct;
+    else if (sqlite3_stricmp(text, "table") == 0)
+      options->format = kFormatTable;
+    else {
+      setErrorMessage("Invalid Format: " + option);
+      return false;
+    }
+  }
+  else if (sqlite3_stricmp(name.c_str(), "Dictionary") == 0) {
+    if (sqlite3_stricmp(text, "off") == 0)
+      options->dictionary = kDictionaryOff;
+    else if (sqlite3_stricmp(text, "on") == 0)
+      options->dictionary = kDictionaryOn;
+    else if (sqlite3_stricmp(text, "auto") == 0)
+      options->dictionary = kDictionaryAuto;
+    else {
+      setErrorMessage("Invalid Dictionary: " + option);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Database::parseOptions(Statement* statement,
+                            vector<const mxArray*>* params,
+                            ExecuteOptions* options) {
+  size_t num_binds = (statement->bindsByName(*params)) ?
+      1 : sqlite3_bind_parameter_count(statement->get());
+  // Anything else than complete name-value pairs of known options is left
+  // to bind() to report the wrong number of parameters.
+  if (params->size() <= num_binds || (params->size() - num_binds) % 2)
+    return true;
+  vector<string> names;
+  for (size_t i = num_binds; i < params->size(); i += 2) {
+    const mxArray* name = (*params)[i];
+    if (!mxIsChar(name))
+      return true;
+    char* name_string = mxArrayToString(name);
+    names.push_back((name_string) ? name_string : "");
+    mxFree(name_string);
+    if (!isOptionName(names.back()))
+      return true;
+  }
+  for (size_t i = 0; i < names.size(); ++i) {
+    if (!setOption(names[i], (*params)[num_binds + 2 * i + 1], options))
+      return false;
+  }
+  params->resize(num_binds);
+  return true;
+}
+
+bool Database::busyTimeout(int milliseconds) {
+  return sqlite3_busy_timeout(database_, milliseconds) == SQLITE_OK;
+}
+
+bool Database::setBusyHandler(const BusyPolicy& policy) {
+  lock_guard<mutex> lock(mutex_);
+  clearError();
+  if (policy.initial_delay < 0 || policy.max_delay < 0 ||
+      policy.max_wait < 0 || policy.jitter < 0 || policy.jitter > 1) {
+    setErrorMessage("Busy delays must be non-negative and the jitter "
+                    "between 0 and 1.");
+    return false;
+  }
+  busy_policy_ = policy;
+  return sqlite3_busy_handler(database_, &Database::busyHandler, this) ==
+         SQLITE_OK;
+}
+
+BusyStats Database::busyStats(bool reset) {
+  lock_guard<mutex> lock(mutex_);
+  BusyStats stats = busy_stats_;
+  if (reset)
+    busy_stats_ = BusyStats();
+  return stats;
+}
+
+bool Database::begin(const string& mode) {
+  lock_guard<mutex> lock(mutex_);
+  clearError();
+  if (mode != "deferred" && mode != "immediate" && mode != "exclusive") {
+    setErrorMessage("Invalid transaction mode: " + mode);
+    return false;
+  }
+  // An explicit transaction takes over the pending group commit.
+  if (!endGroup(0, true))
+    return false;
+  return executeControl(("BEGIN " + mode).c_str());
+}
+
+bool Database::commit() {
+  lock_guard<mutex> lock(mutex_);
+  clearError();
+  group_open_ = false;
+  return executeControl("COMMIT");
+}
+
+bool Database::rollback() {
+  lock_guard<mutex> lock(mutex_);
+  clearError();
+  // Writes buffered by the group commit were reported done, so they are
+  // committed, and there is no transaction of the caller to roll back.
+  if (group_open_) {
+    if (!endGroup(0, true))
+      return false;
+    setErrorMessage("cannot rollback - no transaction is active");
+    return false;
+  }
+  return executeControl("ROLLBACK");
+}
+
+bool Database::savepoint(const string& name) {
+  lock_guard<mutex> lock(mutex_);
+  clearError();
+  // A savepoint must not be committed by the group commit.
+  if (!endGroup(0, true))
+    return false;
+  char* sql = sqlite3_mprintf("SAVEPOINT \"%w\"", name.c_str());
+  bool success = executeControl(sql);
+  sqlite3_free(sql);
+  return success;
+}
+
+bool Database::release(const string& name) {
+  lock_guard<mutex> lock(mutex_);
+  clearError();
+  char* sql = sqlite3_mprintf("RELEASE \"%w\"", name.c_str());
+  bool success = executeControl(sql);
+  sqlite3_free(sql);
+  return success;
+}
+
+bool Database::rollbackTo(const string& name) {
+  lock_guard<mutex> lock(mutex_);
+  clearError();
+  char* sql = sqlite3_mprintf("ROLLBACK TO \"%w\"", name.c_str());
+  bool success = executeControl(sql);
+  sqlite3_free(sql);
+  return success;
+}
+
+bool Database::autoCheckpoint(const CheckpointPolicy& policy) {
+  stopCheckpoint();
+  lock_guard<mutex> lock(mutex_);
+  clearError();
+  if (policy.interval < 0 || policy.max_wal_size < 0 ||
+      policy.vacuum_pages < 0) {
+    setErrorMessage("Checkpoint settings must be non-negative.");
+    return false;
+  }
+  if (policy.interval == 0)
+    return true;
+  const char* filename = sqlite3_db_filename(database_, "main");
+  if (!filename || !*filename) {
+    setErrorMessage("Checkpoints need a database file.");
+    return false;
+  }
+  if (sqlite3_open_v2(filename, &checkpoint_database_,
+                      SQLITE_OPEN_READWRITE, NULL) != SQLITE_OK) {
+    setErrorMessage(string("Failed to open ") + filename + ": " +
+                    sqlite3_errmsg(checkpoint_database_));
+    sqlite3_close(checkpoint_database_);
+    checkpoint_database_ = NULL;
+    return false;
+  }
+  // A truncating checkpoint waits for readers up to the interval.
+  sqlite3_busy_timeout(checkpoint_database_, policy.interval);
+  checkpoint_policy_ = policy;
+  checkpoint_stopping_ = false;
+  checkpoint_thread_ = thread(&Database::runCheckpoint, this);
+  return true;
+}
+
+CheckpointStats Database::checkpointStats(bool reset) {
+  lock_guard<mutex> lock(checkpoint_mutex_);
+  CheckpointStats stats = checkpoint_stats_;
+  if (reset)
+    checkpoint_stats_ = CheckpointStats();
+  return stats;
+}
+
+bool Database::warm(const vector<string>& tables,
+                    bool page_cache,
+                    bool wait) {
+  stopWarm();
+  unique_lock<mutex> lock(mutex_);
+  clearError();
+  const char* filename = sqlite3_db_filename(database_, "main");
+  // The schema is warmed with the tables.
+  vector<uint32_t> root_pages(1, 1);
+  vector<pair<string, bool> > queries;
+  Statement select;
+  if (!select.prepare("SELECT type, name, tbl_name, rootpage "
+                      "FROM sqlite_master WHERE rootpage > 0 AND "
+                      "(?1 IS NULL OR tbl_name = ?1 COLLATE NOCASE)",
+                      database_))
+    return false;
+  for (size_t i = 0; i < max<size_t>(tables.size(), 1); ++i) {
+    if (!tables.empty())
+      sqlite3_bind_text(select.get(), 1, tables[i].c_str(), -1,
+                        SQLITE_TRANSIENT);
+    bool found = false;
+    while (select.step()) {
+      found = true;
+      string type(reinterpret_cast<const char*>(
+          sqlite3_column_text(select.get(), 0)));
+      string name(reinterpret_cast<const char*>(
+          sqlite3_column_text(select.get(), 1)));
+      string table_name(reinterpret_cast<const char*>(
+          sqlite3_column_text(select.get(), 2)));
+      root_pages.push_back(sqlite3_column_int(select.get(), 3));
+      // A scan of the rowids reads all pages of the table and resumes from
+      // the last rowid. Tables without rowid and indexes are counted, and
+      // index scans are forced by the WHERE clause, which count(*) does not
+      // optimize away.
+      string rowid_query("SELECT rowid FROM " + quoteIdentifier(table_name) +
+                         " NOT INDEXED WHERE rowid >= ?1");
+      Statement probe;
+      if (type == "table" && probe.prepare(rowid_query, database_))
+        queries.push_back(make_pair(rowid_query, true));
+      else if (type == "table")
+        queries.push_back(make_pair("SELECT count(*) FROM " +
+                                    quoteIdentifier(table_name) +
+                                    " NOT INDEXED", false));
+      else
+        queries.push_back(make_pair("SELECT count(*) FROM " +
+                                    quoteIdentifier(table_name) +
+                                    " INDEXED BY " + quoteIdentifier(name) +
+                                    " WHERE 1", false));
+    }
+    if (!select.done() || !select.reset())
+      return false;
+    if (!tables.empty() && !found) {
+      setErrorMessage("No such table: " + tables[i]);
+      return false;
+    }
+  }
+  select.finalize();
+  // In-memory and temporary databases have no file to read.
+  if (!filename || !*filename)
+    return true;
+  // The whole file is read when all tables are warmed in the OS cache.
+  if (page_cache || tables.empty())
+    root_pages.clear();
+  if (!page_cache)
+    queries.clear();
+  warm_stopping_ = false;
+  warm_thread_ = thread(&Database::runWarm, this, string(filename),
+                        root_pages, queries);
+  lock.unlock();
+  if (wait)
+    warm_thread_.join();
+  return true;
+}
+
+bool Database::groupCommit(int rows, int milliseconds) {
+  stopGroupCommit();
+  lock_guard<mutex> lock(mutex_);
+  clearError();
+  if (rows < 0 || milliseconds < 0) {
+    setErrorMessage("Group commit condition must be non-negative.");
+    return false;
+  }
+  group_rows_ = rows;
+  group_milliseconds_ = milliseconds;
+  if (milliseconds > 0) {
+    group_stopping_ = false;
+    group_thread_ = thread(&Database::runGroupCommit, this);
+  }
+  return endGroup(0, rows == 0 && milliseconds == 0);
+}
+
+void Database::setResultCacheCapacity(size_t capacity) {
+  lock_guard<mutex> lock(mutex_);
+  result_cache_.setCapacity(capacity);
+}
+
+void Database::clearResultCache() {
+  lock_guard<mutex> lock(mutex_);
+  result_cache_.clear();
+}
+
+ResultCacheStats Database::resultCacheStats() {
+  lock_guard<mutex> lock(mutex_);
+  return result_cache_.stats();
+}
+
+bool Database::databaseVersion(DatabaseVersion* version) {
+  Statement* data_version = statement_cache_.get("PRAGMA data_version",
+                                                 database_);
+  Statement* schema_version = statement_cache_.get("PRAGMA schema_version",
+                                                   database_);
+  if (!data_version || !schema_version || !data_version->reset() ||
+      !data_version->step() || !schema_version->reset() ||
+      !schema_version->step())
+    return false;
+  version->data_version = sqlite3_column_int64(data_version->get(), 0);
+  version->schema_version = sqlite3_column_int64(schema_version->get(), 0);
+  version->total_changes = sqlite3_total_changes(database_);
+  data_version->reset();
+  schema_version->reset();
+  return true;
+}
+
+void Database::trackChanges(size_t capacity, uint64_t* token) {
+  lock_guard<mutex> lock(mutex_);
+  bool enabled = change_log_.capacity() > 0;
+  if (sqlite3_get_autocommit(database_))
+    change_log_.commit();
+  change_log_.setCapacity(capacity);
+  if (capacity > 0 && !enabled) {
+    sqlite3_update_hook(database_, &Database::updateHook, this);
+    sqlite3_commit_hook(database_, &Database::commitHook, this);
+    sqlite3_rollback_hook(database_, &Database::rollbackHook, this);
+    sqlite3_trace(database_, &Database::traceHook, this);
+  }
+  else if (capacity == 0 && enabled) {
+    sqlite3_update_hook(database_, NULL, NULL);
+    sqlite3_commit_hook(database_, NULL, NULL);
+    sqlite3_rollback_hook(database_, NULL, NULL);
+    sqlite3_trace(database_, NULL, NULL);
+  }
+  *token = change_log_.token();
+}
+
+void Database::changesSince(uint64_t since,
+                            vector<TableChanges>* changes,
+                            bool* overflow,
+                            uint64_t* token) {
+  lock_guard<mutex> lock(mutex_);
+  if (sqlite3_get_autocommit(database_))
+    change_log_.commit();
+  *overflow = !change_log_.since(since, changes);
+  *token = change_log_.token();
+}
+
+bool Database::startSession(const vector<string>& tables, uint64_t* id) {
+  lock_guard<mutex> lock(mutex_);
+  clearError();
+#ifdef SQLITE_ENABLE_SESSION
+  sqlite3_session* session = NULL;
+  if (sqlite3session_create(database_, "main", &session) != SQLITE_OK)
+    return false;
+  int code = SQLITE_OK;
+  if (tables.empty())
+    code = sqlite3session_attach(session, NULL);
+  for (size_t i = 0; code == SQLITE_OK && i < tables.size(); ++i)
+    code = sqlite3session_attach(session, tables[i].c_str());
+  if (code != SQLITE_OK) {
+    sqlite3session_delete(session);
+    setError("sqlite3:session", sqlite3_errstr(code));
+    return false;
+  }
+  *id = next_session_id++;
+  sessions_[*id] = session;
+  return true;
+#else
+  setError("sqlite3:session", kNoSession);
+  return false;
+#endif
+}
+
+bool Database::hasSession(uint64_t id) const {
+  return sessions_.count(id) > 0;
+}
+
+bool Database::changeset(uint64_t id, bool patchset, string* changeset) {
+  lock_guard<mutex> lock(mutex_);
+  clearError();
+#ifdef SQLITE_ENABLE_SESSION
+  map<uint64_t, sqlite3_session*>::iterator session = sessions_.find(id);
+  if (session == sessions_.end()) {
+    setError("sqlite3:session", "Invalid session");
+    return false;
+  }
+  int size = 0;
+  void* data = NULL;
+  int code = (patchset) ?
+      sqlite3session_patchset(session->second, &size, &data) :
+      sqlite3session_changeset(session->second, &size, &data);
+  if (code != SQLITE_OK) {
+    setError("sqlite3:session", sqlite3_errstr(code));
+    return false;
+  }
+  changeset->assign(static_cast<const char*>(data), size);
+  sqlite3_free(data);
+  return true;
+#else
+  setError("sqlite3:session", kNoSession);
+  return false;
+#endif
+}
+
+void Database::endSession(uint64_t id) {
+  lock_guard<mutex> lock(mutex_);
+  deleteSession(id);
+}
+
+void Database::deleteSession(uint64_t id) {
+#ifdef SQLITE_ENABLE_SESSION
+  map<uint64_t, sqlite3_session*>::iterator session = sessions_.find(id);
+  if (session == sessions_.end())
+    return;
+  sqlite3session_delete(session->second);
+  sessions_.erase(session);
+#endif
+}
+
+bool Database::applyChangeset(const string& changeset,
+                              ConflictPolicy policy,
+                              int* conflicts) {
+  lock_guard<mutex> lock(mutex_);
+  clearError();
+#ifdef SQLITE_ENABLE_SESSION
+  if (!beginGroup(NULL))
+    return false;
+  int changes = sqlite3_total_changes(database_);
+  ConflictContext context;
+  context.policy = policy;
+  context.conflicts = 0;
+  // The changeset is applied in a savepoint and rolled back on abort.
+  int code = sqlite3changeset_apply(
+      database_, changeset.size(), const_cast<char*>(changeset.data()),
+      NULL, &resolveConflict, &context);
+  *conflicts = context.conflicts;
+  if (code == SQLITE_ABORT) {
+    stringstream message;
+    message << "Changeset aborted on conflict " << context.conflicts;
+    setError("sqlite3:session", message.str());
+    return false;
+  }
+  if (code != SQLITE_OK) {
+    // A malformed changeset does not set the message of the connection.
+    if (sqlite3_errcode(database_) != code)
+      setErrorMessage(sqlite3_errstr(code));
+    return false;
+  }
+  return endGroup(sqlite3_total_changes(database_) - changes, false);
+#else
+  setError("sqlite3:session", kNoSession);
+  return false;
+#endif
+}
+
+bool Database::beginBulkLoad(const vector<string>& tables,
+                             int64_t cache_bytes) {
+  lock_guard<mutex> lock(mutex_);
+  clearError();
+  if (bulk_loading_) {
+    setErrorMessage("Bulk load is already started");
+    return false;
+  }
+  if (!endGroup(0, true))
+    return false;
+  if (!sqlite3_get_autocommit(database_)) {
+    setErrorMessage("Bulk load can't start in a transaction");
+    return false;
+  }
+  if (!queryInteger("PRAGMA synchronous", &bulk_synchronous_) ||
+      !queryInteger("PRAGMA cache_size", &bulk_cache_size_))
+    return false;
+  // The definitions are kept in the transaction dropping the indexes, so a
+  // load that never ends can still restore them.
+  if (!executeControl("BEGIN IMMEDIATE"))
+    return false;
+  Statement select;
+  Statement record;
+  bool success =
+      sqlite3_exec(database_,
+                   "CREATE TABLE IF NOT EXISTS sqlite3mex_bulkload ("
+                   "name TEXT PRIMARY KEY, table_name TEXT, sql TEXT)",
+                   NULL, NULL, NULL) == SQLITE_OK &&
+      select.prepare("SELECT name, tbl_name, sql FROM sqlite_master "
+                     "WHERE type = 'index' AND sql IS NOT NULL AND "
+                     "tbl_name = ? COLLATE NOCASE", database_) &&
+      record.prepare("INSERT OR REPLACE INTO sqlite3mex_bulkload "
+                     "VALUES (?, ?, ?)", database_);
+  for (size_t i = 0; success && i < tables.size(); ++i) {
+    vector<string> names;
+    vector<string> table_names;
+    vector<string> definitions;
+    sqlite3_bind_text(select.get(), 1, tables[i].c_str(), -1,
+                      SQLITE_TRANSIENT);
+    while (select.step()) {
+      names.push_back(reinterpret_cast<const char*>(
+          sqlite3_column_text(select.get(), 0)));
+      table_names.push_back(reinterpret_cast<const char*>(
+          sqlite3_column_text(select.get(), 1)));
+      definitions.push_back(reinterpret_cast<const char*>(
+          sqlite3_column_text(select.get(), 2)));
+    }
+    success = select.done() && select.reset();
+    for (size_t j = 0; success && j < names.size(); ++j) {
+      sqlite3_bind_text(record.get(), 1, names[j].c_str(), -1,
+                        SQLITE_TRANSIENT);
+      sqlite3_bind_text(record.get(), 2, table_names[j].c_str(), -1,
+                        SQLITE_TRANSIENT);
+      sqlite3_bind_text(record.get(), 3, definitions[j].c_str(), -1,
+                        SQLITE_TRANSIENT);
+      record.step();
+      char* sql = sqlite3_mprintf("DROP INDEX \"%w\"", names[j].c_str());
+      success = record.done() && record.reset() &&
+                sqlite3_exec(database_, sql, NULL, NULL, NULL) == SQLITE_OK;
+      sqlite3_free(sql);
+    }
+  }
+  select.finalize();
+  record.finalize();
+  if (!success) {
+    string message(errorMessage());
+    executeControl("ROLLBACK");
+    setErrorMessage(message);
+    return false;
+  }
+  if (!executeControl("COMMIT"))
+    return false;
+  char* sql = sqlite3_mprintf("PRAGMA synchronous = OFF; "
+                              "PRAGMA cache_size = %lld",
+                              -static_cast<long long>(cache_bytes / 1024));
+  success = sqlite3_exec(database_, sql, NULL, NULL, NULL) == SQLITE_OK;
+  sqlite3_free(sql);
+  bulk_loading_ = success;
+  return success;
+}
+
+bool Database::endBulkLoad() {
+  lock_guard<mutex> lock(mutex_);
+  clearError();
+  if (!endGroup(0, true))
+    return false;
+  if (!sqlite3_get_autocommit(database_)) {
+    setErrorMessage("Bulk load can't end in a transaction");
+    return false;
+  }
+  bool success = true;
+  // Synced writes come back first so the commit of the rebuilt indexes
+  // also syncs the loaded pages to the disk.
+  if (bulk_loading_) {
+    char* sql = sqlite3_mprintf("PRAGMA synchronous = %lld",
+                                static_cast<long long>(bulk_synchronous_));
+    success = sqlite3_exec(database_, sql, NULL, NULL, NULL) == SQLITE_OK;
+    sqlite3_free(sql);
+  }
+  success = success && rebuildIndexes();
+  if (bulk_loading_) {
+    char* sql = sqlite3_mprintf("PRAGMA cache_size = %lld",
+                                static_cast<long long>(bulk_cache_size_));
+    sqlite3_exec(database_, sql, NULL, NULL, NULL);
+    sqlite3_free(sql);
+    bulk_loading_ = false;
+  }
+  return success;
+}
+
+bool Database::rebuildIndexes() {
+  int64_t exists = 0;
+  if (!queryInteger("SELECT count(*) FROM sqlite_master WHERE "
+                    "type = 'table' AND name = 'sqlite3mex_bulkload'",
+                    &exists))
+    return false;
+  if (!exists)
+    return true;
+  // Indexes of dropped tables and indexes created again are skipped.
+  Statement select;
+  if (!select.prepare("SELECT name, sql FROM sqlite3mex_bulkload WHERE "
+                      "table_name IN (SELECT name FROM sqlite_master "
+                      "WHERE type = 'table') AND name NOT IN (SELECT name "
+                      "FROM sqlite_master WHERE type = 'index')", database_))
+    return false;
+  vector<string> names;
+  vector<string> definitions;
+  while (select.step()) {
+    names.push_back(reinterpret_cast<const char*>(
+        sqlite3_column_text(select.get(), 0)));
+    definitions.push_back(reinterpret_cast<const char*>(
+        sqlite3_column_text(select.get(), 1)));
+  }
+  if (!select.done() || !select.finalize())
+    return false;
+  // The sorter of CREATE INDEX may use worker threads.
+  int64_t threads = 0;
+  if (!queryInteger("PRAGMA threads", &threads))
+    return false;
+  char* sql = sqlite3_mprintf("PRAGMA threads = %d",
+                              static_cast<int>(thread::hardware_concurrency()));
+  sqlite3_exec(database_, sql, NULL, NULL, NULL);
+  sqlite3_free(sql);
+  bool success = executeControl("BEGIN IMMEDIATE");
+  for (size_t i = 0; success && i < names.size(); ++i) {
+    if (sqlite3_exec(database_, definitions[i].c_str(), NULL, NULL, NULL) !=
+        SQLITE_OK) {
+      setErrorMessage("Failed to rebuild index " + names[i] + ": " +
+                      sqlite3_errmsg(database_));
+      success = false;
+    }
+  }
+  success = success && sqlite3_exec(database_,
+                                    "DROP TABLE sqlite3mex_bulkload",
+                                    NULL, NULL, NULL) == SQLITE_OK;
+  if (success)
+    success = executeControl("COMMIT");
+  else {
+    string message(errorMessage());
+    executeControl("ROLLBACK");
+    setErrorMessage(message);
+  }
+  sql = sqlite3_mprintf("PRAGMA threads = %lld",
+                        static_cast<long long>(threads));
+  sqlite3_exec(database_, sql, NULL, NULL, NULL);
+  sqlite3_free(sql);
+  return success;
+}
+
+bool Database::queryInteger(const char* sql, int64_t* value) {
+  Statement statement;
+  if (!statement.prepare(sql, database_))
+    return false;
+  if (!statement.step())
+    return false;
+  *value = sqlite3_column_int64(statement.get(), 0);
+  return true;
+}
+
+bool Database::executeControl(const char* sql) {
+  bool success = sqlite3_exec(database_, sql, NULL, NULL, NULL) == SQLITE_OK;
+  if (sqlite3_get_autocommit(database_))
+    group_open_ = false;
+  return success;
+}
+
+bool Database::beginGroup(Statement* statement) {
+  if (group_rows_ == 0 && group_milliseconds_ == 0)
+    return true;
+  if (!sqlite3_get_autocommit(database_)) {
+    // BEGIN or SAVEPOINT in the group transaction starts a new explicit
+    // transaction, and ROLLBACK, COMMIT, or END finds no transaction of the
+    // caller once the buffered writes are committed.
+    if (group_open_ && statement) {
+      const char* sql = sqlite3_sql(statement->get());
+      sql += strspn(sql, " \t\r\n");
+      if (sqlite3_strnicmp(sql, "BEGIN", 5) == 0 ||
+          sqlite3_strnicmp(sql, "SAVEPOINT", 9) == 0 ||
+          sqlite3_strnicmp(sql, "ROLLBACK", 8) == 0 ||
+          sqlite3_strnicmp(sql, "COMMIT", 6) == 0 ||
+          sqlite3_strnicmp(sql, "END", 3) == 0)
+        return endGroup(0, true);
+    }
+    return true;
+  }
+  group_open_ = false;
+  if (statement && sqlite3_stmt_readonly(statement->get()))
+    return true;
+  // The group transaction is for writes, so the write lock is taken at the
+  // start, where the busy handler can wait for it.
+  if (sqlite3_exec(database_, "BEGIN IMMEDIATE", NULL, NULL, NULL) !=
+      SQLITE_OK)
+    return false;
+  group_open_ = true;
+  group_changes_ = 0;
+  group_start_ = chrono::steady_clock::now();
+  group_condition_.notify_all();
+  return true;
+}
+
+bool Database::endGroup(int changes, bool force) {
+  if (group_open_ && sqlite3_get_autocommit(database_))
+    group_open_ = false;
+  if (!group_open_)
+    return true;
+  group_changes_ += changes;
+  bool due = force ||
+      (group_rows_ > 0 && group_changes_ >= group_rows_) ||
+      (group_milliseconds_ > 0 &&
+       chrono::steady_clock::now() - group_start_ >=
+           chrono::milliseconds(group_milliseconds_));
+  if (!due)
+    return true;
+  if (sqlite3_exec(database_, "COMMIT", NULL, NULL, NULL) != SQLITE_OK)
+    return false;
+  group_open_ = false;
+  return true;
+}
+
+void Database::runGroupCommit() {
+  unique_lock<mutex> lock(mutex_);
+  chrono::milliseconds interval(group_milliseconds_);
+  while (!group_stopping_) {
+    if (group_open_)
+      group_condition_.wait_until(lock, group_start_ + interval);
+    else
+      group_condition_.wait_for(lock, interval);
+    if (!group_stopping_)
+      endGroup(0, false);
+  }
+}
+
+void Database::runCheckpoint() {
+  unique_lock<mutex> lock(checkpoint_mutex_);
+  chrono::milliseconds interval(checkpoint_policy_.interval);
+  while (!checkpoint_stopping_) {
+    checkpoint_condition_.wait_for(lock, interval);
+    if (checkpoint_stopping_)
+      break;
+    // The round runs on the own connection without holding the lock, and
+    // the statistics are merged after it.
+    CheckpointPolicy policy = checkpoint_policy_;
+    CheckpointStats round = CheckpointStats();
+    lock.unlock();
+    checkpointOnce(policy, &round);
+    lock.lock();
+    CheckpointStats& stats = checkpoint_stats_;
+    stats.checkpoints += round.checkpoints;
+    stats.truncates += round.truncates;
+    stats.busy += round.busy;
+    stats.vacuumed_pages += round.vacuumed_pages;
+    if (round.wal_size >= 0)
+      stats.wal_size = round.wal_size;
+    stats.max_wal_size = max(stats.max_wal_size, round.max_wal_size);
+    stats.last_seconds = round.last_seconds;
+    stats.longest_seconds = max(stats.longest_seconds, round.last_seconds);
+    stats.total_seconds += round.last_seconds;
+  }
+}
+
+void Database::checkpointOnce(const CheckpointPolicy& policy,
+                              CheckpointStats* stats) {
+  sqlite3* database = checkpoint_database_;
+  int64_t free_pages = 0;
+  int64_t page_size = 0;
+  Statement pragma;
+  if (pragma.prepare("PRAGMA freelist_count", database) && pragma.step())
+    free_pages = sqlite3_column_int64(pragma.get(), 0);
+  if (pragma.prepare("PRAGMA page_size", database) && pragma.step())
+    page_size = sqlite3_column_int64(pragma.get(), 0);
+  pragma.finalize();
+  // The vacuum needs PRAGMA auto_vacuum = INCREMENTAL, and is skipped
+  // while other connections write.
+  if (policy.vacuum_pages > 0 && free_pages > 0) {
+    stringstream sql;
+    sql << "PRAGMA incremental_vacuum(" << policy.vacuum_pages << ")";
+    if (sqlite3_exec(database, sql.str().c_str(), NULL, NULL, NULL) ==
+            SQLITE_OK &&
+        pragma.prepare("PRAGMA freelist_count", database) && pragma.step())
+      stats->vacuumed_pages = max<int64_t>(
+          free_pages - sqlite3_column_int64(pragma.get(), 0), 0);
+    pragma.finalize();
+  }
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  int frames = 0;
+  int checkpointed = 0;
+  int code = sqlite3_wal_checkpoint_v2(database, NULL,
+                                       SQLITE_CHECKPOINT_PASSIVE, &frames,
+                                       &checkpointed);
+  // Frames are -1 when the database is not in WAL mode.
+  stats->wal_size = (frames > 0) ? 32 + frames * (page_size + 24) : 0;
+  stats->max_wal_size = stats->wal_size;
+  if (frames < 0) {
+    stats->wal_size = -1;
+    return;
+  }
+  ++stats->checkpoints;
+  if (code == SQLITE_OK && stats->wal_size > policy.max_wal_size) {
+    // Truncating waits for the readers of the WAL and empties it.
+    code = sqlite3_wal_checkpoint_v2(database, NULL,
+                                     SQLITE_CHECKPOINT_TRUNCATE, &frames,
+                                     &checkpointed);
+    ++stats->truncates;
+    if (code == SQLITE_OK)
+      stats->wal_size = 0;
+  }
+  if (code == SQLITE_BUSY || checkpointed < frames)
+    ++stats->busy;
+  stats->last_seconds = chrono::duration<double>(
+      chrono::steady_clock::now() - start).count();
+}
+
+void Database::stopCheckpoint() {
+  if (checkpoint_thread_.joinable()) {
+    {
+      lock_guard<mutex> lock(checkpoint_mutex_);
+      checkpoint_stopping_ = true;
+    }
+    checkpoint_condition_.notify_all();
+    checkpoint_thread_.join();
+  }
+  if (checkpoint_database_) {
+    sqlite3_close(checkpoint_database_);
+    checkpoint_database_ = NULL;
+  }
+}
+
+void Database::runWarm(const string& filename,
+                       const vector<uint32_t>& root_pages,
+                       const vector<pair<string, bool> >& queries) {
+  if (queries.empty()) {
+    warmFile(filename, root_pages, warm_stopping_);
+    return;
+  }
+  // The b-trees are read in slices ended by the progress handler, so that
+  // queries on the connection wait for one slice at most and stopWarm()
+  // does not wait for a whole scan. A table scan resumes from the last
+  // rowid. Other scans start over with a longer slice, and find the pages
+  // of the previous slices in the cache.
+  for (size_t i = 0; i < queries.size() && !warm_stopping_; ++i) {
+    sqlite3_int64 rowid = numeric_limits<sqlite3_int64>::min();
+    int slice = kWarmSliceMilliseconds;
+    while (!warm_stopping_) {
+      bool interrupted = false;
+      {
+        lock_guard<mutex> lock(mutex_);
+        Statement statement;
+        if (!statement.prepare(queries[i].first, database_))
+          break;
+        if (queries[i].second)
+          sqlite3_bind_int64(statement.get(), 1, rowid);
+        warm_deadline_ = chrono::steady_clock::now() +
+                         chrono::milliseconds(slice);
+        warm_active_ = true;
+        while (statement.step()) {
+          if (queries[i].second)
+            rowid = sqlite3_column_int64(statement.get(), 0);
+        }
+        warm_active_ = false;
+        interrupted = (statement.code() == SQLITE_INTERRUPT);
+      }
+      if (!interrupted)
+        break;
+      if (!queries[i].second)
+        slice *= 2;
+      // Let the waiting queries take the connection.
+      this_thread::sleep_for(chrono::milliseconds(1));
+    }
+  }
+}
+
+void Database::stopWarm() {
+  if (!warm_thread_.joinable())
+    return;
+  warm_stopping_ = true;
+  warm_thread_.join();
+}
+
+void Database::stopGroupCommit() {
+  if (!group_thread_.joinable())
+    return;
+  {
+    lock_guard<mutex> lock(mutex_);
+    group_stopping_ = true;
+  }
+  group_condition_.notify_all();
+  group_thread_.join();
+}
+
+void Database::createColumns(const Statement& statement,
+                             vector<Column>* columns) const {
+  columns->resize(statement.columnCount());
+  set<string> unique_names;
+  for (int i = 0; i < statement.columnCount(); ++i) {
+    // Clean the column name.
+    static const regex leading_non_alphabets("^[^a-zA-Z]+");
+    static const regex non_alphanumerics("[^a-zA-Z0-9]+");
+    string name(statement.columnName(i));
+    name = regex_replace(name, leading_non_alphabets, string(""));
+    name = regex_replace(name, non_alphanumerics, string(" "));
+    name.erase(0, name.find_first_not_of(' '));
+    name.erase(name.find_last_not_of(' ') + 1);
+    replace(name.begin(), name.end(), ' ', '_');
+    transform(name.begin(), name.end(), name.begin(), ::tolower);
+    if (name.empty())
+      name = "field";
+    // Ensure name fits in MATLAB 63-char limit. This truncates and leaves 1 character buffer for up to 10 name collisions below
+    if (name.length() > 62) {
+      name.resize(62);
+    }
+    // Find a unique name for the duplicated column.
+    int index = 0;
+    string original_name(name);
+    while (unique_names.find(name) != unique_names.end()) {
+      stringstream name_builder(stringstream::in | stringstream::out);
+      name_builder << original_name << ++index;
+      name = name_builder.str();
+    }
+    unique_names.insert(name);
+    (*columns)[i].name = name;
+    (*columns)[i].original_name = statement.columnName(i);
+  }
+}
+
+bool Database::convertColumnsToArray(vector<Column>* columns,
+                                     const ExecuteOptions& options,
+                                     mxArray** array) const {
+  if (array == NULL)
+    return false;
+  *array = (options.format == kFormatTable) ?
+      convertColumnsToTable(columns) : convertColumnsToStruct(columns);
+  return true;
+}
+
+mxArray* Database::convertColumnsToStruct(vector<Column>* columns) const {
+  if (columns->empty() || (*columns)[0].values.empty())
+    return mxCreateStructMatrix(0, 0, 0, NULL);
+  vector<const char*> fieldnames;
+  fieldnames.reserve(columns->size());
+  for (vector<Column>::iterator it = columns->begin();
+       it != columns->end(); ++it)
+    fieldnames.push_back(it->name.c_str());
+  mxArray* array = mxCreateStructMatrix(1, (*columns)[0].values.size(),
+                                        columns->size(), &fieldnames[0]);
+  for (size_t i = 0; i < columns->size(); ++i) {
+    Column* column = &(*columns)[i];
+    for (size_t j = 0; j < column->values.size(); ++j)
+      mxSetFieldByNumber(array, j, i, convertValueToArray(*column, j));
+    vector<Datum>().swap(column->values);
+    string().swap(column->data);
+  }
+  return array;
+}
+
+mxArray* Database::convertColumnsToTable(vector<Column>* columns) const {
+  mxArray* table = NULL;
+  if (columns->empty()) {
+    mexCallMATLAB(1, &table, 0, NULL, "table");
+    return table;
+  }
+  // table(column1, column2, ..., 'VariableNames', names).
+  vector<mxArray*> rhs;
+  vector<string> names, descriptions;
+  for (size_t i = 0; i < columns->size(); ++i) {
+    Column* column = &(*columns)[i];
+    rhs.push_back(convertColumnToArray(column));
+    names.push_back(column->name);
+    descriptions.push_back(column->original_name);
+    vector<Datum>().swap(column->values);
+    string().swap(column->data);
+  }
+  rhs.push_back(mxCreateString("VariableNames"));
+  rhs.push_back(createCellString(names));
+  mexCallMATLAB(1, &table, rhs.size(), &rhs[0], "table");
+  for (size_t i = 0; i < rhs.size(); ++i)
+    mxDestroyArray(rhs[i]);
+  // Keep the names reported by sqlite in VariableDescriptions.
+  vector<mxArray*> subs;
+  subs.push_back(mxCreateString("Properties"));
+  subs.push_back(mxCreateString("VariableDescriptions"));
+  return assignTo(table, ".", subs, createCellString(descriptions));
+}
+
+mxArray* Database::convertColumnToArray(Column* column_pointer) const {
+  const Column& column = *column_pointer;
+  size_t rows = column.values.size();
+  int type = SQLITE_NULL;
+  for (size_t i = 0; i < rows; ++i) {
+    int value_type = column.values[i].type;
+    if (value_type == SQLITE_NULL || value_type == type)
+      continue;
+    bool numeric = (value_type == SQLITE_INTEGER ||
+                    value_type == SQLITE_FLOAT);
+    if (type == SQLITE_NULL)
+      type = (numeric) ? SQLITE_FLOAT : value_type;
+    else if (!(numeric && type == SQLITE_FLOAT)) {
+      type = -1;  // Mixed types.
+      break;
+    }
+  }
+  if (column.encoded && (type != SQLITE_TEXT ||
+      column.entries.size() > column.max_distinct * rows))
+    decodeColumn(column_pointer);
+  // Texts with surrounding white space are returned as strings instead.
+  for (size_t i = 0; column.encoded && i < column.entries.size(); ++i) {
+    const Datum& entry = column.entries[i];
+    if (!isCategoryName(column.data.data() + entry.offset, entry.size))
+      decodeColumn(column_pointer);
+  }
+  mxArray* array = NULL;
+  if (column.encoded) {
+    // categorical(codes, 1:n, names) with code 0 for null and empty text,
+    // which are undefined as categorical does not allow an empty name.
+    size_t num_entries = column.entries.size();
+    vector<uint32_t> remap(num_entries);
+    vector<size_t> categories;
+    for (size_t i = 0; i < num_entries; ++i) {
+      if (column.entries[i].size > 0)
+        categories.push_back(i);
+      remap[i] = (column.entries[i].size > 0) ? categories.size() : 0;
+    }
+    mxArray* codes = mxCreateNumericMatrix(rows, 1, mxUINT32_CLASS, mxREAL);
+    uint32_t* code_data = reinterpret_cast<uint32_t*>(mxGetData(codes));
+    for (size_t i = 0; i < rows; ++i) {
+      const Datum& value = column.values[i];
+      code_data[i] = (value.type == SQLITE_TEXT) ? remap[value.offset] : 0;
+    }
+    mxArray* value_set = mxCreateNumericMatrix(1, categories.size(),
+                                               mxUINT32_CLASS, mxREAL);
+    uint32_t* value_data = reinterpret_cast<uint32_t*>(mxGetData(value_set));
+    mxArray* names = mxCreateCellMatrix(1, categories.size());
+    for (size_t i = 0; i < categories.size(); ++i) {
+      const Datum& entry = column.entries[categories[i]];
+      value_data[i] = i + 1;
+      mxSetCell(names, i, createCharArray(column.data.data() + entry.offset,
+                                          entry.size));
+    }
+    mxArray* rhs[] = {codes, value_set, names};
+    mexCallMATLAB(1, &array, 3, rhs, "categorical");
+    for (size_t i = 0; i < 3; ++i)
+      mxDestroyArray(rhs[i]);
+    return array;
+  }
+  switch (type) {
+    case SQLITE_NULL:
+    case SQLITE_FLOAT: {
+      // Integers become double like the struct format, and null is NaN.
+      array = mxCreateDoubleMatrix(rows, 1, mxREAL);
+      double* output = mxGetPr(array);
+      for (size_t i = 0; i < rows; ++i) {
+        const Datum& value = column.values[i];
+        output[i] = (value.type == SQLITE_INTEGER) ?
+            static_cast<double>(value.integer) :
+            (value.type == SQLITE_FLOAT) ? value.real : mxGetNaN();
+      }
+      break;
+    }
+    case SQLITE_TEXT: {
+      // Text is a string array with missing for null.
+      mxArray* cell = mxCreateCellMatrix(rows, 1);
+      vector<double> missing;
+      for (size_t i = 0; i < rows; ++i) {
+        const Datum& value = column.values[i];
+        if (value.type == SQLITE_NULL)
+          missing.push_back(i + 1);
+        mxSetCell(cell, i, createCharArray(column.data.data() + value.offset,
+                                           value.size));
+      }
+      mexCallMATLAB(1, &array, 1, &cell, "string");
+      mxDestroyArray(cell);
+      if (!missing.empty()) {
+        mxArray* index = mxCreateDoubleMatrix(missing.size(), 1, mxREAL);
+        copy(missing.begin(), missing.end(), mxGetPr(index));
+        mxArray* subs = mxCreateCellMatrix(1, 1);
+        mxSetCell(subs, 0, index);
+        mxArray* value = NULL;
+        mexCallMATLAB(1, &value, 0, NULL, "missing");
+        array = assignTo(array, "()", vector<mxArray*>(1, subs), value);
+      }
+      break;
+    }
+    default: {
+      // Blobs and mixed types are a cell array of values.
+      array = mxCreateCellMatrix(rows, 1);
+      for (size_t i = 0; i < rows; ++i)
+        mxSetCell(array, i, convertValueToArray(column, i));
+      break;
+    }
+  }
+  if (array == NULL)
+    ERROR("Failed to create mxArray.");
+  return array;
+}
+
+mxArray* Database::convertValueToArray(const Column& column,
+                                       size_t row) const {
+  const Datum& value = column.values[row];
   mxArray* array = NULL;
-  switch (value.first) {
+  switch (value.type) {
     case SQLITE_INTEGER: {
       // Integer types in matlab are very restricted. Convert them to double
       // by default.
-      //array = mxCreateNumericMatrix(1, 1, mxINT64_CLASS, mxREAL);
-      //*reinterpret_cast<IntegerValue*>(mxGetData(array)) =
-      //    static_cast<IntegerValue>(boost::get<IntegerValue>(value));
-      array = mxCreateDoubleScalar(boost::get<IntegerValue>(value.second));
+      array = mxCreateDoubleScalar(static_cast<double>(value.integer));
       break;
     }
     case SQLITE_FLOAT: {
-      array = mxCreateDoubleScalar(boost::get<FloatValue>(value.second));
+      array = mxCreateDoubleScalar(value.real);
       break;
     }
     case SQLITE_TEXT: {
-      // There is no direct UTF-8 conversion in MEX API...
-      const string& text = boost::get<TextValue>(value.second);
-      mwSize dimensions[] = {1, static_cast<mwSize>(text.size())};
-      array = mxCreateCharArray(2, dimensions);
-      mxArray* blob = mxCreateNumericMatrix(1,
-                                            text.size(),
-                                            mxUINT8_CLASS,
-                                            mxREAL);
-      copy(text.begin(), text.end(),
-           reinterpret_cast<uint8_t*>(mxGetData(blob)));
-      mxArray* lhs[] = {blob, kUTF8Label.get()};
-      mexCallMATLAB(1, &array, 2, lhs, "native2unicode");
-      mxDestroyArray(blob);
+      array = createCharArray(column.data.data() + value.offset, value.size);
       break;
     }
     case SQLITE_BLOB: {
-      const vector<uint8_t>& blob = boost::get<BlobValue>(value.second);
-      array = mxCreateNumericMatrix(1, blob.size(), mxUINT8_CLASS, mxREAL);
-      copy(blob.begin(), blob.end(),
-           reinterpret_cast<uint8_t*>(mxGetData(array)));
+      array = mxCreateNumericMatrix(1, value.size, mxUINT8_CLASS, mxREAL);
+      copy(column.data.begin() + value.offset,
+           column.data.begin() + value.offset + value.size,
+           reinterpret_cast<char*>(mxGetData(array)));
       break;
     }
     case SQLITE_NULL: {
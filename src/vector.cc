@@ -0,0 +1,608 @@
+// SQLite3 matlab driver vector similarity functions.
+//
+// Vectors are stored as blobs of packed float32 (default) or float64 values.
+// The kernels are compiled for several instruction sets and the best one is
+// picked at runtime from the CPU features.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sqlite3mex.h>
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define SQLITE3MEX_VECTOR_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+using sqlite3mex::VectorMetric;
+using sqlite3mex::kVectorDot;
+using sqlite3mex::kVectorL2;
+using sqlite3mex::kVectorCosine;
+
+// Sums of a single pass over two vectors. The cosine kernel fills all three,
+// other kernels only fill the first one.
+typedef struct {
+  double ab;  // Dot product or squared distance.
+  double aa;  // Squared norm of a.
+  double bb;  // Squared norm of b.
+} VectorSums;
+
+// Kernel signatures.
+typedef void (*FloatKernel)(const float*, const float*, size_t, VectorSums*);
+typedef void (*DoubleKernel)(const double*, const double*, size_t,
+                             VectorSums*);
+
+// Kernel table for one instruction set.
+typedef struct {
+  const char* name;
+  FloatKernel float_kernels[3];
+  DoubleKernel double_kernels[3];
+} KernelTable;
+
+// Portable kernels.
+
+template <typename T>
+void dotGeneric(const T* a, const T* b, size_t size, VectorSums* sums) {
+  double ab = 0.0;
+  for (size_t i = 0; i < size; ++i)
+    ab += static_cast<double>(a[i]) * b[i];
+  sums->ab = ab;
+}
+
+template <typename T>
+void l2Generic(const T* a, const T* b, size_t size, VectorSums* sums) {
+  double ab = 0.0;
+  for (size_t i = 0; i < size; ++i) {
+    double diff = static_cast<double>(a[i]) - b[i];
+    ab += diff * diff;
+  }
+  sums->ab = ab;
+}
+
+template <typename T>
+void cosineGeneric(const T* a, const T* b, size_t size, VectorSums* sums) {
+  double ab = 0.0, aa = 0.0, bb = 0.0;
+  for (size_t i = 0; i < size; ++i) {
+    ab += static_cast<double>(a[i]) * b[i];
+    aa += static_cast<double>(a[i]) * a[i];
+    bb += static_cast<double>(b[i]) * b[i];
+  }
+  sums->ab = ab;
+  sums->aa = aa;
+  sums->bb = bb;
+}
+
+const KernelTable kGenericKernels = {
+  "generic",
+  {dotGeneric<float>, l2Generic<float>, cosineGeneric<float>},
+  {dotGeneric<double>, l2Generic<double>, cosineGeneric<double>}
+};
+
+#ifdef SQLITE3MEX_VECTOR_X86
+
+// SSE kernels. The tail that does not fill a register is handled by the
+// generic loop and added to the SIMD sums.
+
+__attribute__((target("sse2")))
+double horizontalSum(__m128 value) {
+  float lanes[4];
+  _mm_storeu_ps(lanes, value);
+  return static_cast<double>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+}
+
+__attribute__((target("sse2")))
+double horizontalSum(__m128d value) {
+  double lanes[2];
+  _mm_storeu_pd(lanes, value);
+  return lanes[0] + lanes[1];
+}
+
+__attribute__((target("sse2")))
+void dotSSE(const float* a, const float* b, size_t size, VectorSums* sums) {
+  __m128 ab = _mm_setzero_ps();
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4)
+    ab = _mm_add_ps(ab, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+  dotGeneric(a + i, b + i, size - i, sums);
+  sums->ab += horizontalSum(ab);
+}
+
+__attribute__((target("sse2")))
+void l2SSE(const float* a, const float* b, size_t size, VectorSums* sums) {
+  __m128 ab = _mm_setzero_ps();
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    __m128 diff = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+    ab = _mm_add_ps(ab, _mm_mul_ps(diff, diff));
+  }
+  l2Generic(a + i, b + i, size - i, sums);
+  sums->ab += horizontalSum(ab);
+}
+
+__attribute__((target("sse2")))
+void cosineSSE(const float* a, const float* b, size_t size, VectorSums* sums) {
+  __m128 ab = _mm_setzero_ps(), aa = _mm_setzero_ps(), bb = _mm_setzero_ps();
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    __m128 x = _mm_loadu_ps(a + i), y = _mm_loadu_ps(b + i);
+    ab = _mm_add_ps(ab, _mm_mul_ps(x, y));
+    aa = _mm_add_ps(aa, _mm_mul_ps(x, x));
+    bb = _mm_add_ps(bb, _mm_mul_ps(y, y));
+  }
+  cosineGeneric(a + i, b + i, size - i, sums);
+  sums->ab += horizontalSum(ab);
+  sums->aa += horizontalSum(aa);
+  sums->bb += horizontalSum(bb);
+}
+
+__attribute__((target("sse2")))
+void dotSSE(const double* a, const double* b, size_t size, VectorSums* sums) {
+  __m128d ab = _mm_setzero_pd();
+  size_t i = 0;
+  for (; i + 2 <= size; i += 2)
+    ab = _mm_add_pd(ab, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+  dotGeneric(a + i, b + i, size - i, sums);
+  sums->ab += horizontalSum(ab);
+}
+
+__attribute__((target("sse2")))
+void l2SSE(const double* a, const double* b, size_t size, VectorSums* sums) {
+  __m128d ab = _mm_setzero_pd();
+  size_t i = 0;
+  for (; i + 2 <= size; i += 2) {
+    __m128d diff = _mm_sub_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i));
+    ab = _mm_add_pd(ab, _mm_mul_pd(diff, diff));
+  }
+  l2Generic(a + i, b + i, size - i, sums);
+  sums->ab += horizontalSum(ab);
+}
+
+__attribute__((target("sse2")))
+void cosineSSE(const double* a, const double* b, size_t size,
+               VectorSums* sums) {
+  __m128d ab = _mm_setzero_pd(), aa = _mm_setzero_pd(), bb = _mm_setzero_pd();
+  size_t i = 0;
+  for (; i + 2 <= size; i += 2) {
+    __m128d x = _mm_loadu_pd(a + i), y = _mm_loadu_pd(b + i);
+    ab = _mm_add_pd(ab, _mm_mul_pd(x, y));
+    aa = _mm_add_pd(aa, _mm_mul_pd(x, x));
+    bb = _mm_add_pd(bb, _mm_mul_pd(y, y));
+  }
+  cosineGeneric(a + i, b + i, size - i, sums);
+  sums->ab += horizontalSum(ab);
+  sums->aa += horizontalSum(aa);
+  sums->bb += horizontalSum(bb);
+}
+
+const KernelTable kSSEKernels = {
+  "sse2",
+  {dotSSE, l2SSE, cosineSSE},
+  {dotSSE, l2SSE, cosineSSE}
+};
+
+// AVX2 kernels with fused multiply-add.
+
+__attribute__((target("avx2,fma")))
+double horizontalSum(__m256 value) {
+  float lanes[8];
+  _mm256_storeu_ps(lanes, value);
+  double sum = 0.0;
+  for (int i = 0; i < 8; ++i)
+    sum += lanes[i];
+  return sum;
+}
+
+__attribute__((target("avx2,fma")))
+double horizontalSum(__m256d value) {
+  double lanes[4];
+  _mm256_storeu_pd(lanes, value);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+__attribute__((target("avx2,fma")))
+void dotAVX2(const float* a, const float* b, size_t size, VectorSums* sums) {
+  __m256 ab = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8)
+    ab = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), ab);
+  dotGeneric(a + i, b + i, size - i, sums);
+  sums->ab += horizontalSum(ab);
+}
+
+__attribute__((target("avx2,fma")))
+void l2AVX2(const float* a, const float* b, size_t size, VectorSums* sums) {
+  __m256 ab = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(a + i),
+                                _mm256_loadu_ps(b + i));
+    ab = _mm256_fmadd_ps(diff, diff, ab);
+  }
+  l2Generic(a + i, b + i, size - i, sums);
+  sums->ab += horizontalSum(ab);
+}
+
+__attribute__((target("avx2,fma")))
+void cosineAVX2(const float* a, const float* b, size_t size,
+                VectorSums* sums) {
+  __m256 ab = _mm256_setzero_ps(), aa = _mm256_setzero_ps(),
+         bb = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    __m256 x = _mm256_loadu_ps(a + i), y = _mm256_loadu_ps(b + i);
+    ab = _mm256_fmadd_ps(x, y, ab);
+    aa = _mm256_fmadd_ps(x, x, aa);
+    bb = _mm256_fmadd_ps(y, y, bb);
+  }
+  cosineGeneric(a + i, b + i, size - i, sums);
+  sums->ab += horizontalSum(ab);
+  sums->aa += horizontalSum(aa);
+  sums->bb += horizontalSum(bb);
+}
+
+__attribute__((target("avx2,fma")))
+void dotAVX2(const double* a, const double* b, size_t size,
+             VectorSums* sums) {
+  __m256d ab = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4)
+    ab = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), ab);
+  dotGeneric(a + i, b + i, size - i, sums);
+  sums->ab += horizontalSum(ab);
+}
+
+__attribute__((target("avx2,fma")))
+void l2AVX2(const double* a, const double* b, size_t size, VectorSums* sums) {
+  __m256d ab = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    __m256d diff = _mm256_sub_pd(_mm256_loadu_pd(a + i),
+                                 _mm256_loadu_pd(b + i));
+    ab = _mm256_fmadd_pd(diff, diff, ab);
+  }
+  l2Generic(a + i, b + i, size - i, sums);
+  sums->ab += horizontalSum(ab);
+}
+
+__attribute__((target("avx2,fma")))
+void cosineAVX2(const double* a, const double* b, size_t size,
+                VectorSums* sums) {
+  __m256d ab = _mm256_setzero_pd(), aa = _mm256_setzero_pd(),
+          bb = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    __m256d x = _mm256_loadu_pd(a + i), y = _mm256_loadu_pd(b + i);
+    ab = _mm256_fmadd_pd(x, y, ab);
+    aa = _mm256_fmadd_pd(x, x, aa);
+    bb = _mm256_fmadd_pd(y, y, bb);
+  }
+  cosineGeneric(a + i, b + i, size - i, sums);
+  sums->ab += horizontalSum(ab);
+  sums->aa += horizontalSum(aa);
+  sums->bb += horizontalSum(bb);
+}
+
+const KernelTable kAVX2Kernels = {
+  "avx2",
+  {dotAVX2, l2AVX2, cosineAVX2},
+  {dotAVX2, l2AVX2, cosineAVX2}
+};
+
+// AVX-512 kernels.
+
+__attribute__((target("avx512f")))
+double horizontalSum(__m512 value) {
+  float lanes[16];
+  _mm512_storeu_ps(lanes, value);
+  double sum = 0.0;
+  for (int i = 0; i < 16; ++i)
+    sum += lanes[i];
+  return sum;
+}
+
+__attribute__((target("avx512f")))
+double horizontalSum(__m512d value) {
+  double lanes[8];
+  _mm512_storeu_pd(lanes, value);
+  double sum = 0.0;
+  for (int i = 0; i < 8; ++i)
+    sum += lanes[i];
+  return sum;
+}
+
+__attribute__((target("avx512f")))
+void dotAVX512(const float* a, const float* b, size_t size,
+               VectorSums* sums) {
+  __m512 ab = _mm512_setzero_ps();
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16)
+    ab = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), ab);
+  dotGeneric(a + i, b + i, size - i, sums);
+  sums->ab += horizontalSum(ab);
+}
+
+__attribute__((target("avx512f")))
+void l2AVX512(const float* a, const float* b, size_t size, VectorSums* sums) {
+  __m512 ab = _mm512_setzero_ps();
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m512 diff = _mm512_sub_ps(_mm512_loadu_ps(a + i),
+                                _mm512_loadu_ps(b + i));
+    ab = _mm512_fmadd_ps(diff, diff, ab);
+  }
+  l2Generic(a + i, b + i, size - i, sums);
+  sums->ab += horizontalSum(ab);
+}
+
+__attribute__((target("avx512f")))
+void cosineAVX512(const float* a, const float* b, size_t size,
+                  VectorSums* sums) {
+  __m512 ab = _mm512_setzero_ps(), aa = _mm512_setzero_ps(),
+         bb = _mm512_setzero_ps();
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m512 x = _mm512_loadu_ps(a + i), y = _mm512_loadu_ps(b + i);
+    ab = _mm512_fmadd_ps(x, y, ab);
+    aa = _mm512_fmadd_ps(x, x, aa);
+    bb = _mm512_fmadd_ps(y, y, bb);
+  }
+  cosineGeneric(a + i, b + i, size - i, sums);
+  sums->ab += horizontalSum(ab);
+  sums->aa += horizontalSum(aa);
+  sums->bb += horizontalSum(bb);
+}
+
+__attribute__((target("avx512f")))
+void dotAVX512(const double* a, const double* b, size_t size,
+               VectorSums* sums) {
+  __m512d ab = _mm512_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8)
+    ab = _mm512_fmadd_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i), ab);
+  dotGeneric(a + i, b + i, size - i, sums);
+  sums->ab += horizontalSum(ab);
+}
+
+__attribute__((target("avx512f")))
+void l2AVX512(const double* a, const double* b, size_t size,
+              VectorSums* sums) {
+  __m512d ab = _mm512_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    __m512d diff = _mm512_sub_pd(_mm512_loadu_pd(a + i),
+                                 _mm512_loadu_pd(b + i));
+    ab = _mm512_fmadd_pd(diff, diff, ab);
+  }
+  l2Generic(a + i, b + i, size - i, sums);
+  sums->ab += horizontalSum(ab);
+}
+
+__attribute__((target("avx512f")))
+void cosineAVX512(const double* a, const double* b, size_t size,
+                  VectorSums* sums) {
+  __m512d ab = _mm512_setzero_pd(), aa = _mm512_setzero_pd(),
+          bb = _mm512_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    __m512d x = _mm512_loadu_pd(a + i), y = _mm512_loadu_pd(b + i);
+    ab = _mm512_fmadd_pd(x, y, ab);
+    aa = _mm512_fmadd_pd(x, x, aa);
+    bb = _mm512_fmadd_pd(y, y, bb);
+  }
+  cosineGeneric(a + i, b + i, size - i, sums);
+  sums->ab += horizontalSum(ab);
+  sums->aa += horizontalSum(aa);
+  sums->bb += horizontalSum(bb);
+}
+
+const KernelTable kAVX512Kernels = {
+  "avx512",
+  {dotAVX512, l2AVX512, cosineAVX512},
+  {dotAVX512, l2AVX512, cosineAVX512}
+};
+
+#endif // SQLITE3MEX_VECTOR_X86
+
+// Pick the kernel table for this CPU. Resolved once on first use.
+const KernelTable& kernels() {
+  static const KernelTable* table = NULL;
+  if (!table) {
+    table = &kGenericKernels;
+#ifdef SQLITE3MEX_VECTOR_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+      table = &kAVX512Kernels;
+    else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+      table = &kAVX2Kernels;
+    else if (__builtin_cpu_supports("sse2"))
+      table = &kSSEKernels;
+#endif
+  }
+  return *table;
+}
+
+// Finish the metric from the kernel sums.
+double finishMetric(VectorMetric metric, const VectorSums& sums) {
+  switch (metric) {
+    case kVectorDot:
+      return sums.ab;
+    case kVectorL2:
+      return sqrt(sums.ab);
+    case kVectorCosine: {
+      double norm = sqrt(sums.aa) * sqrt(sums.bb);
+      return (norm > 0.0) ? 1.0 - sums.ab / norm : 1.0;
+    }
+  }
+  return 0.0;
+}
+
+// SQL function vec_dot(a, b [, type]), vec_l2(a, b [, type]), and
+// vec_cosine(a, b [, type]). The metric is given in the user data.
+void vectorFunction(sqlite3_context* context,
+                    int argc,
+                    sqlite3_value** argv) {
+  VectorMetric metric = static_cast<VectorMetric>(
+      reinterpret_cast<intptr_t>(sqlite3_user_data(context)));
+  if (sqlite3_value_type(argv[0]) == SQLITE_NULL ||
+      sqlite3_value_type(argv[1]) == SQLITE_NULL) {
+    sqlite3_result_null(context);
+    return;
+  }
+  size_t element_size = sizeof(float);
+  if (argc > 2) {
+    const char* type = reinterpret_cast<const char*>(
+        sqlite3_value_text(argv[2]));
+    if (type && strcmp(type, "float64") == 0)
+      element_size = sizeof(double);
+    else if (!type || strcmp(type, "float32") != 0) {
+      sqlite3_result_error(context,
+                           "Vector type must be 'float32' or 'float64'.",
+                           -1);
+      return;
+    }
+  }
+  const void* a = sqlite3_value_blob(argv[0]);
+  int a_bytes = sqlite3_value_bytes(argv[0]);
+  const void* b = sqlite3_value_blob(argv[1]);
+  int b_bytes = sqlite3_value_bytes(argv[1]);
+  if (a_bytes != b_bytes || a_bytes % element_size != 0) {
+    sqlite3_result_error(context, "Vector size mismatch.", -1);
+    return;
+  }
+  size_t size = a_bytes / element_size;
+  double value = (element_size == sizeof(float)) ?
+      sqlite3mex::computeVectorMetric(metric,
+                                      static_cast<const float*>(a),
+                                      static_cast<const float*>(b),
+                                      size) :
+      sqlite3mex::computeVectorMetric(metric,
+                                      static_cast<const double*>(a),
+                                      static_cast<const double*>(b),
+                                      size);
+  sqlite3_result_double(context, value);
+}
+
+// Aggregate state of top_k(). The heap keeps the k smallest scores with the
+// largest one on top.
+typedef struct {
+  int k;
+  vector<pair<double, sqlite3_int64> >* heap;
+} TopKState;
+
+void topKStep(sqlite3_context* context, int argc, sqlite3_value** argv) {
+  TopKState* state = static_cast<TopKState*>(
+      sqlite3_aggregate_context(context, sizeof(TopKState)));
+  if (!state) {
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  if (!state->heap) {
+    state->k = sqlite3_value_int(argv[2]);
+    if (state->k <= 0) {
+      sqlite3_result_error(context, "top_k requires positive k.", -1);
+      return;
+    }
+    state->heap = new vector<pair<double, sqlite3_int64> >();
+    state->heap->reserve(state->k + 1);
+  }
+  if (sqlite3_value_type(argv[1]) == SQLITE_NULL)
+    return;
+  pair<double, sqlite3_int64> entry(sqlite3_value_double(argv[1]),
+                                    sqlite3_value_int64(argv[0]));
+  vector<pair<double, sqlite3_int64> >* heap = state->heap;
+  if (heap->size() < static_cast<size_t>(state->k)) {
+    heap->push_back(entry);
+    push_heap(heap->begin(), heap->end());
+  }
+  else if (entry < heap->front()) {
+    pop_heap(heap->begin(), heap->end());
+    heap->back() = entry;
+    push_heap(heap->begin(), heap->end());
+  }
+}
+
+void topKFinal(sqlite3_context* context) {
+  TopKState* state = static_cast<TopKState*>(
+      sqlite3_aggregate_context(context, 0));
+  if (!state || !state->heap) {
+    sqlite3_result_null(context);
+    return;
+  }
+  vector<pair<double, sqlite3_int64> >* heap = state->heap;
+  sort_heap(heap->begin(), heap->end());
+  vector<sqlite3_int64> ids(heap->size());
+  for (size_t i = 0; i < heap->size(); ++i)
+    ids[i] = (*heap)[i].second;
+  sqlite3_result_blob(context,
+                      (ids.empty()) ? static_cast<void*>(state) : &ids[0],
+                      ids.size() * sizeof(sqlite3_int64),
+                      SQLITE_TRANSIENT);
+  delete heap;
+  state->heap = NULL;
+}
+
+} // namespace
+
+namespace sqlite3mex {
+
+double computeVectorMetric(VectorMetric metric,
+                           const float* a,
+                           const float* b,
+                           size_t size) {
+  VectorSums sums = {0.0, 0.0, 0.0};
+  kernels().float_kernels[metric](a, b, size, &sums);
+  return finishMetric(metric, sums);
+}
+
+double computeVectorMetric(VectorMetric metric,
+                           const double* a,
+                           const double* b,
+                           size_t size) {
+  VectorSums sums = {0.0, 0.0, 0.0};
+  kernels().double_kernels[metric](a, b, size, &sums);
+  return finishMetric(metric, sums);
+}
+
+const char* vectorKernelName() {
+  return kernels().name;
+}
+
+bool registerVectorFunctions(sqlite3* database) {
+  static const struct {
+    const char* name;
+    VectorMetric metric;
+  } kFunctions[] = {
+    {"vec_dot", kVectorDot},
+    {"vec_l2", kVectorL2},
+    {"vec_cosine", kVectorCosine}
+  };
+  for (size_t i = 0; i < sizeof(kFunctions) / sizeof(kFunctions[0]); ++i) {
+    for (int argc = 2; argc <= 3; ++argc) {
+      if (sqlite3_create_function_v2(
+              database,
+              kFunctions[i].name,
+              argc,
+              SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+              reinterpret_cast<void*>(
+                  static_cast<intptr_t>(kFunctions[i].metric)),
+              vectorFunction,
+              NULL,
+              NULL,
+              NULL) != SQLITE_OK)
+        return false;
+    }
+  }
+  return sqlite3_create_function_v2(database,
+                                    "top_k",
+                                    3,
+                                    SQLITE_UTF8,
+                                    NULL,
+                                    NULL,
+                                    topKStep,
+                                    topKFinal,
+                                    NULL) == SQLITE_OK;
+}
+
+} // namespace sqlite3mex
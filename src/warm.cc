@@ -0,0 +1,205 @@
+// SQLite3 matlab driver warm-up of the database file.
+//
+// Pages of the database file are read with large sequential reads so that
+// the first queries after open find them in the OS cache. The whole file is
+// read when no b-tree is selected. Otherwise the pages of the selected
+// b-trees are located from the file by walking their interior pages level by
+// level from the root. All leaves of an SQLite b-tree are at the same depth,
+// so a level is only read while its first page is an interior page, and the
+// leaves are collected from the pointers of the last interior level without
+// reading them one by one. The located pages are sorted and read in runs,
+// after posix_fadvise(WILLNEED) of all runs lets the kernel queue them.
+// Overflow pages of large values are not located.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <sqlite3mex.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace sqlite3mex {
+
+namespace {
+
+// Bytes of a read.
+const size_t kWarmReadSize = 1 << 20;
+// Pages between located pages that are read instead of starting a new run.
+const uint32_t kWarmRunGap = 8;
+
+// Big-endian integers of the file format.
+uint32_t readUint16(const unsigned char* p) {
+  return (static_cast<uint32_t>(p[0]) << 8) | p[1];
+}
+
+uint32_t readUint32(const unsigned char* p) {
+  return (static_cast<uint32_t>(p[0]) << 24) |
+         (static_cast<uint32_t>(p[1]) << 16) |
+         (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+// Read-only database file with positioned reads.
+class WarmFile {
+public:
+  WarmFile() : file_(NULL) {}
+  ~WarmFile() {
+    if (file_)
+      fclose(file_);
+  }
+  bool open(const string& filename) {
+    file_ = fopen(filename.c_str(), "rb");
+    return file_ != NULL;
+  }
+  // Size of the file in bytes.
+  uint64_t size() {
+    return seek(0, SEEK_END) ? tell() : 0;
+  }
+  // Read bytes at the offset. The result is the bytes read.
+  size_t read(uint64_t offset, size_t size, void* buffer) {
+    return seek(offset, SEEK_SET) ? fread(buffer, 1, size, file_) : 0;
+  }
+  // Hint that the range is read soon.
+  void willNeed(uint64_t offset, uint64_t size) {
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+    posix_fadvise(fileno(file_), offset, size, POSIX_FADV_WILLNEED);
+#endif
+  }
+
+private:
+  bool seek(uint64_t offset, int origin) {
+#ifdef _WIN32
+    return _fseeki64(file_, offset, origin) == 0;
+#else
+    return fseeko(file_, offset, origin) == 0;
+#endif
+  }
+  uint64_t tell() {
+#ifdef _WIN32
+    return _ftelli64(file_);
+#else
+    return ftello(file_);
+#endif
+  }
+
+  FILE* file_;
+};
+
+// Collect the pages of the b-tree of the root page. Visited pages are
+// skipped, which also stops at loops in a corrupt file.
+void locateBtree(WarmFile* file,
+                 uint32_t root_page,
+                 uint32_t page_size,
+                 uint32_t page_count,
+                 const atomic<bool>& stop,
+                 vector<bool>* visited,
+                 vector<uint32_t>* pages) {
+  vector<unsigned char> page(page_size);
+  vector<uint32_t> level(1, root_page);
+  while (!level.empty() && !stop) {
+    vector<uint32_t> children;
+    for (size_t i = 0; i < level.size(); ++i) {
+      uint32_t number = level[i];
+      if (number == 0 || number > page_count || (*visited)[number])
+        continue;
+      (*visited)[number] = true;
+      pages->push_back(number);
+      if (file->read(static_cast<uint64_t>(number - 1) * page_size,
+                     page_size, &page[0]) != page_size)
+        return;
+      const unsigned char* header = &page[(number == 1) ? 100 : 0];
+      // 0x02 and 0x05 are interior pages of index and table b-trees.
+      if (header[0] != 0x02 && header[0] != 0x05) {
+        if (i == 0) {
+          // The level is of leaves, which are taken without reading.
+          for (size_t j = 1; j < level.size(); ++j) {
+            if (level[j] > 0 && level[j] <= page_count &&
+                !(*visited)[level[j]]) {
+              (*visited)[level[j]] = true;
+              pages->push_back(level[j]);
+            }
+          }
+          return;
+        }
+        continue;
+      }
+      uint32_t cells = readUint16(header + 3);
+      const unsigned char* pointers = header + 12;
+      for (uint32_t j = 0; j < cells; ++j) {
+        if (pointers + 2 * j + 2 > &page[0] + page_size)
+          break;
+        uint32_t offset = readUint16(pointers + 2 * j);
+        if (offset + 4 <= page_size)
+          children.push_back(readUint32(&page[offset]));
+      }
+      children.push_back(readUint32(header + 8));
+    }
+    // The next level is read in file order after its first page.
+    if (children.size() > 1) {
+      uint32_t first = children[0];
+      sort(children.begin() + 1, children.end());
+      children[0] = first;
+    }
+    level.swap(children);
+  }
+}
+
+} // namespace
+
+bool warmFile(const string& filename,
+              const vector<uint32_t>& root_pages,
+              const atomic<bool>& stop) {
+  WarmFile file;
+  if (!file.open(filename))
+    return false;
+  uint64_t file_size = file.size();
+  unsigned char header[100];
+  if (file.read(0, sizeof(header), header) != sizeof(header) ||
+      memcmp(header, "SQLite format 3", 16) != 0)
+    return false;
+  uint32_t page_size = readUint16(header + 16);
+  if (page_size == 1)
+    page_size = 65536;
+  if (page_size < 512 || (page_size & (page_size - 1)))
+    return false;
+  uint32_t page_count = static_cast<uint32_t>(file_size / page_size);
+
+  // Runs of pages as pairs of the first page and the number of pages.
+  vector<pair<uint32_t, uint32_t> > runs;
+  if (root_pages.empty())
+    runs.push_back(make_pair(1u, page_count));
+  else {
+    vector<bool> visited(page_count + 1, false);
+    vector<uint32_t> pages;
+    for (size_t i = 0; i < root_pages.size() && !stop; ++i)
+      locateBtree(&file, root_pages[i], page_size, page_count, stop,
+                  &visited, &pages);
+    sort(pages.begin(), pages.end());
+    for (size_t i = 0; i < pages.size(); ++i) {
+      if (!runs.empty() &&
+          pages[i] <= runs.back().first + runs.back().second + kWarmRunGap)
+        runs.back().second = pages[i] - runs.back().first + 1;
+      else
+        runs.push_back(make_pair(pages[i], 1u));
+    }
+  }
+  for (size_t i = 0; i < runs.size(); ++i)
+    file.willNeed(static_cast<uint64_t>(runs[i].first - 1) * page_size,
+                  static_cast<uint64_t>(runs[i].second) * page_size);
+  vector<char> buffer(kWarmReadSize);
+  for (size_t i = 0; i < runs.size() && !stop; ++i) {
+    uint64_t offset = static_cast<uint64_t>(runs[i].first - 1) * page_size;
+    uint64_t end = offset + static_cast<uint64_t>(runs[i].second) * page_size;
+    while (offset < end && !stop) {
+      size_t size = static_cast<size_t>(
+          min<uint64_t>(end - offset, buffer.size()));
+      if (file.read(offset, size, &buffer[0]) != size)
+        return false;
+      offset += size;
+    }
+  }
+  return true;
+}
+
+} // namespace sqlite3mex
@@ -1,7 +1,9 @@
 function benchmarkSQLite3
 %BENCHMARKSQLITE3 Benchmark the performance.
   tests = { ...
-    @benchmark1 ...
+    @benchmark1, ...
+    @benchmark2, ...
+    @benchmark3 ...
     };
   for i = 1:numel(tests)
     try
@@ -54,4 +56,70 @@ function benchmark1NonParametric
     sqlite3.execute(sprintf('INSERT INTO records VALUES (%g)', X(i)));
   end
   sqlite3.execute('END');
-end
\ No newline at end of file
+end
+
+function benchmark2
+%BENCHMARK_2 Recall and latency of the ann index against the exact scan.
+  num_vectors = 50000;
+  num_queries = 100;
+  dimension = 64;
+  k = 10;
+  X = single(rand(num_vectors, dimension));
+  Q = single(rand(num_queries, dimension));
+  sqlite3.open(':memory:');
+  sqlite3.execute('CREATE TABLE emb (id INTEGER PRIMARY KEY, v BLOB)');
+  sqlite3.execute(sprintf(['CREATE VIRTUAL TABLE idx USING ann(' ...
+                           'dim=%d, metric=l2, lists=256, probes=8)'], ...
+                          dimension));
+  sqlite3.execute('BEGIN');
+  for i = 1:num_vectors
+    sqlite3.execute('INSERT INTO emb VALUES (?, ?)', i, X(i, :));
+    sqlite3.execute('INSERT INTO idx(rowid, vector) VALUES (?, ?)', ...
+                    i, X(i, :));
+  end
+  sqlite3.execute('COMMIT');
+  exact_time = 0;
+  ann_time = 0;
+  recall = 0;
+  for i = 1:num_queries
+    tic;
+    exact = sqlite3.execute(...
+        'SELECT id FROM emb ORDER BY vec_l2(v, ?) LIMIT ?', Q(i, :), k);
+    exact_time = exact_time + toc;
+    tic;
+    approximate = sqlite3.execute(...
+        'SELECT rowid AS id FROM idx WHERE vector MATCH ? AND k = ?', ...
+        Q(i, :), k);
+    ann_time = ann_time + toc;
+    recall = recall + numel(intersect([exact.id], [approximate.id])) / k;
+  end
+  fprintf('Exact scan: %g ms/query.\n', 1000 * exact_time / num_queries);
+  fprintf('ANN index: %g ms/query, recall@%d = %g.\n', ...
+          1000 * ann_time / num_queries, k, recall / num_queries);
+  sqlite3.close();
+end
+
+function benchmark3
+%BENCHMARK_3 Per-call overhead of execute on a cached trivial statement.
+  num_calls = 100000;
+  sqlite3.open(':memory:');
+  sqlite3.execute('SELECT 1');
+  tic;
+  for i = 1:num_calls
+    sqlite3.execute('SELECT 1');
+  end
+  wrapper_time = toc;
+  tic;
+  for i = 1:num_calls
+    noop('SELECT 1');
+  end
+  baseline_time = toc;
+  fprintf('sqlite3.execute: %g us/call.\n', 1e6 * wrapper_time / num_calls);
+  fprintf('No-op function baseline: %g us/call.\n', ...
+          1e6 * baseline_time / num_calls);
+  sqlite3.close();
+end
+
+function noop(varargin)
+%NOOP Baseline of the function call overhead in benchmark3.
+end
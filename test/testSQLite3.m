@@ -4,7 +4,31 @@ function testSQLite3
 
   tests = {@test_functional_1, ...
            @test_functional_2, ...
-           @test_functional_3};
+           @test_functional_3, ...
+           @test_vector_functions, ...
+           @test_ann_index, ...
+           @test_execute_script, ...
+           @test_transactions, ...
+           @test_default_connection, ...
+           @test_table_format, ...
+           @test_dictionary_format, ...
+           @test_limits, ...
+           @test_spill, ...
+           @test_export_columns, ...
+           @test_export_arrow, ...
+           @test_import_csv, ...
+           @test_export_csv, ...
+           @test_insert, ...
+           @test_write_table, ...
+           @test_bulk_load, ...
+           @test_result_cache, ...
+           @test_track_changes, ...
+           @test_track_changes_failed_commit, ...
+           @test_changeset, ...
+           @test_connect, ...
+           @test_warm, ...
+           @test_busy_handler, ...
+           @test_auto_checkpoint};
   for i = 1:numel(tests)
     try
       tests{i}();
@@ -92,3 +116,740 @@ function test_functional_3
   assert(all(record.binary(:) == fixture.binary(:)));
   sqlite3.close();
 end
+
+function test_vector_functions
+%TEST_VECTOR_FUNCTIONS
+  X = single(rand(100, 16));
+  query = single(rand(1, 16));
+  sqlite3.open(':memory:');
+  sqlite3.execute('CREATE TABLE emb (id INTEGER, v BLOB)');
+  sqlite3.execute('BEGIN');
+  for i = 1:size(X, 1)
+    sqlite3.execute('INSERT INTO emb VALUES (?, ?)', i, X(i, :));
+  end
+  sqlite3.execute('COMMIT');
+  distances = sqrt(sum(bsxfun(@minus, double(X), double(query)) .^ 2, 2));
+  [~, order] = sort(distances);
+  results = sqlite3.execute(...
+      'SELECT id, vec_l2(v, ?) AS d FROM emb ORDER BY d LIMIT 5', query);
+  assert(all([results.id] == order(1:5)'));
+  assert(all(abs([results.d] - distances(order(1:5))') < 1e-4));
+  result = sqlite3.execute(...
+      'SELECT top_k(id, vec_l2(v, ?), 5) AS ids FROM emb', query);
+  assert(all(typecast(result.ids, 'int64') == order(1:5)));
+  result = sqlite3.execute('SELECT vec_dot(?, ?, ''float64'') AS d', ...
+                           [1, 2, 3], [4, 5, 6]);
+  assert(result.d == 32);
+  sqlite3.close();
+end
+
+function test_ann_index
+%TEST_ANN_INDEX
+  X = single(rand(200, 8));
+  sqlite3.open(':memory:');
+  sqlite3.execute(...
+      'CREATE VIRTUAL TABLE idx USING ann(dim=8, metric=l2, lists=4)');
+  sqlite3.execute('BEGIN');
+  for i = 1:size(X, 1)
+    sqlite3.execute('INSERT INTO idx(rowid, vector) VALUES (?, ?)', ...
+                    i, X(i, :));
+  end
+  sqlite3.execute('COMMIT');
+  results = sqlite3.execute(...
+      'SELECT rowid AS id, distance FROM idx WHERE vector MATCH ? AND k = 3', ...
+      X(10, :));
+  assert(numel(results) == 3);
+  assert(results(1).id == 10 && results(1).distance == 0);
+  assert(issorted([results.distance]));
+  sqlite3.execute('DELETE FROM idx WHERE rowid = 10');
+  results = sqlite3.execute(...
+      'SELECT rowid AS id FROM idx WHERE vector MATCH ? AND k = 3', X(10, :));
+  assert(~any([results.id] == 10));
+  sqlite3.close();
+end
+
+function test_execute_script
+%TEST_EXECUTE_SCRIPT
+  sqlite3.open(':memory:');
+  results = sqlite3.executeScript([...
+      'CREATE TABLE records (id INTEGER, name TEXT);' ...
+      'INSERT INTO records VALUES (?, ?);' ...
+      'INSERT INTO records VALUES (2, ''bar'');' ...
+      'SELECT * FROM records ORDER BY id;'], 1, 'foo');
+  assert(numel(results) == 2);
+  assert(strcmp(results(1).name, 'foo'));
+  try
+    sqlite3.executeScript([...
+        'INSERT INTO records VALUES (3, ''baz'');' ...
+        'INSERT INTO missing VALUES (4);']);
+    error('Script must fail.');
+  catch e
+    assert(~isempty(strfind(e.message, 'Statement 2 failed')));
+  end
+  result = sqlite3.execute('SELECT COUNT(*) AS count FROM records');
+  assert(result.count == 2);
+  sqlite3.close();
+end
+
+function test_transactions
+%TEST_TRANSACTIONS
+  filename = fullfile(fileparts(mfilename('fullpath')), '_test_tx_.sqlite3');
+  function cleanup(db_ids, filename)
+    for j = 1:numel(db_ids)
+      sqlite3.close(db_ids{j});
+    end
+    if exist(filename, 'file'), delete(filename); end
+  end
+
+  writer = sqlite3.open(filename);
+  reader = sqlite3.open(filename);
+  try
+    sqlite3.execute(writer, 'CREATE TABLE records (id INTEGER)');
+    sqlite3.begin(writer, 'immediate');
+    sqlite3.execute(writer, 'INSERT INTO records VALUES (1)');
+    sqlite3.savepoint(writer, 'second');
+    sqlite3.execute(writer, 'INSERT INTO records VALUES (2)');
+    sqlite3.rollback(writer, 'second');
+    sqlite3.release(writer, 'second');
+    sqlite3.commit(writer);
+    result = sqlite3.execute(reader, 'SELECT COUNT(*) AS count FROM records');
+    assert(result.count == 1);
+    sqlite3.groupCommit(writer, 2, 0);
+    sqlite3.execute(writer, 'INSERT INTO records VALUES (3)');
+    result = sqlite3.execute(reader, 'SELECT COUNT(*) AS count FROM records');
+    assert(result.count == 1);
+    sqlite3.execute(writer, 'INSERT INTO records VALUES (4)');
+    result = sqlite3.execute(reader, 'SELECT COUNT(*) AS count FROM records');
+    assert(result.count == 3);
+    sqlite3.execute(writer, 'INSERT INTO records VALUES (5)');
+    sqlite3.groupCommit(writer, 0, 0);
+    result = sqlite3.execute(reader, 'SELECT COUNT(*) AS count FROM records');
+    assert(result.count == 4);
+    % Rollback without a transaction of the caller keeps the buffered writes.
+    sqlite3.groupCommit(writer, 10, 0);
+    sqlite3.execute(writer, 'INSERT INTO records VALUES (6)');
+    try
+      sqlite3.rollback(writer);
+      assert(false);
+    catch e
+      assert(strcmp(e.identifier, 'sqlite3:error'));
+      assert(~isempty(strfind(e.message, 'no transaction is active')));
+    end
+    sqlite3.execute(writer, 'INSERT INTO records VALUES (7)');
+    try
+      sqlite3.execute(writer, 'ROLLBACK');
+      assert(false);
+    catch e
+      assert(strcmp(e.identifier, 'sqlite3:error'));
+      assert(~isempty(strfind(e.message, 'no transaction is active')));
+    end
+    sqlite3.groupCommit(writer, 0, 0);
+    result = sqlite3.execute(reader, 'SELECT COUNT(*) AS count FROM records');
+    assert(result.count == 6);
+  catch e
+    cleanup({writer, reader}, filename);
+    rethrow(e);
+  end
+  cleanup({writer, reader}, filename);
+end
+
+function test_default_connection
+%TEST_DEFAULT_CONNECTION
+  first = sqlite3.open(':memory:');
+  second = sqlite3.open(':memory:');
+  sqlite3.execute(first, 'CREATE TABLE first_table (id INTEGER)');
+  sqlite3.execute('CREATE TABLE second_table (id INTEGER)');
+  sqlite3.close();
+  result = sqlite3.execute('SELECT name FROM sqlite_master');
+  assert(strcmp(result.name, 'first_table'));
+  third = sqlite3.open(':memory:');
+  try
+    sqlite3.execute(second, 'SELECT 1');
+    error('Stale connection id is accepted.');
+  catch e
+    assert(strcmp(e.identifier, 'mexplus:session:notFound'));
+  end
+  sqlite3.close(third);
+  sqlite3.close(first);
+end
+
+function test_table_format
+%TEST_TABLE_FORMAT
+  sqlite3.open(':memory:');
+  sqlite3.execute(['CREATE TABLE records (id INTEGER, name TEXT, ' ...
+                   'data BLOB, value)']);
+  sqlite3.execute('INSERT INTO records VALUES (?, ?, ?, ?)', ...
+                  1, 'foo', uint8([1, 2]), 1);
+  sqlite3.execute('INSERT INTO records VALUES (?, ?, ?, ?)', ...
+                  2.5, [], [], 'bar');
+  result = sqlite3.execute(['SELECT id, name AS "Record Name", data, value ' ...
+                            'FROM records WHERE id > ?'], 0, ...
+                           'Format', 'table');
+  assert(istable(result));
+  assert(isequal(result.Properties.VariableNames, ...
+                 {'id', 'record_name', 'data', 'value'}));
+  assert(strcmp(result.Properties.VariableDescriptions{2}, 'Record Name'));
+  assert(isequal(result.id, [1; 2.5]));
+  assert(isstring(result.record_name));
+  assert(result.record_name(1) == "foo" && ismissing(result.record_name(2)));
+  assert(iscell(result.data) && isequal(result.data{1}, uint8([1, 2])));
+  assert(iscell(result.value) && strcmp(result.value{2}, 'bar'));
+  result = sqlite3.execute('SELECT id FROM records WHERE id > 5', ...
+                           'Format', 'table');
+  assert(istable(result) && height(result) == 0);
+  sqlite3.close();
+end
+
+function test_dictionary_format
+%TEST_DICTIONARY_FORMAT
+  sqlite3.open(':memory:');
+  sqlite3.execute('CREATE TABLE events (id INTEGER, status TEXT, note TEXT)');
+  sqlite3.begin();
+  for i = 1:2000
+    status = {'ok', 'error', []};
+    sqlite3.execute('INSERT INTO events VALUES (?, ?, ?)', ...
+                    i, status{mod(i, 3) + 1}, sprintf('note %d', i));
+  end
+  sqlite3.commit();
+  result = sqlite3.execute('SELECT status, note FROM events', ...
+                           'Format', 'table', 'Dictionary', 'auto');
+  assert(iscategorical(result.status));
+  assert(isequal(sort(categories(result.status)), {'error'; 'ok'}));
+  assert(sum(isundefined(result.status)) == 666);
+  assert(isstring(result.note));
+  result = sqlite3.execute('SELECT note FROM events', ...
+                           'Format', 'table', 'Dictionary', 'on');
+  assert(iscategorical(result.note));
+  sqlite3.execute('CREATE TABLE labels (name TEXT)');
+  sqlite3.execute('INSERT INTO labels VALUES (?), (?), (?)', ' ', 'a', 'a ');
+  result = sqlite3.execute('SELECT name FROM labels', ...
+                           'Format', 'table', 'Dictionary', 'on');
+  assert(isstring(result.name));
+  assert(isequal(result.name, [" "; "a"; "a "]));
+  sqlite3.close();
+end
+
+function test_limits
+%TEST_LIMITS
+  sqlite3.open(':memory:');
+  sqlite3.execute('CREATE TABLE records (id INTEGER, name TEXT)');
+  sqlite3.executeScript(['WITH RECURSIVE n(i) AS (' ...
+                         'SELECT 1 UNION ALL SELECT i + 1 FROM n ' ...
+                         'WHERE i < 1000) ' ...
+                         'INSERT INTO records SELECT i, ''row'' FROM n']);
+  function assertError(identifier, varargin)
+    try
+      sqlite3.execute(varargin{:});
+      error('Limit is not enforced.');
+    catch e
+      assert(strcmp(e.identifier, identifier), e.message);
+    end
+  end
+  assertError('sqlite3:maxRows', 'SELECT * FROM records', 'MaxRows', 10);
+  assertError('sqlite3:maxBytes', 'SELECT * FROM records', 'MaxBytes', 1000);
+  assertError('sqlite3:deadline', ...
+              ['WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL ' ...
+               'SELECT i + 1 FROM n) SELECT COUNT(*) FROM n'], ...
+              'Deadline', 0.1);
+  limits = sqlite3.limits('MaxRows', 10);
+  assert(limits.MaxRows == 10);
+  assertError('sqlite3:maxRows', 'SELECT * FROM records');
+  result = sqlite3.execute('SELECT * FROM records LIMIT 10');
+  assert(numel(result) == 10);
+  result = sqlite3.execute('SELECT * FROM records', 'MaxRows', 0);
+  assert(numel(result) == 1000);
+  sqlite3.close();
+end
+
+function test_spill
+%TEST_SPILL
+  sqlite3.open(':memory:');
+  sqlite3.execute('CREATE TABLE records (id INTEGER, value REAL, name TEXT)');
+  sqlite3.executeScript(['WITH RECURSIVE n(i) AS (' ...
+                         'SELECT 1 UNION ALL SELECT i + 1 FROM n ' ...
+                         'WHERE i < 1000) ' ...
+                         'INSERT INTO records SELECT i, i / 2.0, ' ...
+                         'CASE WHEN i % 10 THEN ''row'' || i END FROM n']);
+  filename = [tempname(), '.col'];
+  cleaner = onCleanup(@() delete(filename));
+  columns = sqlite3.execute('SELECT * FROM records', ...
+                            'SpillThreshold', 1000, 'SpillFile', filename);
+  assert(isa(columns.id, 'memmapfile'));
+  assert(isequal(columns.id.Data.data, int64(1:1000)'));
+  assert(isequal(columns.value.Data.data, (1:1000)' / 2));
+  [names, valid] = sqlite3.readColumns(filename, 'name');
+  assert(isstring(names) && numel(names) == 1000);
+  assert(sum(~valid) == 100 && all(ismissing(names(~valid))));
+  assert(names(1) == "row1");
+  result = sqlite3.execute('SELECT * FROM records', 'SpillThreshold', 2^30);
+  assert(isstruct(result) && numel(result) == 1000);
+  sqlite3.close();
+end
+
+function test_export_columns
+%TEST_EXPORT_COLUMNS
+  sqlite3.open(':memory:');
+  sqlite3.execute('CREATE TABLE records (id INTEGER, value REAL, data BLOB)');
+  sqlite3.execute('INSERT INTO records VALUES (?, ?, ?)', 1, 0.5, uint8(1:4));
+  sqlite3.execute('INSERT INTO records VALUES (?, ?, ?)', 2, [], []);
+  sqlite3.execute('INSERT INTO records VALUES (?, ?, ?)', 3, 1.5, uint8(5));
+  filename = [tempname(), '.col'];
+  cleaner = onCleanup(@() delete(filename));
+  rows = sqlite3.exportColumns('SELECT *, id || ''x'' AS tag FROM records ' ...
+                               'WHERE id > ?', {0}, filename);
+  assert(rows == 3);
+  columns = sqlite3.readColumns(filename);
+  assert(isequal(columns.id.Data.data, int64([1; 2; 3])));
+  [values, valid] = sqlite3.readColumns(filename, 'value');
+  assert(isequal(valid, [true; false; true]));
+  assert(isnan(values(2)) && values(3) == 1.5);
+  values = sqlite3.readColumns(filename, 'data');
+  assert(isequal(values{1}, uint8(1:4)) && isempty(values{2}));
+  values = sqlite3.readColumns(filename, 'tag');
+  assert(isequal(values, ["1x"; "2x"; "3x"]));
+  sqlite3.close();
+end
+
+function test_export_arrow
+%TEST_EXPORT_ARROW
+  sqlite3.open(':memory:');
+  sqlite3.execute('CREATE TABLE records (id INTEGER, name TEXT)');
+  sqlite3.executeScript(['WITH RECURSIVE n(i) AS (' ...
+                         'SELECT 1 UNION ALL SELECT i + 1 FROM n ' ...
+                         'WHERE i < 1000) ' ...
+                         'INSERT INTO records SELECT i, ''row'' || i FROM n']);
+  filename = [tempname(), '.arrow'];
+  cleaner = onCleanup(@() delete(filename));
+  rows = sqlite3.exportArrow('SELECT * FROM records', {}, filename, ...
+                             'Format', 'file', 'BatchSize', 100);
+  assert(rows == 1000);
+  fid = fopen(filename, 'r');
+  data = fread(fid, inf, '*uint8')';
+  fclose(fid);
+  assert(strcmp(char(data(1:6)), 'ARROW1'));
+  assert(strcmp(char(data(end - 5:end)), 'ARROW1'));
+  rows = sqlite3.exportArrow('SELECT * FROM records WHERE id > ?', {990}, ...
+                             filename);
+  assert(rows == 10);
+  sqlite3.close();
+end
+
+function test_import_csv
+%TEST_IMPORT_CSV
+  sqlite3.open(':memory:');
+  filename = [tempname(), '.csv'];
+  cleaner = onCleanup(@() delete(filename));
+  fid = fopen(filename, 'w');
+  fprintf(fid, 'id,value,name\r\n');
+  for i = 1:1000
+    fprintf(fid, '%d,%g,"row, ""%d"""\r\n', i, i / 4, i);
+  end
+  fprintf(fid, '1001,,\r\n');
+  fclose(fid);
+  rows = sqlite3.importCSV('records', filename, 'Threads', 2);
+  assert(rows == 1001);
+  result = sqlite3.execute('SELECT typeof(id) AS a, typeof(value) AS b ' ...
+                           'FROM records WHERE id = 2');
+  assert(strcmp(result.a, 'integer') && strcmp(result.b, 'real'));
+  result = sqlite3.execute('SELECT * FROM records WHERE id = ?', 3);
+  assert(result.value == 0.75 && strcmp(result.name, 'row, "3"'));
+  result = sqlite3.execute('SELECT * FROM records WHERE id = 1001');
+  assert(isempty(result.value) && isempty(result.name));
+  fid = fopen(filename, 'a');
+  fprintf(fid, '1002,1\n');
+  fclose(fid);
+  try
+    sqlite3.importCSV('records', filename);
+    error('Malformed record is imported.');
+  catch e
+    assert(strcmp(e.identifier, 'sqlite3:import'), e.message);
+  end
+  result = sqlite3.execute('SELECT COUNT(*) AS count FROM records');
+  assert(result.count == 1001);
+  sqlite3.close();
+end
+
+function test_export_csv
+%TEST_EXPORT_CSV
+  sqlite3.open(':memory:');
+  sqlite3.execute('CREATE TABLE records (id INTEGER, value REAL, name TEXT)');
+  sqlite3.execute('INSERT INTO records VALUES (?, ?, ?)', 1, 0.1, 'a,"b"');
+  sqlite3.execute('INSERT INTO records VALUES (?, ?, ?)', 2, 1 / 3, '');
+  sqlite3.execute('INSERT INTO records VALUES (?, ?, ?)', 3, [], []);
+  filename = [tempname(), '.csv'];
+  cleaner = onCleanup(@() delete(filename));
+  rows = sqlite3.exportCSV('SELECT * FROM records', {}, filename);
+  assert(rows == 3);
+  text = fileread(filename);
+  assert(strcmp(text, sprintf(['id,value,name\n1,0.1,"a,""b"""\n' ...
+                               '2,0.3333333333333333,""\n3,,\n'])));
+  sqlite3.importCSV('copies', filename);
+  result = sqlite3.execute(['SELECT COUNT(*) AS count FROM records r ' ...
+                            'JOIN copies c ON r.id = c.id AND ' ...
+                            'r.value IS c.value AND r.name IS c.name']);
+  assert(result.count == 3);
+  rows = sqlite3.exportCSV('SELECT * FROM records WHERE id > ?', {1}, ...
+                           filename, 'Delimiter', '\t', 'Null', 'NA', ...
+                           'Header', false);
+  assert(rows == 2);
+  text = fileread(filename);
+  assert(strcmp(text, sprintf('2\t0.3333333333333333\t\n3\tNA\tNA\n')));
+  sqlite3.close();
+end
+
+function test_insert
+%TEST_INSERT
+  sqlite3.open(':memory:');
+  sqlite3.execute('CREATE TABLE records (id INTEGER, name TEXT, data BLOB)');
+  sqlite3.execute('INSERT INTO records VALUES (:id, @name, $data)', ...
+                  struct('id', 1, 'name', 'foo', 'data', uint8(1:4)));
+  result = sqlite3.execute('SELECT * FROM records WHERE id = :id', ...
+                           struct('id', 1));
+  assert(strcmp(result.name, 'foo') && isequal(result.data, uint8(1:4)));
+  rows = sqlite3.insert('records', struct('id', {2, 3}, ...
+                                          'name', {'bar', []}));
+  assert(rows == 2);
+  records = sqlite3.execute('SELECT * FROM records');
+  rows = sqlite3.insert('records', records);
+  assert(rows == 3);
+  data = table([4; 5], ["baz"; missing], 'VariableNames', {'id', 'name'});
+  rows = sqlite3.insert('records', data);
+  assert(rows == 2);
+  result = sqlite3.execute(['SELECT COUNT(*) AS count FROM records ' ...
+                            'WHERE name IS NULL']);
+  assert(result.count == 3);
+  sqlite3.execute('CREATE TABLE keys (id INTEGER PRIMARY KEY)');
+  try
+    sqlite3.insert('keys', struct('id', {6, 6}));
+    error('Expected a failure.');
+  catch e
+    assert(isempty(strfind(e.message, 'Expected')));
+  end
+  result = sqlite3.execute('SELECT COUNT(*) AS count FROM keys');
+  assert(result.count == 0);
+  sqlite3.close();
+end
+
+function test_write_table
+%TEST_WRITE_TABLE
+  sqlite3.open(':memory:');
+  data = table(int64([1; 2; 3]), ["a"; "b"; missing], [0.5; NaN; 1.5], ...
+               [true; false; true], 'VariableNames', ...
+               {'id', 'name', 'score', 'flag'});
+  rows = sqlite3.writeTable('results', data, 'PrimaryKey', 'id', ...
+                            'Indexes', {'name', {'score', 'name'}});
+  assert(rows == 3);
+  schema = sqlite3.execute(['SELECT sql FROM sqlite_master ' ...
+                            'WHERE name = "results"']);
+  assert(~isempty(strfind(schema.sql, '"id" INTEGER')));
+  assert(~isempty(strfind(schema.sql, '"name" TEXT')));
+  assert(~isempty(strfind(schema.sql, '"score" REAL')));
+  assert(~isempty(strfind(schema.sql, 'WITHOUT ROWID')));
+  indexes = sqlite3.execute(['SELECT name FROM sqlite_master ' ...
+                             'WHERE type = "index" ORDER BY name']);
+  assert(isequal({indexes.name}, {'results_name', 'results_score_name'}));
+  result = sqlite3.execute(['SELECT COUNT(*) AS count FROM results ' ...
+                            'WHERE name IS NULL OR score IS NULL']);
+  assert(result.count == 2);
+  try
+    sqlite3.writeTable('results', data);
+    error('Expected a failure.');
+  catch e
+    assert(isempty(strfind(e.message, 'Expected')));
+  end
+  data.id = data.id + 3;
+  rows = sqlite3.writeTable('results', data, 'Mode', 'append');
+  assert(rows == 3);
+  result = sqlite3.execute('SELECT COUNT(*) AS count FROM results');
+  assert(result.count == 6);
+  rows = sqlite3.writeTable('results', data(1, :), 'Mode', 'replace');
+  assert(rows == 1);
+  result = sqlite3.execute('SELECT COUNT(*) AS count FROM results');
+  assert(result.count == 1);
+  rows = sqlite3.writeTable("copies", data);
+  assert(rows == 3);
+  result = sqlite3.execute('SELECT COUNT(*) AS count FROM copies');
+  assert(result.count == 3);
+  sqlite3.close();
+end
+
+function test_bulk_load
+%TEST_BULK_LOAD
+  sqlite3.open(':memory:');
+  sqlite3.execute('CREATE TABLE records (id INTEGER PRIMARY KEY, name TEXT)');
+  sqlite3.execute('CREATE INDEX records_name ON records (name)');
+  function load()
+    indexes = sqlite3.execute(['SELECT name FROM sqlite_master ' ...
+                               'WHERE name = "records_name"']);
+    assert(isempty(indexes));
+    sync = sqlite3.execute('PRAGMA synchronous');
+    assert(sync.synchronous == 0);
+    sqlite3.insert('records', struct('name', {'foo', 'bar', 'baz'}));
+  end
+  sqlite3.bulkLoad('records', @load);
+  indexes = sqlite3.execute(['SELECT name FROM sqlite_master ' ...
+                             'WHERE name = "records_name"']);
+  assert(numel(indexes) == 1);
+  result = sqlite3.execute('SELECT COUNT(*) AS count FROM records');
+  assert(result.count == 3);
+  sqlite3.execute('CREATE UNIQUE INDEX records_unique ON records (name)');
+  sqlite3.bulkLoadBegin('records');
+  sqlite3.insert('records', struct('name', {'foo'}));
+  try
+    sqlite3.bulkLoadEnd();
+    error('Expected a failure.');
+  catch e
+    assert(isempty(strfind(e.message, 'Expected')));
+  end
+  sqlite3.execute('DELETE FROM records WHERE id = 4');
+  sqlite3.bulkLoadEnd();
+  indexes = sqlite3.execute(['SELECT name FROM sqlite_master ' ...
+                             'WHERE name LIKE "records_%"']);
+  assert(numel(indexes) == 2);
+  sqlite3.close();
+end
+
+function test_result_cache
+%TEST_RESULT_CACHE
+  sqlite3.open(':memory:');
+  sqlite3.execute('CREATE TABLE records (id INTEGER, name TEXT)');
+  sqlite3.execute('INSERT INTO records VALUES (?, ?)', 1, 'foo');
+  stats = sqlite3.resultCache('Capacity', 2^20);
+  assert(stats.Capacity == 2^20 && stats.Entries == 0);
+  for i = 1:3
+    result = sqlite3.execute('SELECT * FROM records WHERE id = ?', 1);
+    assert(strcmp(result.name, 'foo'));
+  end
+  stats = sqlite3.resultCache();
+  assert(stats.Hits == 2 && stats.Misses == 1 && stats.Entries == 1);
+  sqlite3.execute('UPDATE records SET name = ? WHERE id = ?', 'bar', 1);
+  result = sqlite3.execute('SELECT * FROM records WHERE id = ?', 1);
+  assert(strcmp(result.name, 'bar'));
+  result = sqlite3.execute('SELECT * FROM records WHERE id = ?', 1, ...
+                           'Format', 'table');
+  assert(istable(result));
+  % Results read in a transaction are not kept after a rollback.
+  sqlite3.begin('deferred');
+  sqlite3.execute('INSERT INTO records VALUES (?, ?)', 2, 'baz');
+  result = sqlite3.execute('SELECT count(*) AS n FROM records');
+  assert(result.n == 2);
+  sqlite3.rollback();
+  result = sqlite3.execute('SELECT count(*) AS n FROM records');
+  assert(result.n == 1);
+  stats = sqlite3.resultCache('Clear', true);
+  assert(stats.Entries == 0 && stats.Bytes == 0);
+  stats = sqlite3.resultCache('Capacity', 0);
+  assert(stats.Capacity == 0);
+  sqlite3.close();
+end
+
+function test_track_changes
+%TEST_TRACK_CHANGES
+  sqlite3.open(':memory:');
+  sqlite3.execute('CREATE TABLE records (id INTEGER, name TEXT)');
+  sqlite3.execute('INSERT INTO records VALUES (?, ?)', 1, 'foo');
+  token = sqlite3.trackChanges('Capacity', 10);
+  sqlite3.execute('INSERT INTO records VALUES (?, ?)', 2, 'bar');
+  sqlite3.execute('UPDATE records SET name = ? WHERE id = ?', 'baz', 1);
+  sqlite3.begin('deferred');
+  sqlite3.execute('DELETE FROM records');
+  sqlite3.rollback();
+  changes = sqlite3.changesSince(token);
+  assert(~changes.Overflow && numel(changes.Tables) == 1);
+  assert(strcmp(changes.Tables.Table, 'records'));
+  assert(isequal(changes.Tables.Inserted, int64(2)));
+  assert(isequal(changes.Tables.Updated, int64(1)));
+  assert(isempty(changes.Tables.Deleted));
+  token = changes.Token;
+  changes = sqlite3.changesSince(token);
+  assert(isempty(changes.Tables) && changes.Token == token);
+  sqlite3.execute(['WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL ' ...
+                   'SELECT i + 1 FROM n LIMIT 20) ' ...
+                   'INSERT INTO records SELECT i, "x" FROM n']);
+  changes = sqlite3.changesSince(token);
+  assert(changes.Overflow);
+  sqlite3.trackChanges('Capacity', 0);
+  sqlite3.close();
+end
+
+function test_track_changes_failed_commit
+%TEST_TRACK_CHANGES_FAILED_COMMIT
+  filename = [tempname, '.sqlite3'];
+  writer = sqlite3.open(filename);
+  reader = sqlite3.open(filename);
+  sqlite3.execute(writer, 'CREATE TABLE records (id INTEGER)');
+  sqlite3.busyHandler(writer, 'MaxWait', 0);
+  token = sqlite3.trackChanges(writer, 'Capacity', 10);
+  sqlite3.begin(reader, 'deferred');
+  sqlite3.execute(reader, 'SELECT * FROM records');
+  sqlite3.begin(writer, 'deferred');
+  sqlite3.execute(writer, 'INSERT INTO records VALUES (1)');
+  try
+    sqlite3.commit(writer);
+    assert(false);
+  catch e
+    assert(strcmp(e.identifier, 'sqlite3:error'), e.message);
+  end
+  changes = sqlite3.changesSince(writer, token);
+  assert(isempty(changes.Tables));
+  sqlite3.rollback(writer);
+  sqlite3.commit(reader);
+  sqlite3.execute(writer, 'INSERT INTO records VALUES (2)');
+  changes = sqlite3.changesSince(writer, token);
+  assert(isequal(changes.Tables.Inserted, int64(1)));
+  sqlite3.close(reader);
+  sqlite3.close(writer);
+  delete(filename);
+end
+
+function test_changeset
+%TEST_CHANGESET
+  source = sqlite3.open(':memory:');
+  replica = sqlite3.open(':memory:');
+  for database = [source, replica]
+    sqlite3.execute(database, ...
+                    'CREATE TABLE records (id INTEGER PRIMARY KEY, name TEXT)');
+    sqlite3.execute(database, 'INSERT INTO records VALUES (1, "foo")');
+  end
+  try
+    session = sqlite3.sessionStart(source, 'records');
+  catch e
+    % The driver is built without the session extension.
+    assert(strcmp(e.identifier, 'sqlite3:session'));
+    sqlite3.close(source);
+    sqlite3.close(replica);
+    return;
+  end
+  sqlite3.execute(source, 'INSERT INTO records VALUES (2, "bar")');
+  sqlite3.execute(source, 'UPDATE records SET name = "baz" WHERE id = 1');
+  bytes = sqlite3.changeset(session);
+  assert(isa(bytes, 'uint8') && ~isempty(bytes));
+  sqlite3.sessionEnd(session);
+  assert(sqlite3.applyChangeset(replica, bytes) == 0);
+  result = sqlite3.execute(replica, 'SELECT name FROM records ORDER BY id');
+  assert(isequal({result.name}, {'baz', 'bar'}));
+  sqlite3.execute(replica, 'UPDATE records SET name = "qux" WHERE id = 1');
+  try
+    sqlite3.applyChangeset(replica, bytes, 'abort');
+    assert(false);
+  catch e
+    assert(strcmp(e.identifier, 'sqlite3:session'));
+  end
+  assert(sqlite3.applyChangeset(replica, bytes, 'omit') > 0);
+  sqlite3.close(source);
+  sqlite3.close(replica);
+end
+
+function test_connect
+%TEST_CONNECT
+  filename = [tempname, '.sqlite3'];
+  database = sqlite3.open(filename);
+  sqlite3.execute(database, 'CREATE TABLE records (id INTEGER, name TEXT)');
+  sqlite3.execute(database, 'INSERT INTO records VALUES (?, ?)', 1, 'foo');
+  sqlite3.close(database);
+  descriptor = sqlite3.descriptor(filename, 'Immutable', true, ...
+                                  'Pragmas', {'cache_size = -1024'});
+  database = sqlite3.connect(descriptor);
+  assert(sqlite3.connect(descriptor) == database);
+  result = sqlite3.execute(database, 'SELECT name FROM records');
+  assert(strcmp(result.name, 'foo'));
+  result = sqlite3.execute(database, 'PRAGMA cache_size');
+  assert(result.cache_size == -1024);
+  try
+    sqlite3.execute(database, 'DELETE FROM records');
+    assert(false);
+  catch e
+    assert(strcmp(e.identifier, 'sqlite3:error'), e.message);
+    assert(~isempty(strfind(e.message, 'readonly')));
+  end
+  sqlite3.close(database);
+  assert(sqlite3.connect(descriptor) ~= database);
+  sqlite3.close(sqlite3.connect(descriptor));
+  delete(filename);
+end
+
+function test_warm
+%TEST_WARM
+  filename = [tempname, '.sqlite3'];
+  database = sqlite3.open(filename);
+  sqlite3.execute(database, 'CREATE TABLE records (id INTEGER, name TEXT)');
+  sqlite3.execute(database, 'CREATE INDEX records_name ON records (name)');
+  sqlite3.insert(database, 'records', struct('id', num2cell(1:100), ...
+                                             'name', 'foo'));
+  sqlite3.warm(database, 'Wait', true);
+  sqlite3.warm(database, 'Tables', 'records', 'Wait', true);
+  sqlite3.warm(database, 'Tables', {'records'}, 'Mode', 'pagecache');
+  result = sqlite3.execute(database, 'SELECT count(*) AS n FROM records');
+  assert(result.n == 100);
+  try
+    sqlite3.warm(database, 'Tables', 'missing');
+    assert(false);
+  catch e
+    assert(strcmp(e.identifier, 'sqlite3:error'), e.message);
+    assert(~isempty(strfind(e.message, 'No such table: missing')));
+  end
+  sqlite3.warm(database);
+  sqlite3.close(database);
+  delete(filename);
+end
+
+function test_busy_handler
+%TEST_BUSY_HANDLER
+  filename = [tempname, '.sqlite3'];
+  writer = sqlite3.open(filename);
+  reader = sqlite3.open(filename);
+  sqlite3.execute(writer, 'CREATE TABLE records (id INTEGER)');
+  sqlite3.busyHandler(reader, 'MaxWait', 100, 'MaxDelay', 20);
+  sqlite3.begin(writer, 'immediate');
+  try
+    sqlite3.execute(reader, 'INSERT INTO records VALUES (?)', 1);
+    assert(false);
+  catch e
+  end
+  sqlite3.commit(writer);
+  stats = sqlite3.busyStats(reader, 'Reset', true);
+  assert(stats.Events == 1 && stats.Failures == 1 && stats.Retries > 0);
+  assert(stats.WaitTime > 0.05 && stats.LongestWait >= stats.WaitTime);
+  stats = sqlite3.busyStats(reader);
+  assert(stats.Events == 0);
+  rows = sqlite3.transaction(reader, @() sqlite3.insert(reader, ...
+      'records', struct('id', {2, 3})));
+  assert(rows == 2);
+  try
+    sqlite3.transaction(reader, @() error('test:error', 'Rolled back.'));
+    assert(false);
+  catch e
+    assert(strcmp(e.identifier, 'test:error'));
+  end
+  result = sqlite3.execute(writer, 'SELECT count(*) AS n FROM records');
+  assert(result.n == 2);
+  sqlite3.close(writer);
+  sqlite3.close(reader);
+  delete(filename);
+end
+
+function test_auto_checkpoint
+%TEST_AUTO_CHECKPOINT
+  filename = [tempname, '.sqlite3'];
+  database = sqlite3.open(filename);
+  sqlite3.execute(database, 'PRAGMA auto_vacuum = INCREMENTAL');
+  sqlite3.execute(database, 'PRAGMA journal_mode = WAL');
+  sqlite3.execute(database, 'PRAGMA wal_autocheckpoint = 0');
+  sqlite3.execute(database, 'CREATE TABLE records (value BLOB)');
+  sqlite3.autoCheckpoint(database, 'Interval', 50, 'MaxWalSize', 2^16, ...
+                         'VacuumPages', 1000);
+  sqlite3.insert(database, 'records', ...
+                 struct('value', num2cell(uint8(rand(1000, 100) * 255), 2)));
+  sqlite3.execute(database, 'DELETE FROM records');
+  pause(0.5);
+  stats = sqlite3.checkpointStats(database, 'Reset', true);
+  assert(stats.Checkpoints > 0 && stats.Truncates > 0);
+  assert(stats.VacuumedPages > 0 && stats.MaxWalSize > 2^16);
+  sqlite3.autoCheckpoint(database, 'Interval', 0);
+  stats = sqlite3.checkpointStats(database);
+  assert(stats.Checkpoints == 0);
+  sqlite3.close(database);
+  delete(filename);
+  delete([filename, '-wal']);
+  delete([filename, '-shm']);
+end